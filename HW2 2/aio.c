@@ -0,0 +1,707 @@
+///////////////////// ASYNCHRONOUS I/O SOURCE FILE README///////////////////////
+
+//This file contains the implementation (`aio.c`) of the asynchronous I/O of
+//the user-level threads. The io_uring rings are mapped and driven with the
+//raw system calls of `linux/io_uring.h`; the submission queue has a single
+//producer and the completion queue a single consumer, the kernel thread of
+//the core, so only the head and tail indexes need ordered accesses.
+//The worker threads of the epoll backend are shared by every core and are
+//started with the first instance that needs them. The waiters of an epoll
+//instance have a lock: a task stolen after its descriptor became ready does
+//its operation, and wakes the next waiter, from another core.
+
+#define _GNU_SOURCE // preadv2, pwritev2
+#include "aio.h"
+#include <errno.h>
+#include <linux/io_uring.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#define pAIO_EVENTS 64 // Readiness events reaped by one epoll_wait
+
+// Stages of a request
+#define pAIO_OUT 0 // In the io_uring ring, or handed back to its task
+#define pAIO_BACKLOG 1 // Waiting for room in the ring
+#define pAIO_WAITING 2 // Waiting for its descriptor to be ready
+#define pAIO_QUEUED 3 // Waiting for a worker
+#define pAIO_WORKING 4 // Done by a worker
+
+// Descriptor waited for by the epoll backend
+struct AioWatch {
+  int fd;
+  int registered; // In the epoll instance
+  unsigned armed; // Directions the registration waits for, 0 once it fired
+  unsigned busy; // Directions woken whose operation is not done yet
+  AioRequest *head, *tail; // Waiters in submission order
+  struct AioWatch *next; // Bucket link
+};
+
+// %%%%%%%%%%%%%%%%%%%%%% Plain System Calls %%%%%%%%%%%%%%%%%%%%%%
+
+// Do an operation synchronously
+static long long aioDo(AioRequest *request) {
+  ssize_t n;
+  if (request->op == pAIO_READ) {
+    n = request->offset < 0 ? read(request->fd, request->buf, request->len)
+                            : pread(request->fd, request->buf, request->len, request->offset);
+  } else {
+    n = request->offset < 0 ? write(request->fd, request->buf, request->len)
+                            : pwrite(request->fd, request->buf, request->len, request->offset);
+  }
+  return n < 0 ? -errno : n;
+}
+
+// Push a request on the completion list, from any thread
+static void pushDone(Aio *aio, AioRequest *request) {
+  AioRequest *head = __atomic_load_n(&aio->done, __ATOMIC_RELAXED);
+  do {
+    request->next = head;
+  } while (!__atomic_compare_exchange_n(&aio->done, &head, request, 1,
+                                        __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+
+// Take up to max - n requests of the completion list, its order does not matter
+static int takeDone(Aio *aio, AioRequest **done, int n, int max) {
+  if (n >= max || __atomic_load_n(&aio->done, __ATOMIC_RELAXED) == NULL) {
+    return n;
+  }
+  AioRequest *request = __atomic_exchange_n(&aio->done, NULL, __ATOMIC_ACQUIRE);
+  while (request != NULL && n < max) {
+    AioRequest *next = request->next;
+    done[n++] = request;
+    request = next;
+  }
+  // Put back what did not fit
+  while (request != NULL) {
+    AioRequest *next = request->next;
+    pushDone(aio, request);
+    request = next;
+  }
+  return n;
+}
+
+// Do an operation whose descriptor became ready, without blocking: a task
+// of another core may have taken the data or the room first
+static long long aioDoNowait(AioRequest *request) {
+  struct iovec iov = {request->buf, request->len};
+  ssize_t n = request->op == pAIO_READ ? preadv2(request->fd, &iov, 1, request->offset, RWF_NOWAIT)
+                                       : pwritev2(request->fd, &iov, 1, request->offset, RWF_NOWAIT);
+  if (n < 0 && errno == EOPNOTSUPP) {
+    return aioDo(request); // Descriptor without RWF_NOWAIT
+  }
+  return n < 0 ? -errno : n;
+}
+
+// %%%%%%%%%%%%%%%%%%%%%% io_uring %%%%%%%%%%%%%%%%%%%%%%
+
+static int uringSetup(unsigned entries, struct io_uring_params *params) {
+  return (int)syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int uringEnter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+  return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+// Create the rings and map them
+static int uringInit(Aio *aio) {
+  struct io_uring_params params;
+  memset(&params, 0, sizeof(params));
+  int fd = uringSetup(pAIO_ENTRIES, &params);
+  if (fd < 0) {
+    return -1;
+  }
+  // Reads and writes at the current position (-1) need 5.6
+  if (!(params.features & IORING_FEAT_RW_CUR_POS)) {
+    close(fd);
+    return -1;
+  }
+
+  aio->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  aio->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+  if (params.features & IORING_FEAT_SINGLE_MMAP) {
+    if (aio->cq_ring_size > aio->sq_ring_size) {
+      aio->sq_ring_size = aio->cq_ring_size;
+    }
+    aio->cq_ring_size = aio->sq_ring_size;
+  }
+  aio->sq_ring = mmap(NULL, aio->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      fd, IORING_OFF_SQ_RING);
+  if (aio->sq_ring == MAP_FAILED) {
+    close(fd);
+    return -1;
+  }
+  aio->cq_ring = aio->sq_ring;
+  if (!(params.features & IORING_FEAT_SINGLE_MMAP)) {
+    aio->cq_ring = mmap(NULL, aio->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                        fd, IORING_OFF_CQ_RING);
+    if (aio->cq_ring == MAP_FAILED) {
+      munmap(aio->sq_ring, aio->sq_ring_size);
+      close(fd);
+      return -1;
+    }
+  }
+  aio->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+  aio->sqes = mmap(NULL, aio->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                   fd, IORING_OFF_SQES);
+  if (aio->sqes == MAP_FAILED) {
+    if (aio->cq_ring != aio->sq_ring) {
+      munmap(aio->cq_ring, aio->cq_ring_size);
+    }
+    munmap(aio->sq_ring, aio->sq_ring_size);
+    close(fd);
+    return -1;
+  }
+
+  char *sq = aio->sq_ring;
+  char *cq = aio->cq_ring;
+  aio->sq_head = (unsigned *)(sq + params.sq_off.head);
+  aio->sq_tail = (unsigned *)(sq + params.sq_off.tail);
+  aio->sq_mask = (unsigned *)(sq + params.sq_off.ring_mask);
+  aio->sq_entries = (unsigned *)(sq + params.sq_off.ring_entries);
+  aio->sq_array = (unsigned *)(sq + params.sq_off.array);
+  aio->cq_head = (unsigned *)(cq + params.cq_off.head);
+  aio->cq_tail = (unsigned *)(cq + params.cq_off.tail);
+  aio->cq_mask = (unsigned *)(cq + params.cq_off.ring_mask);
+  aio->cqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+  aio->fd = fd;
+  aio->to_submit = 0;
+  return 0;
+}
+
+// Hand the queued entries to the kernel
+static void uringFlush(Aio *aio) {
+  while (aio->to_submit > 0) {
+    int n = uringEnter(aio->fd, aio->to_submit, 0, 0);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return; // EAGAIN or EBUSY: retried on the next poll, after reaping
+    }
+    aio->to_submit -= n;
+  }
+}
+
+// Fill a submission queue entry, -1 if the ring is full
+static int uringQueue(Aio *aio, AioRequest *request) {
+  unsigned tail = *aio->sq_tail;
+  if (tail - __atomic_load_n(aio->sq_head, __ATOMIC_ACQUIRE) >= *aio->sq_entries) {
+    uringFlush(aio);
+    if (tail - __atomic_load_n(aio->sq_head, __ATOMIC_ACQUIRE) >= *aio->sq_entries) {
+      return -1;
+    }
+  }
+  unsigned index = tail & *aio->sq_mask;
+  struct io_uring_sqe *sqe = &aio->sqes[index];
+  memset(sqe, 0, sizeof(*sqe));
+  sqe->opcode = request->op == pAIO_READ ? IORING_OP_READ : IORING_OP_WRITE;
+  sqe->fd = request->fd;
+  sqe->addr = (uint64_t)(uintptr_t)request->buf;
+  sqe->len = (unsigned)request->len;
+  sqe->off = (uint64_t)request->offset; // -1 is the current position
+  sqe->user_data = (uint64_t)(uintptr_t)request;
+  aio->sq_array[index] = index;
+  __atomic_store_n(aio->sq_tail, tail + 1, __ATOMIC_RELEASE);
+  aio->to_submit++;
+  request->stage = pAIO_OUT;
+  return 0;
+}
+
+// Move the backlog into the ring while it has room
+static void uringRefill(Aio *aio) {
+  while (aio->backlog != NULL && uringQueue(aio, aio->backlog) == 0) {
+    aio->backlog = aio->backlog->next;
+  }
+  if (aio->backlog == NULL) {
+    aio->backlog_tail = NULL;
+  }
+}
+
+// Queue a request, behind the backlog to keep the order on a descriptor
+static void uringSubmit(Aio *aio, AioRequest *request) {
+  if (aio->backlog == NULL && uringQueue(aio, request) == 0) {
+    return;
+  }
+  request->stage = pAIO_BACKLOG;
+  request->next = NULL;
+  if (aio->backlog_tail != NULL) {
+    aio->backlog_tail->next = request;
+  } else {
+    aio->backlog = request;
+  }
+  aio->backlog_tail = request;
+}
+
+// Ask the kernel to cancel a request, the entry itself completes with no request
+static void uringCancel(Aio *aio, AioRequest *request) {
+  if (request->stage == pAIO_BACKLOG) {
+    // Never reached the kernel
+    AioRequest **link = &aio->backlog;
+    AioRequest *previous = NULL;
+    while (*link != request) {
+      previous = *link;
+      link = &(*link)->next;
+    }
+    *link = request->next;
+    if (aio->backlog_tail == request) {
+      aio->backlog_tail = previous;
+    }
+    request->result = -ECANCELED;
+    pushDone(aio, request);
+    return;
+  }
+  unsigned tail = *aio->sq_tail;
+  if (tail - __atomic_load_n(aio->sq_head, __ATOMIC_ACQUIRE) >= *aio->sq_entries) {
+    uringFlush(aio);
+    if (tail - __atomic_load_n(aio->sq_head, __ATOMIC_ACQUIRE) >= *aio->sq_entries) {
+      return; // The operation completes normally
+    }
+  }
+  unsigned index = tail & *aio->sq_mask;
+  struct io_uring_sqe *sqe = &aio->sqes[index];
+  memset(sqe, 0, sizeof(*sqe));
+  sqe->opcode = IORING_OP_ASYNC_CANCEL;
+  sqe->fd = -1;
+  sqe->addr = (uint64_t)(uintptr_t)request;
+  sqe->user_data = 0;
+  aio->sq_array[index] = index;
+  __atomic_store_n(aio->sq_tail, tail + 1, __ATOMIC_RELEASE);
+  aio->to_submit++;
+}
+
+static int uringReap(Aio *aio, AioRequest **done, int max) {
+  unsigned head = *aio->cq_head;
+  unsigned tail = __atomic_load_n(aio->cq_tail, __ATOMIC_ACQUIRE);
+  int n = 0;
+  while (head != tail && n < max) {
+    struct io_uring_cqe *cqe = &aio->cqes[head & *aio->cq_mask];
+    AioRequest *request = (AioRequest *)(uintptr_t)cqe->user_data;
+    head++;
+    if (request == NULL) {
+      continue; // Completion of a cancel entry
+    }
+    request->result = cqe->res;
+    done[n++] = request;
+  }
+  __atomic_store_n(aio->cq_head, head, __ATOMIC_RELEASE);
+  return n;
+}
+
+// %%%%%%%%%%%%%%%%%%%%%% Worker Threads %%%%%%%%%%%%%%%%%%%%%%
+
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t pool_cond = PTHREAD_COND_INITIALIZER;
+static pthread_t workers[pAIO_WORKERS];
+static AioRequest *queue_head, *queue_tail; // Waiting for a worker
+static int pool_users; // epoll instances, the workers stop at 0
+static int pool_stop;
+
+static void *workerMain(void *arg) {
+  (void)arg;
+  pthread_mutex_lock(&pool_lock);
+  for (;;) {
+    while (queue_head == NULL && !pool_stop) {
+      pthread_cond_wait(&pool_cond, &pool_lock);
+    }
+    if (queue_head == NULL) {
+      break;
+    }
+    AioRequest *request = queue_head;
+    queue_head = request->next;
+    if (queue_head == NULL) {
+      queue_tail = NULL;
+    }
+    request->stage = pAIO_WORKING;
+    pthread_mutex_unlock(&pool_lock);
+
+    request->result = aioDo(request);
+    // Push on the completion list of the core and wake it if idle
+    Aio *aio = request->aio;
+    pushDone(aio, request);
+    uint64_t one = 1;
+    ssize_t unused = write(aio->event, &one, sizeof(one));
+    (void)unused;
+
+    pthread_mutex_lock(&pool_lock);
+  }
+  pthread_mutex_unlock(&pool_lock);
+  return NULL;
+}
+
+// Start the workers with the first epoll instance
+static int poolJoin(void) {
+  pthread_mutex_lock(&pool_lock);
+  if (pool_users == 0) {
+    pool_stop = 0;
+    for (int i = 0; i < pAIO_WORKERS; i++) {
+      if (pthread_create(&workers[i], NULL, workerMain, NULL) != 0) {
+        pool_stop = 1;
+        pthread_cond_broadcast(&pool_cond);
+        pthread_mutex_unlock(&pool_lock);
+        for (int j = 0; j < i; j++) {
+          pthread_join(workers[j], NULL);
+        }
+        return -1;
+      }
+    }
+  }
+  pool_users++;
+  pthread_mutex_unlock(&pool_lock);
+  return 0;
+}
+
+// Stop the workers with the last one
+static void poolLeave(void) {
+  pthread_mutex_lock(&pool_lock);
+  int last = --pool_users == 0;
+  if (last) {
+    pool_stop = 1;
+    pthread_cond_broadcast(&pool_cond);
+  }
+  pthread_mutex_unlock(&pool_lock);
+  if (last) {
+    for (int i = 0; i < pAIO_WORKERS; i++) {
+      pthread_join(workers[i], NULL);
+    }
+  }
+}
+
+static void poolSubmit(AioRequest *request) {
+  request->next = NULL;
+  pthread_mutex_lock(&pool_lock);
+  request->stage = pAIO_QUEUED;
+  if (queue_tail != NULL) {
+    queue_tail->next = request;
+  } else {
+    queue_head = request;
+  }
+  queue_tail = request;
+  pthread_cond_signal(&pool_cond);
+  pthread_mutex_unlock(&pool_lock);
+}
+
+// Take a request off the queue if no worker took it yet, 0 if one did
+static int poolCancel(AioRequest *request) {
+  pthread_mutex_lock(&pool_lock);
+  int queued = request->stage == pAIO_QUEUED;
+  if (queued) {
+    AioRequest **link = &queue_head;
+    AioRequest *previous = NULL;
+    while (*link != request) {
+      previous = *link;
+      link = &(*link)->next;
+    }
+    *link = request->next;
+    if (queue_tail == request) {
+      queue_tail = previous;
+    }
+  }
+  pthread_mutex_unlock(&pool_lock);
+  return queued;
+}
+
+// %%%%%%%%%%%%%%%%%%%%%% epoll %%%%%%%%%%%%%%%%%%%%%%
+
+static unsigned direction(const AioRequest *request) {
+  return request->op == pAIO_READ ? EPOLLIN : EPOLLOUT;
+}
+
+// Find the watch of a descriptor, created if asked, with the lock held
+static AioWatch *watchFind(Aio *aio, int fd, int create) {
+  AioWatch **bucket = &aio->watches[fd % pAIO_BUCKETS];
+  for (AioWatch *watch = *bucket; watch != NULL; watch = watch->next) {
+    if (watch->fd == fd) {
+      return watch;
+    }
+  }
+  if (!create) {
+    return NULL;
+  }
+  AioWatch *watch = calloc(1, sizeof(AioWatch));
+  if (watch != NULL) {
+    watch->fd = fd;
+    watch->next = *bucket;
+    *bucket = watch;
+  }
+  return watch;
+}
+
+static void watchUnlink(AioWatch *watch, AioRequest *request) {
+  AioRequest **link = &watch->head;
+  AioRequest *previous = NULL;
+  while (*link != request) {
+    previous = *link;
+    link = &(*link)->next;
+  }
+  *link = request->next;
+  if (watch->tail == request) {
+    watch->tail = previous;
+  }
+}
+
+// Register the directions that have a waiter and none woken, release the
+// watch once nothing waits on it
+static int watchArm(Aio *aio, AioWatch *watch) {
+  unsigned events = 0;
+  for (AioRequest *request = watch->head; request != NULL; request = request->next) {
+    events |= direction(request);
+  }
+  events &= ~watch->busy;
+  if (events == 0) {
+    if (watch->registered) {
+      epoll_ctl(aio->fd, EPOLL_CTL_DEL, watch->fd, NULL);
+      watch->registered = 0;
+    }
+    if (watch->head == NULL && watch->busy == 0) {
+      AioWatch **link = &aio->watches[watch->fd % pAIO_BUCKETS];
+      while (*link != watch) {
+        link = &(*link)->next;
+      }
+      *link = watch->next;
+      free(watch);
+    }
+    return 0;
+  }
+  if (watch->registered && watch->armed == events) {
+    return 0;
+  }
+  struct epoll_event ev = {.events = events | EPOLLONESHOT, .data.ptr = watch};
+  // A descriptor closed while registered left the instance with it
+  if (!watch->registered || (epoll_ctl(aio->fd, EPOLL_CTL_MOD, watch->fd, &ev) != 0 &&
+                             errno == ENOENT)) {
+    if (epoll_ctl(aio->fd, EPOLL_CTL_ADD, watch->fd, &ev) != 0) {
+      return -1;
+    }
+    watch->registered = 1;
+  }
+  watch->armed = events;
+  return 0;
+}
+
+static int epollInit(Aio *aio) {
+  aio->fd = epoll_create1(EPOLL_CLOEXEC);
+  aio->event = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  struct epoll_event ev = {.events = EPOLLIN, .data.ptr = NULL};
+  if (aio->fd < 0 || aio->event < 0 || epoll_ctl(aio->fd, EPOLL_CTL_ADD, aio->event, &ev) != 0 ||
+      poolJoin() != 0) {
+    if (aio->fd >= 0) {
+      close(aio->fd);
+    }
+    if (aio->event >= 0) {
+      close(aio->event);
+    }
+    return -1;
+  }
+  pthread_mutex_init(&aio->lock, NULL);
+  aio->done = NULL;
+  return 0;
+}
+
+static int epollSubmit(Aio *aio, AioRequest *request) {
+  if (request->fd < 0) {
+    return -1;
+  }
+  // Wait behind the other tasks of the core on a pollable descriptor
+  pthread_mutex_lock(&aio->lock);
+  AioWatch *watch = watchFind(aio, request->fd, 1);
+  if (watch == NULL) {
+    pthread_mutex_unlock(&aio->lock);
+    poolSubmit(request); // Out of memory, a worker waits instead
+    return 0;
+  }
+  request->stage = pAIO_WAITING;
+  request->next = NULL;
+  if (watch->tail != NULL) {
+    watch->tail->next = request;
+  } else {
+    watch->head = request;
+  }
+  watch->tail = request;
+  if (watchArm(aio, watch) == 0) {
+    pthread_mutex_unlock(&aio->lock);
+    return 0;
+  }
+  int error = errno;
+  watchUnlink(watch, request);
+  watchArm(aio, watch);
+  pthread_mutex_unlock(&aio->lock);
+  if (error != EPERM) {
+    return -1;
+  }
+
+  // Regular file: a worker does it
+  poolSubmit(request);
+  return 0;
+}
+
+// A request still waiting completes at once, a worker that already took
+// one finishes it
+static void epollCancel(Aio *aio, AioRequest *request) {
+  if (request->stage == pAIO_WAITING) {
+    pthread_mutex_lock(&aio->lock);
+    AioWatch *watch = watchFind(aio, request->fd, 0);
+    watchUnlink(watch, request);
+    watchArm(aio, watch);
+    pthread_mutex_unlock(&aio->lock);
+  } else if (request->stage != pAIO_QUEUED || !poolCancel(request)) {
+    return;
+  }
+  request->result = -ECANCELED;
+  pushDone(aio, request);
+}
+
+// Wake the first waiter of every ready direction that has none woken
+static int epollReap(Aio *aio, AioRequest **done, int max) {
+  int n = 0;
+  struct epoll_event events[pAIO_EVENTS];
+  int count = epoll_wait(aio->fd, events, max < pAIO_EVENTS ? max : pAIO_EVENTS, 0);
+  for (int i = 0; i < count; i++) {
+    AioWatch *watch = events[i].data.ptr;
+    if (watch == NULL) {
+      uint64_t value;
+      ssize_t unused = read(aio->event, &value, sizeof(value));
+      (void)unused;
+      continue;
+    }
+    pthread_mutex_lock(&aio->lock);
+    watch->armed = 0; // One-shot
+    unsigned ready = events[i].events;
+    AioRequest *request = watch->head;
+    while (request != NULL && n < max) {
+      AioRequest *next = request->next;
+      unsigned d = direction(request);
+      if (!(watch->busy & d) && (ready & (d | EPOLLERR | EPOLLHUP))) {
+        watchUnlink(watch, request);
+        watch->busy |= d;
+        request->stage = pAIO_OUT;
+        request->ready = 1;
+        done[n++] = request;
+      }
+      request = next;
+    }
+    watchArm(aio, watch);
+    pthread_mutex_unlock(&aio->lock);
+  }
+  return takeDone(aio, done, n, max);
+}
+
+// The woken task did its operation, wake the next waiter of its direction
+static void epollRelease(Aio *aio, AioRequest *request) {
+  pthread_mutex_lock(&aio->lock);
+  AioWatch *watch = watchFind(aio, request->fd, 0);
+  if (watch != NULL) {
+    watch->busy &= ~direction(request);
+    watchArm(aio, watch);
+  }
+  pthread_mutex_unlock(&aio->lock);
+}
+
+// %%%%%%%%%%%%%%%%%%%%%% Interface %%%%%%%%%%%%%%%%%%%%%%
+
+int aioInit(Aio *aio, int uring) {
+  memset(aio, 0, sizeof(Aio));
+  aio->event = -1;
+  if (uring && uringInit(aio) == 0) {
+    aio->uring = 1;
+    return 0;
+  }
+  return epollInit(aio);
+}
+
+void aioDestroy(Aio *aio) {
+  if (aio->uring) {
+    munmap(aio->sqes, aio->sqes_size);
+    if (aio->cq_ring != aio->sq_ring) {
+      munmap(aio->cq_ring, aio->cq_ring_size);
+    }
+    munmap(aio->sq_ring, aio->sq_ring_size);
+  } else {
+    poolLeave();
+    close(aio->event);
+    for (int i = 0; i < pAIO_BUCKETS; i++) {
+      while (aio->watches[i] != NULL) {
+        AioWatch *next = aio->watches[i]->next;
+        free(aio->watches[i]);
+        aio->watches[i] = next;
+      }
+    }
+    pthread_mutex_destroy(&aio->lock);
+  }
+  close(aio->fd);
+}
+
+// Queue an operation of the task running on the core of aio
+int aioSubmit(Aio *aio, AioRequest *request) {
+  request->ready = 0;
+  request->aio = aio;
+  request->stage = pAIO_OUT;
+  if (aio->uring) {
+    uringSubmit(aio, request);
+  } else if (epollSubmit(aio, request) != 0) {
+    // Not a descriptor: fails at once
+    request->result = aioDo(request);
+    return 1;
+  }
+  aio->pending++;
+  return 0;
+}
+
+int aioPoll(Aio *aio, AioRequest **done, int max) {
+  if (aio->pending == 0) {
+    return 0;
+  }
+  int n;
+  if (aio->uring) {
+    uringFlush(aio);
+    if (aio->backlog != NULL) {
+      uringRefill(aio);
+      uringFlush(aio);
+    }
+    n = takeDone(aio, done, uringReap(aio, done, max), max);
+  } else {
+    n = epollReap(aio, done, max);
+  }
+  aio->pending -= n;
+  return n;
+}
+
+// Can run on another core than the one that reaped the request (stealing)
+long long aioFinish(AioRequest *request) {
+  request->retry = 0;
+  if (request->ready) {
+    request->ready = 0;
+    if (request->aio == NULL) {
+      request->result = aioDo(request); // Never submitted
+    } else {
+      request->result = aioDoNowait(request);
+      request->retry = request->result == -EAGAIN;
+      epollRelease(request->aio, request);
+    }
+  }
+  return request->result;
+}
+
+// Cancel an operation in flight
+void aioCancel(Aio *aio, AioRequest *request) {
+  if (aio->uring) {
+    uringCancel(aio, request);
+  } else {
+    epollCancel(aio, request);
+  }
+}
+
+int aioPending(const Aio *aio) {
+  return aio->pending;
+}
+
+const char *aioName(const Aio *aio) {
+  return aio->uring ? "io_uring" : "epoll";
+}
@@ -0,0 +1,98 @@
+///////////////////// ASYNCHRONOUS I/O HEADER FILE README///////////////////////
+
+//This file contains the header (`aio.h`) for the asynchronous I/O of the
+//user-level threads. Every core owns one `Aio`: a task queues a read or a
+//write on the `Aio` of its core and blocks, the scheduling loop of the core
+//submits the queued operations, runs other tasks meanwhile and makes the
+//task ready again when its operation completes. Thousands of I/O bound tasks
+//thus overlap on a single kernel thread.
+
+// BACKENDS
+// *`io_uring`: Raw system calls, no liburing. Tasks fill submission queue
+//  entries without entering the kernel; the loop submits them in one batch
+//  and reaps the completion queue from shared memory.
+// *`epoll`: Pollable descriptors (pipes, sockets) are waited for with a
+//  one-shot epoll registration and the task does the operation once it is
+//  ready. The tasks waiting on a descriptor are kept in submission order
+//  and woken one per direction at a time, the next one once the previous
+//  did its operation, so none of them blocks the core. Regular files, which
+//  are always ready for epoll, go to a small pool of worker threads.
+
+// FUNCTIONALITY
+// *`aioInit`: Create the io_uring instance, or the epoll one if it fails.
+// *`aioSubmit`: Queue an operation, the caller blocks until it is reaped.
+//  Operations that do not fit in a full ring wait in a backlog. Done at once
+//  only if it is not a descriptor.
+// *`aioPoll`: Submit the queued operations and return the completed ones.
+// *`aioFinish`: Result of a reaped operation (does it in the epoll case,
+//  without blocking). Sets `retry` if another task took the data or the
+//  room first, the operation is then submitted again.
+// *`aioCancel`: Stop an operation in flight, it is still reaped.
+// *`aioPending`: Operations in flight, the loop polls `fd` while idle if any.
+// *`aioDestroy`: Release the instance.
+
+#ifndef AIO_H
+#define AIO_H
+
+#include <pthread.h>
+#include <stddef.h>
+
+#define pAIO_ENTRIES 256 // Submission queue entries of every io_uring
+#define pAIO_WORKERS 4 // Worker threads of the epoll backend
+#define pAIO_BUCKETS 64 // Hash buckets of the descriptors waited for by epoll
+#define pAIO_READ 0
+#define pAIO_WRITE 1
+
+typedef struct Aio Aio;
+
+// Structure
+typedef struct AioRequest {
+  int op; // pAIO_READ or pAIO_WRITE
+  int fd;
+  void *buf;
+  size_t len;
+  long long offset; // -1 for the current file position
+  void *owner; // Task to wake on completion
+  long long result; // Bytes transferred or -errno
+  int ready; // epoll: the descriptor is ready, the operation is still to do
+  int retry; // epoll: it would have blocked after all, submit it again
+  int stage; // Where the request waits, for cancellation
+  Aio *aio; // Instance it was submitted on
+  struct AioRequest *next; // Backlog, waiter, worker queue and completion list link
+} AioRequest;
+
+typedef struct AioWatch AioWatch;
+
+struct Aio {
+  int uring; // 1 for io_uring, 0 for epoll
+  int fd; // Ring or epoll descriptor, polled while idle
+  int pending; // Operations in flight
+  // io_uring
+  void *sq_ring, *cq_ring;
+  size_t sq_ring_size, cq_ring_size;
+  struct io_uring_sqe *sqes;
+  size_t sqes_size;
+  unsigned *sq_head, *sq_tail, *sq_mask, *sq_entries, *sq_array;
+  unsigned *cq_head, *cq_tail, *cq_mask;
+  struct io_uring_cqe *cqes;
+  unsigned to_submit; // Entries queued but not submitted
+  AioRequest *backlog, *backlog_tail; // Waiting for room in a full ring
+  // epoll
+  int event; // eventfd written by the workers
+  pthread_mutex_t lock; // Waiters, finished on the core that runs the task
+  AioWatch *watches[pAIO_BUCKETS]; // Descriptors waited for, by number
+  // Both
+  AioRequest *done; // Completed off the rings, pushed without a lock
+};
+
+// Function prototypes
+int aioInit(Aio *aio, int uring); // Falls back to epoll, -1 if both fail
+void aioDestroy(Aio *aio);
+int aioSubmit(Aio *aio, AioRequest *request); // 0 if queued, 1 if done at once (result is set)
+int aioPoll(Aio *aio, AioRequest **done, int max); // Number of completed requests
+long long aioFinish(AioRequest *request); // Bytes transferred or -errno
+void aioCancel(Aio *aio, AioRequest *request); // Reaped with -ECANCELED unless it completed first
+int aioPending(const Aio *aio);
+const char *aioName(const Aio *aio); // "io_uring" or "epoll"
+
+#endif /* AIO_H */
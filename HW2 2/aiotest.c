@@ -0,0 +1,316 @@
+/////////////////////// ASYNCHRONOUS I/O TEST SOURCE FILE README/////////////////////////
+
+//This file contains the tests (`aiotest.c`) of the blocking I/O of the
+//green threads on io_uring, or on epoll with -e. It checks the operations
+//a timeout cancels: they fail with ETIMEDOUT without taking or leaving data,
+//while the others on the same descriptor complete and the cores keep running
+//the other threads meanwhile, also with more operations in flight than the
+//entries of a ring. A ping-pong of many threads over two pipes checks the
+//wakeups across cores. Every failed check is printed, the exit status is 1
+//if there is one.
+
+// Build: gcc -O2 -o aiotest aiotest.c gt.c aio.c core.c policy.c heap.c rbtree.c fenwick.c switch.c stack.c trace.c metrics.c wheel.c -lpthread -lm
+
+// Command-line Options
+// * `-c`: Number of cores (default 4)
+// * `-e`: Use the epoll backend instead of io_uring
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+#include "gt.h"
+
+#define pMS 1000000LL
+#define pREADERS 10 // On one pipe, the last pTIMED_OUT of them with a timeout
+#define pTIMED_OUT 4
+#define pPIPES 300 // More than the entries of a ring
+#define pPING_THREADS 200
+#define pPINGS 10 // Of every ping thread
+#define pWATCHDOG 30 // Seconds before a hung test fails
+
+int failures;
+int data[2];
+int got, timed_out, ticks;
+long long start;
+int pipes[pPIPES][2];
+int ping[2], pong[2];
+
+// Print a failed check, from any core
+void fail(const char *format, ...) {
+  va_list args;
+  va_start(args, format);
+  gt_preempt_disable();
+  printf("FAIL: ");
+  vprintf(format, args);
+  printf("\n");
+  gt_preempt_enable();
+  va_end(args);
+  __atomic_fetch_add(&failures, 1, __ATOMIC_RELAXED);
+}
+
+void count(int *counter) {
+  __atomic_fetch_add(counter, 1, __ATOMIC_RELAXED);
+}
+
+void watchdog(int sig) {
+  (void)sig;
+  static const char message[] = "FAIL: hung\n";
+  write(STDOUT_FILENO, message, sizeof(message) - 1);
+  _exit(1);
+}
+
+// A byte with or without a timeout, the timeout must expire before the data
+void reader(void *arg) {
+  char c;
+  ssize_t n = gt_read_timeout(data[0], &c, 1, -1, (intptr_t)arg * pMS);
+  if (n == 1) {
+    count(&got);
+  } else if (n < 0 && errno == ETIMEDOUT && coreNow() - start < 150 * pMS) {
+    count(&timed_out);
+  } else {
+    fail("read timeout: unexpected result %zd", n < 0 ? -errno : n);
+  }
+}
+
+void dataWriter(void *arg) {
+  (void)arg;
+  gt_sleep_ns(200 * pMS);
+  if (gt_write(data[1], "abcdef", pREADERS - pTIMED_OUT, -1) != pREADERS - pTIMED_OUT) {
+    fail("read timeout: short write");
+  }
+}
+
+// The core runs while the readers wait
+void ticker(void *arg) {
+  (void)arg;
+  for (int i = 0; i < 20; i++) {
+    gt_sleep_ns(10 * pMS);
+    ticks++;
+  }
+}
+
+// Readers of one pipe, some of them time out before the data comes
+void testReadTimeout(void) {
+  gt_thread *threads[pREADERS + 2];
+  got = timed_out = ticks = 0;
+  start = coreNow();
+  for (int i = 0; i < pREADERS; i++) {
+    threads[i] = gt_spawn(reader, (void *)(intptr_t)(i < pREADERS - pTIMED_OUT ? 0 : 50), 1);
+  }
+  threads[pREADERS] = gt_spawn(dataWriter, NULL, 1);
+  threads[pREADERS + 1] = gt_spawn(ticker, NULL, 1);
+  for (int i = 0; i < pREADERS + 2; i++) {
+    gt_join(threads[i]);
+  }
+  if (got != pREADERS - pTIMED_OUT) {
+    fail("read timeout: %d reads completed", got);
+  }
+  if (timed_out != pTIMED_OUT) {
+    fail("read timeout: %d reads timed out", timed_out);
+  }
+  if (ticks != 20) {
+    fail("read timeout: %d ticks", ticks);
+  }
+}
+
+// A write to a full pipe times out without writing, the next one is read
+void fullWriter(void *arg) {
+  (void)arg;
+  if (gt_write_timeout(data[1], "T", 1, -1, 50 * pMS) != -1 || errno != ETIMEDOUT) {
+    fail("write timeout: the write to a full pipe did not time out");
+  }
+  if (gt_write(data[1], "Z", 1, -1) != 1) {
+    fail("write timeout: the last write failed");
+  }
+}
+
+void drainer(void *arg) {
+  long long filled = (intptr_t)arg, total = 0;
+  char buf[4096];
+  gt_sleep_ns(100 * pMS);
+  for (;;) {
+    ssize_t n = gt_read(data[0], buf, sizeof(buf), -1);
+    if (n <= 0) {
+      fail("write timeout: read error %d", n < 0 ? errno : 0);
+      return;
+    }
+    total += n;
+    if (memchr(buf, 'T', n) != NULL) {
+      fail("write timeout: the timed out write is read");
+    }
+    if (buf[n - 1] == 'Z') {
+      break;
+    }
+  }
+  if (total != filled + 1) {
+    fail("write timeout: %lld bytes read of %lld", total, filled + 1);
+  }
+}
+
+void testWriteTimeout(void) {
+  // Fill the pipe without blocking the core
+  char buf[4096];
+  memset(buf, 'x', sizeof(buf));
+  long long filled = 0;
+  ssize_t n;
+  fcntl(data[1], F_SETFL, O_NONBLOCK);
+  while ((n = write(data[1], buf, sizeof(buf))) > 0) {
+    filled += n;
+  }
+  while (write(data[1], buf, 1) > 0) {
+    filled++;
+  }
+  fcntl(data[1], F_SETFL, 0);
+  gt_thread *writer = gt_spawn(fullWriter, NULL, 1);
+  gt_thread *drain = gt_spawn(drainer, (void *)(intptr_t)filled, 1);
+  gt_join(writer);
+  gt_join(drain);
+}
+
+// One reader per pipe, every other one times out
+void pipeReader(void *arg) {
+  int i = (int)(intptr_t)arg;
+  char c;
+  ssize_t n = gt_read_timeout(pipes[i][0], &c, 1, -1, i % 2 == 1 ? 20 * pMS : 0);
+  if (n == 1 && i % 2 == 0) {
+    count(&got);
+  } else if (n < 0 && errno == ETIMEDOUT && i % 2 == 1) {
+    count(&timed_out);
+  } else {
+    fail("many pipes: unexpected result %zd", n < 0 ? -errno : n);
+  }
+}
+
+void pipeWriter(void *arg) {
+  (void)arg;
+  gt_sleep_ns(100 * pMS);
+  for (int i = 0; i < pPIPES; i++) {
+    if (gt_write(pipes[i][1], "x", 1, -1) != 1) {
+      fail("many pipes: write error %d", errno);
+    }
+  }
+}
+
+void testManyPipes(void) {
+  gt_thread *threads[pPIPES + 1];
+  got = timed_out = 0;
+  for (int i = 0; i < pPIPES; i++) {
+    threads[i] = gt_spawn(pipeReader, (void *)(intptr_t)i, 1);
+  }
+  threads[pPIPES] = gt_spawn(pipeWriter, NULL, 1);
+  for (int i = 0; i <= pPIPES; i++) {
+    gt_join(threads[i]);
+  }
+  if (got != pPIPES / 2 || timed_out != pPIPES / 2) {
+    fail("many pipes: %d reads completed, %d timed out", got, timed_out);
+  }
+
+  // The byte of a timed out read is still in its pipe
+  for (int i = 1; i < pPIPES; i += 2) {
+    int left = 0;
+    ioctl(pipes[i][0], FIONREAD, &left);
+    if (left != 1) {
+      fail("many pipes: %d bytes left in a pipe after a timeout", left);
+      break;
+    }
+  }
+}
+
+// Every ping thread reads a byte and answers, from any core
+void pinger(void *arg) {
+  (void)arg;
+  char c;
+  for (int i = 0; i < pPINGS; i++) {
+    if (gt_read(ping[0], &c, 1, -1) == 1) {
+      count(&got);
+    }
+    gt_write(pong[1], "y", 1, -1);
+  }
+}
+
+void ponger(void *arg) {
+  (void)arg;
+  char c;
+  for (int i = 0; i < pPING_THREADS * pPINGS; i++) {
+    gt_write(ping[1], "x", 1, -1);
+    gt_read(pong[0], &c, 1, -1);
+  }
+}
+
+void testPingPong(void) {
+  gt_thread *threads[pPING_THREADS + 1];
+  got = 0;
+  for (int i = 0; i < pPING_THREADS; i++) {
+    threads[i] = gt_spawn(pinger, NULL, 1);
+  }
+  threads[pPING_THREADS] = gt_spawn(ponger, NULL, 1);
+  for (int i = 0; i <= pPING_THREADS; i++) {
+    gt_join(threads[i]);
+  }
+  if (got != pPING_THREADS * pPINGS) {
+    fail("ping-pong: %d bytes read", got);
+  }
+}
+
+void root(void *arg) {
+  (void)arg;
+  testReadTimeout();
+  testWriteTimeout();
+  testManyPipes();
+  testPingPong();
+}
+
+int main(int argc, char *argv[]) {
+  int ncores = 4;
+
+  // Parse command line arguments
+  int opt;
+  while ((opt = getopt(argc, argv, "c:e")) != -1) {
+    switch (opt) {
+      case 'c':
+        ncores = atoi(optarg);
+        break;
+      case 'e':
+        coreSetIoBackend(0);
+        break;
+      default:
+        fprintf(stderr, "Usage: %s [-c cores] [-e]\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+  }
+
+  if (pipe(data) != 0 || pipe(ping) != 0 || pipe(pong) != 0) {
+    perror("pipe");
+    exit(EXIT_FAILURE);
+  }
+  for (int i = 0; i < pPIPES; i++) {
+    if (pipe(pipes[i]) != 0) {
+      perror("pipe");
+      exit(EXIT_FAILURE);
+    }
+  }
+  if (gt_init(ncores, "lottery", 1, 0) != 0) {
+    fprintf(stderr, "Could not create %d cores\n", ncores);
+    exit(EXIT_FAILURE);
+  }
+  printf("I/O backend: %s, %d cores\n", aioName(&coreGet(0)->aio), ncores);
+  signal(SIGALRM, watchdog);
+  alarm(pWATCHDOG);
+  gt_spawn(root, NULL, 1);
+  gt_run();
+  gt_shutdown();
+
+  if (failures > 0) {
+    printf("%d failed\n", failures);
+    return 1;
+  }
+  printf("PASS\n");
+  return 0;
+}
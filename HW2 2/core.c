@@ -0,0 +1,728 @@
+///////////////////// M:N CORE RUNTIME SOURCE FILE README///////////////////////
+
+//This file contains the implementation (`core.c`) of the M:N runtime. Each
+//core runs `coreMain`: expire the due timers, pick a task from the local
+//policy, switch to it, and handle what the task asked for (yield, block or
+//exit) once it switched back. A task is requeued only after the core is back
+//on its own stack, so a thief can never run a task whose stack is still in
+//use. Idle cores steal from the others with a trylock and back off briefly.
+//Between two tasks the core also reaps the completed I/O of its tasks.
+
+#define _GNU_SOURCE // ppoll
+#include "core.h"
+#include "stack.h"
+#include "trace.h"
+#include <errno.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define aYIELD 1
+#define aBLOCK 2
+#define aEXIT 3
+#define aPARK 4
+#define aIO 5
+#define pIDLE_WAIT_NS 100000 // Longest idle wait before trying to steal again
+#define pIO_REAP 64 // Completions handled per loop iteration
+#define pTASK_SLOT ((sizeof(Task) + 63) & ~(size_t)63) // Top of the stack used by the task
+
+static Core cores[pCORE_MAX];
+static int ncores;
+static int next_core; // Round robin placement of new tasks
+static int live; // Tasks that have not exited yet
+static int fast_switch = pFAST_SWITCH; // Hand-written switch instead of ucontext
+static size_t stack_size = pCORE_STACK_SIZE;
+static StackPool stacks;
+static Metrics *metrics; // Accounting fed with the scheduling events
+static long long tick_ns; // Preemption tick, 0 for cooperative switching
+static int use_uring = 1; // I/O backend of the cores created next
+static pthread_t ticker;
+static int ticker_stop;
+
+static __thread Core *this_core;
+static __thread Task *this_task; // Running task of this_core
+
+// Read through a call so that a task resumed on another pthread does not
+// reuse the thread-local address computed before it was switched out
+static __attribute__((noinline)) Core *currentCore(void) {
+  return this_core;
+}
+
+// One load, so a tick between reading the core and its running task cannot
+// hand back the task another core runs after a migration
+static __attribute__((noinline)) Task *currentTask(void) {
+  return this_task;
+}
+
+// Task that owns a scheduling entity
+static Task *taskOf(SchedEntity *se) {
+  return (Task *)((char *)se - offsetof(Task, se));
+}
+
+// Monotonic time
+long long coreNow(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+int coreCount(void) {
+  return ncores;
+}
+
+Core *coreGet(int index) {
+  return &cores[index];
+}
+
+// Select the context switch, before any task is spawned
+int coreUseFastSwitch(int fast) {
+  fast_switch = fast && contextFastAvailable();
+  return fast_switch;
+}
+
+// Select the stack size, before coresInit
+void coreSetStackSize(size_t size) {
+  stack_size = size > pTASK_SLOT + 4096 ? size : pTASK_SLOT + 4096;
+}
+
+// Create the cores
+int coresInit(int count, const char *policy_name, int quantum, unsigned int seed) {
+  if (count < 1 || count > pCORE_MAX || stackPoolInit(&stacks, stack_size) != 0) {
+    return -1;
+  }
+  for (int i = 0; i < count; i++) {
+    Core *core = &cores[i];
+    core->index = i;
+    core->policy = policyCreate(policy_name, quantum, seed + i);
+    if (core->policy == NULL) {
+      for (int j = 0; j < i; j++) {
+        policyDestroy(cores[j].policy);
+        aioDestroy(&cores[j].aio);
+      }
+      return -1;
+    }
+    if (aioInit(&core->aio, use_uring) != 0) {
+      policyDestroy(core->policy);
+      for (int j = 0; j < i; j++) {
+        policyDestroy(cores[j].policy);
+        aioDestroy(&cores[j].aio);
+      }
+      return -1;
+    }
+    pthread_mutex_init(&core->lock, NULL);
+    core->running = NULL;
+    wheelInit(&core->timers, (unsigned long long)coreNow() / pTIMER_TICK_NS);
+    core->ncached = 0;
+    core->switches = 0;
+    core->steals = 0;
+    core->idle_ns = 0;
+  }
+  ncores = count;
+  next_core = 0;
+  live = 0;
+  return 0;
+}
+
+// Select the I/O backend, before coresInit
+void coreSetIoBackend(int uring) {
+  use_uring = uring;
+}
+
+// Account the scheduling events, before coresRun
+void coreSetMetrics(Metrics *m) {
+  metrics = m;
+}
+
+// Record an event of a task in the trace and the metrics. Events that make a
+// task ready are recorded before it is visible to the other cores.
+static void coreEvent(Core *core, int type, Task *task, int arg) {
+  if (traceEnabled() || metrics != NULL) {
+    long long now = coreNow();
+    traceEvent(core->index, type, now, task->se.id, arg);
+    if (metrics != NULL) {
+      metricsRecord(metrics, core->index, type, now, task->se.id);
+    }
+  }
+}
+
+// Entry point of every task
+static void taskEntry(void) {
+  Task *task = currentTask();
+  __atomic_store_n(&currentCore()->in_task, 1, __ATOMIC_RELAXED);
+  task->fn(task->arg);
+  coreExit();
+}
+
+// Put a ready task on a core
+static void makeReady(Core *core, Task *task) {
+  task->state = tREADY;
+  task->core = core->index;
+  pthread_mutex_lock(&core->lock);
+  int preempt = core->policy->onWake(core->policy, &task->se);
+  if (preempt < 0) {
+    // The task would never run again
+    fprintf(stderr, "makeReady: Could not queue task %d\n", task->se.id);
+    abort();
+  }
+  if (preempt) {
+    core->preempt = 1;
+  }
+  pthread_mutex_unlock(&core->lock);
+}
+
+static void switchOut(int action);
+
+// Keep the running task on its core, returns it (NULL outside of a task)
+static Task *preemptDisable(void) {
+  Task *task = currentTask();
+  if (task != NULL) {
+    task->nopreempt++;
+    __atomic_signal_fence(__ATOMIC_SEQ_CST);
+  }
+  return task;
+}
+
+// Allow preemption again, and yield if a tick was held back meanwhile
+static void preemptEnable(Task *task) {
+  if (task == NULL) {
+    return;
+  }
+  __atomic_signal_fence(__ATOMIC_SEQ_CST);
+  if (--task->nopreempt == 0 && currentCore()->resched) {
+    currentCore()->resched = 0;
+    switchOut(aYIELD);
+  }
+}
+
+void corePreemptDisable(void) {
+  preemptDisable();
+}
+
+void corePreemptEnable(void) {
+  preemptEnable(coreSelf());
+}
+
+// Create a task
+Task *coreSpawn(void (*fn)(void *), void *arg, int id, int tickets, int currency, int joinable) {
+  Task *self = preemptDisable();
+  Task *task = NULL;
+
+  // Spawned from a task: reuse a stack of this core and keep the task local,
+  // otherwise take a stack from the shared pool and spread round robin
+  Core *core = currentCore();
+  void *stack;
+  if (core != NULL && core->ncached > 0) {
+    stack = core->stack_cache[--core->ncached];
+  } else {
+    stack = stackAlloc(&stacks);
+  }
+  if (stack != NULL) {
+    size_t usable = stackSize(&stacks) - pTASK_SLOT;
+    task = (Task *)((char *)stack + usable);
+    memset(task, 0, sizeof(Task));
+    task->stack = stack;
+    contextMake(&task->context, stack, usable, taskEntry, fast_switch);
+
+    task->fn = fn;
+    task->arg = arg;
+    task->se.id = id;
+    task->se.tickets = tickets;
+    task->se.currency = currency;
+    task->joinable = joinable;
+    if (joinable) {
+      pthread_mutex_init(&task->join_lock, NULL);
+    }
+    __atomic_add_fetch(&live, 1, __ATOMIC_RELAXED);
+
+    if (core == NULL) {
+      core = &cores[next_core];
+      next_core = (next_core + 1) % ncores;
+    }
+    coreEvent(core, trWAKE, task, 0);
+    makeReady(core, task);
+  }
+  preemptEnable(self);
+  return task;
+}
+
+// Release a finished task together with its stack
+static void freeTask(Core *core, Task *task) {
+  void *stack = task->stack;
+  if (core->ncached < pCORE_STACK_CACHE) {
+    core->stack_cache[core->ncached++] = stack;
+  } else {
+    stackFree(&stacks, stack);
+  }
+}
+
+// Arm the timer of a task that blocked with a deadline, never early
+static void armTimer(Core *core, Task *task) {
+  task->timed_out = 0;
+  if (task->deadline > 0) {
+    wheelAdd(&core->timers, &task->timer,
+             (unsigned long long)(task->deadline + pTIMER_TICK_NS - 1) / pTIMER_TICK_NS);
+  }
+}
+
+// Wake the tasks whose deadline passed, returns the next deadline
+static long long expireTimers(Core *core) {
+  if (core->timers.count == 0) {
+    return 0; // Spare the clock read
+  }
+  TimerNode *timer = wheelAdvance(&core->timers, (unsigned long long)coreNow() / pTIMER_TICK_NS);
+  while (timer != NULL) {
+    TimerNode *next = timer->next;
+    Task *task = wheelEntry(timer, Task, timer);
+    task->timed_out = 1;
+    if (task->io != NULL) {
+      aioCancel(&core->aio, task->io); // Woken when the canceled operation is reaped
+    } else {
+      coreEvent(core, trWAKE, task, 0);
+      makeReady(core, task);
+    }
+    timer = next;
+  }
+  return core->timers.count > 0 ? (long long)wheelNext(&core->timers) * pTIMER_TICK_NS : 0;
+}
+
+// Make the tasks whose I/O completed ready
+static void reapIO(Core *core) {
+  AioRequest *done[pIO_REAP];
+  int n = aioPoll(&core->aio, done, pIO_REAP);
+  for (int i = 0; i < n; i++) {
+    Task *task = done[i]->owner;
+    wheelCancel(&core->timers, &task->timer);
+    coreEvent(core, trWAKE, task, 0);
+    makeReady(core, task);
+  }
+}
+
+// Take a ready task from another core
+static SchedEntity *stealTask(Core *core) {
+  for (int i = 1; i < ncores; i++) {
+    Core *victim = &cores[(core->index + i) % ncores];
+
+    // Racy peek, only a hint to skip empty cores without locking
+    if (__atomic_load_n(&victim->policy->ready, __ATOMIC_RELAXED) == 0) {
+      continue;
+    }
+    if (pthread_mutex_trylock(&victim->lock) != 0) {
+      continue;
+    }
+    SchedEntity *se = victim->policy->steal(victim->policy);
+    pthread_mutex_unlock(&victim->lock);
+
+    if (se != NULL) {
+      core->steals++;
+      coreEvent(core, trSTEAL, taskOf(se), victim->index);
+      makeReady(core, taskOf(se));
+      pthread_mutex_lock(&core->lock);
+      se = core->policy->pickNext(core->policy);
+      pthread_mutex_unlock(&core->lock);
+      return se;
+    }
+  }
+  return NULL;
+}
+
+// Wait for work while idle
+static void idleWait(Core *core, long long next_deadline) {
+  long long now = coreNow();
+  long long wait = pIDLE_WAIT_NS;
+  if (next_deadline != 0 && next_deadline - now < wait) {
+    wait = next_deadline - now;
+  }
+  if (wait > 0) {
+    struct timespec ts = {0, wait};
+    if (aioPending(&core->aio) > 0) {
+      // Woken early by a completion
+      struct pollfd pfd = {core->aio.fd, POLLIN, 0};
+      ppoll(&pfd, 1, &ts, NULL);
+    } else {
+      nanosleep(&ts, NULL);
+    }
+  }
+  core->idle_ns += coreNow() - now;
+}
+
+// Switch to a task and handle its request once it switches back
+static void runTask(Core *core, Task *task) {
+  core->running = task;
+  core->preempt = 0;
+  task->state = tRUNNING;
+  task->core = core->index;
+  core->resched = 0;
+  core->switches++;
+  coreEvent(core, trSWITCH, task, 0);
+
+  this_task = task;
+  contextSwitch(&core->sched_ctx, &task->context, fast_switch);
+  this_task = NULL;
+
+  core->running = NULL;
+  switch (core->action) {
+    case aYIELD:
+      coreEvent(core, trYIELD, task, 0);
+      makeReady(core, task);
+      break;
+    case aBLOCK:
+      coreEvent(core, trBLOCK, task, 0);
+      pthread_mutex_lock(&core->lock);
+      core->policy->onBlock(core->policy, &task->se);
+      pthread_mutex_unlock(&core->lock);
+      task->state = tBLOCKED;
+      armTimer(core, task);
+      break;
+    case aIO:
+      coreEvent(core, trBLOCK, task, 0);
+      pthread_mutex_lock(&core->lock);
+      core->policy->onBlock(core->policy, &task->se);
+      pthread_mutex_unlock(&core->lock);
+      task->state = tBLOCKED; // Until reapIO
+      armTimer(core, task);
+      break;
+    case aPARK:
+      coreEvent(core, trBLOCK, task, 0);
+      pthread_mutex_lock(&core->lock);
+      core->policy->onBlock(core->policy, &task->se);
+      pthread_mutex_unlock(&core->lock);
+      task->state = tBLOCKED;
+      pthread_mutex_unlock(core->park_lock); // Now coreUnpark may make it ready
+      break;
+    case aEXIT:
+      coreEvent(core, trEXIT, task, 0);
+      pthread_mutex_lock(&core->lock);
+      core->policy->onBlock(core->policy, &task->se);
+      pthread_mutex_unlock(&core->lock);
+      if (task->joinable) {
+        // The joiner releases the task, it must not be touched after the unlock
+        task->state = tFINISHED;
+        pthread_mutex_lock(&task->join_lock);
+        task->exited = 1;
+        Task *joiner = task->joiner;
+        pthread_mutex_unlock(&task->join_lock);
+        if (joiner != NULL) {
+          coreEvent(core, trWAKE, joiner, 0);
+          makeReady(core, joiner);
+        }
+      } else {
+        task->state = tFINISHED;
+        freeTask(core, task);
+      }
+      __atomic_sub_fetch(&live, 1, __ATOMIC_RELEASE);
+      break;
+  }
+}
+
+// Scheduling loop of a core
+static void *coreMain(void *arg) {
+  Core *core = arg;
+  this_core = core;
+
+  for (;;) {
+    long long next_deadline = expireTimers(core);
+    reapIO(core);
+
+    pthread_mutex_lock(&core->lock);
+    SchedEntity *se = core->policy->pickNext(core->policy);
+    pthread_mutex_unlock(&core->lock);
+
+    if (se == NULL && ncores > 1) {
+      se = stealTask(core);
+    }
+
+    if (se == NULL) {
+      if (__atomic_load_n(&live, __ATOMIC_ACQUIRE) == 0) {
+        break;
+      }
+      idleWait(core, next_deadline);
+      continue;
+    }
+
+    runTask(core, taskOf(se));
+  }
+
+  this_core = NULL;
+  return NULL;
+}
+
+// Select preemptive switching, before coresRun
+void coreSetPreemption(long long tick) {
+  tick_ns = tick > 0 ? tick : 0;
+}
+
+// Charge a tick to the interrupted task and switch it out if its slice is over
+static void preemptHandler(int sig) {
+  (void)sig;
+  Task *task = currentTask();
+  if (task == NULL) {
+    return;
+  }
+  // Held first, a nested tick must not move the task before core is read
+  int held = task->nopreempt++;
+  __atomic_signal_fence(__ATOMIC_SEQ_CST);
+  Core *core = currentCore();
+  int in_task = __atomic_load_n(&core->in_task, __ATOMIC_RELAXED);
+  if (!in_task || held) {
+    if (in_task) {
+      core->resched = 1; // Yield in preemptEnable
+    }
+    task->nopreempt--;
+    return;
+  }
+
+  pthread_mutex_lock(&core->lock);
+  int expired = core->policy->onTick(core->policy, &task->se, 1);
+  pthread_mutex_unlock(&core->lock);
+  if (expired || core->preempt) {
+    switchOut(aYIELD);
+  }
+  task->nopreempt--;
+}
+
+// Interrupt every core that runs a task once per tick
+static void *tickerMain(void *arg) {
+  (void)arg;
+  struct timespec ts = {tick_ns / 1000000000LL, tick_ns % 1000000000LL};
+  while (!__atomic_load_n(&ticker_stop, __ATOMIC_ACQUIRE)) {
+    nanosleep(&ts, NULL);
+    for (int i = 0; i < ncores; i++) {
+      if (__atomic_load_n(&cores[i].in_task, __ATOMIC_RELAXED)) {
+        pthread_kill(cores[i].thread, pPREEMPT_SIGNAL);
+      }
+    }
+  }
+  return NULL;
+}
+
+// Run the cores until every task has exited
+void coresRun(void) {
+  // The calling thread is core 0
+  cores[0].thread = pthread_self();
+
+  struct sigaction action, previous;
+  if (tick_ns > 0) {
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = preemptHandler;
+    action.sa_flags = SA_RESTART | SA_NODEFER;
+    sigemptyset(&action.sa_mask);
+    sigaction(pPREEMPT_SIGNAL, &action, &previous);
+  }
+
+  for (int i = 1; i < ncores; i++) {
+    pthread_create(&cores[i].thread, NULL, coreMain, &cores[i]);
+  }
+  ticker_stop = 0;
+  if (tick_ns > 0) {
+    pthread_create(&ticker, NULL, tickerMain, NULL);
+  }
+  coreMain(&cores[0]);
+
+  // Stop the ticker while the cores can still receive its signals
+  if (tick_ns > 0) {
+    __atomic_store_n(&ticker_stop, 1, __ATOMIC_RELEASE);
+    pthread_join(ticker, NULL);
+  }
+  for (int i = 1; i < ncores; i++) {
+    pthread_join(cores[i].thread, NULL);
+  }
+  if (tick_ns > 0) {
+    sigaction(pPREEMPT_SIGNAL, &previous, NULL);
+  }
+}
+
+// Release the cores
+void coresDestroy(void) {
+  for (int i = 0; i < ncores; i++) {
+    while (cores[i].ncached > 0) {
+      stackFree(&stacks, cores[i].stack_cache[--cores[i].ncached]);
+    }
+    policyDestroy(cores[i].policy);
+    aioDestroy(&cores[i].aio);
+    pthread_mutex_destroy(&cores[i].lock);
+  }
+  stackPoolDestroy(&stacks);
+  ncores = 0;
+}
+
+// Switch from the running task back to its core
+static void switchOut(int action) {
+  Task *task = coreSelf();
+  task->nopreempt++;
+  __atomic_signal_fence(__ATOMIC_SEQ_CST);
+  Core *core = currentCore();
+  core->action = action;
+  __atomic_store_n(&core->in_task, 0, __ATOMIC_RELAXED);
+  contextSwitch(&task->context, &core->sched_ctx, fast_switch);
+
+  // Resumed, possibly by another core
+  __atomic_store_n(&currentCore()->in_task, 1, __ATOMIC_RELAXED);
+  __atomic_signal_fence(__ATOMIC_SEQ_CST);
+  task->nopreempt--;
+}
+
+Task *coreSelf(void) {
+  return currentTask();
+}
+
+// Charge time to the running task
+void coreTick(int ran) {
+  Task *task = preemptDisable();
+  Core *core = currentCore();
+  pthread_mutex_lock(&core->lock);
+  int expired = core->policy->onTick(core->policy, &task->se, ran);
+  pthread_mutex_unlock(&core->lock);
+  if (expired || core->preempt) {
+    switchOut(aYIELD);
+  }
+  preemptEnable(task);
+}
+
+void coreYield(void) {
+  switchOut(aYIELD);
+}
+
+void coreSleepUntil(long long deadline) {
+  Task *task = coreSelf();
+  task->deadline = deadline > 0 ? deadline : 1;
+  switchOut(aBLOCK);
+}
+
+// Block the running task, the caller holds lock and the core releases it
+// once the task is off its stack, so a waker cannot resume it too early
+void corePark(pthread_mutex_t *lock) {
+  Task *task = preemptDisable();
+  currentCore()->park_lock = lock;
+  switchOut(aPARK);
+  preemptEnable(task);
+}
+
+// Make a parked task ready, on the core of the caller if it is a task
+void coreUnpark(Task *task) {
+  Task *self = preemptDisable();
+  Core *core = currentCore();
+  if (core == NULL) {
+    core = &cores[task->core];
+  }
+  coreEvent(core, trWAKE, task, 0);
+  makeReady(core, task);
+  preemptEnable(self);
+}
+
+// Lock the core that owns a task, preemption is disabled by the caller
+static Core *lockOwner(Task *task) {
+  for (;;) {
+    Core *core = &cores[__atomic_load_n(&task->core, __ATOMIC_RELAXED)];
+    pthread_mutex_lock(&core->lock);
+    // Retry if a thief moved the task meanwhile
+    if (__atomic_load_n(&task->core, __ATOMIC_RELAXED) == core->index) {
+      return core;
+    }
+    pthread_mutex_unlock(&core->lock);
+  }
+}
+
+// Lend base tickets to a task or take them back
+void coreAddTickets(Task *task, int delta) {
+  Task *self = preemptDisable();
+  Core *core = lockOwner(task);
+  core->policy->transfer(core->policy, &task->se, delta);
+  pthread_mutex_unlock(&core->lock);
+  preemptEnable(self);
+}
+
+// Worth of the tickets of a task in base tickets
+int coreTicketValue(Task *task) {
+  Task *self = preemptDisable();
+  Core *core = lockOwner(task);
+  int value = core->policy->value(core->policy, &task->se);
+  pthread_mutex_unlock(&core->lock);
+  preemptEnable(self);
+  return value;
+}
+
+// Fund a currency on every core, each core divides its funding separately
+int coreFund(int currency, int funding) {
+  Task *self = preemptDisable();
+  int result = 0;
+  for (int i = 0; i < ncores; i++) {
+    pthread_mutex_lock(&cores[i].lock);
+    if (cores[i].policy->fund(cores[i].policy, currency, funding) != 0) {
+      result = -1;
+    }
+    pthread_mutex_unlock(&cores[i].lock);
+  }
+  preemptEnable(self);
+  return result;
+}
+
+// Queue an operation on the core and block until the loop reaps it, or
+// until the timeout cancels it
+static ssize_t coreIO(int op, int fd, void *buf, size_t len, long long offset, long long timeout) {
+  AioRequest request = {.op = op, .fd = fd, .buf = buf, .len = len, .offset = offset};
+  Task *self = preemptDisable();
+  long long result;
+  if (self == NULL) {
+    request.ready = 1; // Not a task, do it in place
+    result = aioFinish(&request);
+  } else {
+    request.owner = self;
+    long long deadline = timeout > 0 ? coreNow() + timeout : 0;
+    do {
+      if (aioSubmit(&currentCore()->aio, &request) == 0) {
+        self->io = &request;
+        self->deadline = deadline;
+        switchOut(aIO);
+        self->io = NULL;
+        if (self->timed_out && request.result == -ECANCELED) {
+          request.result = -ETIMEDOUT;
+        }
+      }
+      result = aioFinish(&request);
+    } while (request.retry); // Woken, but another task took the data first
+  }
+  preemptEnable(self);
+  if (result < 0) {
+    errno = (int)-result;
+    return -1;
+  }
+  return (ssize_t)result;
+}
+
+ssize_t coreRead(int fd, void *buf, size_t len, long long offset) {
+  return coreIO(pAIO_READ, fd, buf, len, offset, 0);
+}
+
+ssize_t coreWrite(int fd, const void *buf, size_t len, long long offset) {
+  return coreIO(pAIO_WRITE, fd, (void *)buf, len, offset, 0);
+}
+
+ssize_t coreReadTimeout(int fd, void *buf, size_t len, long long offset, long long timeout_ns) {
+  return coreIO(pAIO_READ, fd, buf, len, offset, timeout_ns);
+}
+
+ssize_t coreWriteTimeout(int fd, const void *buf, size_t len, long long offset, long long timeout_ns) {
+  return coreIO(pAIO_WRITE, fd, (void *)buf, len, offset, timeout_ns);
+}
+
+// Wait for a joinable task to exit, then release its stack
+void coreJoin(Task *task) {
+  Task *self = preemptDisable();
+  pthread_mutex_lock(&task->join_lock);
+  if (!task->exited) {
+    task->joiner = self;
+    corePark(&task->join_lock);
+  } else {
+    pthread_mutex_unlock(&task->join_lock);
+  }
+  pthread_mutex_destroy(&task->join_lock);
+  freeTask(currentCore(), task);
+  preemptEnable(self);
+}
+
+void coreExit(void) {
+  preemptDisable(); // The task never runs again
+  switchOut(aEXIT);
+}
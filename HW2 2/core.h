@@ -0,0 +1,139 @@
+///////////////////// M:N CORE RUNTIME HEADER FILE README///////////////////////
+
+//This file contains the header (`core.h`) for the M:N runtime that runs the
+//user-level threads on a pool of kernel threads. Every core is a pthread
+//with its own scheduling loop, its own policy instance and its own timer
+//wheel of sleeping tasks and I/O timeouts. A core only touches another
+//core's state when it is idle and steals a ready task, so the per-core locks
+//are almost never contended.
+//Switching between tasks never leaves user space; the hand-written switch of
+//`switch.h` is used when available, `ucontext_t` otherwise. A task lives at
+//the top of its own pooled stack, so spawning allocates nothing once the
+//stack pool and the per-core stack caches are warm.
+//Switching is cooperative unless `coreSetPreemption` is given a tick: then a
+//ticker thread sends `pPREEMPT_SIGNAL` to every core that runs a task, and
+//the handler charges the tick and switches the task out if its slice is over.
+//Runtime code that holds a lock runs with preemption disabled.
+//A task that reads or writes with `coreRead`/`coreWrite` blocks while the
+//operation is in flight on the `aio.h` instance of its core, which the
+//scheduling loop polls between two tasks and waits on when idle. With a
+//timeout, the operation is canceled if the timer of the task expires first.
+
+// FUNCTIONALITY
+// *`coresInit`: Create the cores, each with its own policy instance.
+// *`coreUseFastSwitch`: Select the hand-written switch or the ucontext one.
+// *`coreSetStackSize`: Select the stack size of the tasks.
+// *`coreSetMetrics`: Log the scheduling events of every core in a `Metrics`,
+//  accounted by `metricsMerge` after the run.
+// *`coreSetPreemption`: Preempt the running tasks every tick (0: cooperative).
+// *`coreSetIoBackend`: Select io_uring or the epoll fallback.
+// *`coreSpawn`: Create a task and place it on a core (round robin).
+// *`coresRun`: Start the cores and wait until every task has exited.
+// *`coreTick`: Charge time to the running task, switch if its slice ended.
+// *`coreSleepUntil`: Block the running task until a deadline.
+// *`corePark`: Block the running task until `coreUnpark`.
+// *`coreAddTickets`: Lend base tickets to a task in any state (transfer).
+// *`coreTicketValue`: Worth of the tickets of a task in base tickets.
+// *`coreFund`: Fund a ticket currency on every core.
+// *`coreRead`, `coreWrite`: Asynchronous I/O, other tasks run meanwhile.
+// *`coreReadTimeout`, `coreWriteTimeout`: The same, ETIMEDOUT after a delay.
+// *`coreJoin`: Wait until a joinable task has exited and release it.
+// *`coreExit`: Terminate the running task.
+
+#ifndef CORE_H
+#define CORE_H
+
+#include <pthread.h>
+#include <signal.h>
+#include <sys/types.h>
+#include "aio.h"
+#include "metrics.h"
+#include "policy.h"
+#include "switch.h"
+#include "wheel.h"
+
+#define tREADY 1
+#define tRUNNING 2
+#define tBLOCKED 3
+#define tFINISHED 4
+#define pCORE_MAX 64 // Maximum number of cores
+#define pCORE_STACK_SIZE (64 * 1024) // Default stack of every task
+#define pCORE_STACK_CACHE 64 // Released stacks kept by every core
+#define pPREEMPT_SIGNAL SIGURG // Sent by the ticker in the preemptive mode
+#define pTIMER_TICK_NS 10000 // Resolution of the timer wheels
+
+// Structure
+typedef struct Task {
+  Context context;
+  void *stack; // Pooled stack, the task itself is stored at its top
+  SchedEntity se; // Scheduling policy bookkeeping
+  int state;
+  int core; // Core that owns the task
+  void (*fn)(void *); // Function run by the task
+  void *arg;
+  long long deadline; // Sleep or I/O deadline (ns), 0 for none
+  TimerNode timer; // Armed on the wheel of its core while blocked with a deadline
+  AioRequest *io; // Operation in flight, canceled if the timer expires first
+  int timed_out; // The timer expired while the task was blocked
+  volatile int nopreempt; // Preemption is disabled while non-zero
+  int joinable; // Kept after the exit until coreJoin
+  int exited; // Set under join_lock when a joinable task exits
+  pthread_mutex_t join_lock; // Guards the exit and the joiner
+  struct Task *joiner; // Task parked in coreJoin
+} Task;
+
+typedef struct Core {
+  pthread_t thread;
+  int index;
+  pthread_mutex_t lock; // Guards the policy, taken by thieves as well
+  SchedPolicy *policy;
+  Context sched_ctx; // Context of the scheduling loop
+  Task *running;
+  int action; // What the running task asked for when it switched out
+  int preempt; // A woken task should preempt the running one
+  int in_task; // The core runs task code, the ticker may preempt it
+  volatile int resched; // A tick arrived while preemption was disabled
+  pthread_mutex_t *park_lock; // Released once a parking task switched out
+  Wheel timers; // Deadlines of the blocked tasks of this core
+  Aio aio; // I/O of the tasks of this core
+  void *stack_cache[pCORE_STACK_CACHE]; // Stacks of exited tasks, no locking
+  int ncached;
+  long long switches;
+  long long steals;
+  long long idle_ns;
+} __attribute__((aligned(64))) Core;
+
+// Function prototypes
+int coresInit(int ncores, const char *policy_name, int quantum, unsigned int seed); // -1 on error
+int coreUseFastSwitch(int fast); // Returns the switch actually used
+void coreSetStackSize(size_t size); // Before coresInit, default pCORE_STACK_SIZE
+void coreSetMetrics(Metrics *metrics); // Log the scheduling events, NULL to stop
+void coreSetPreemption(long long tick_ns); // Before coresRun, 0 for cooperative switching
+void coreSetIoBackend(int uring); // Before coresInit, io_uring by default
+Task *coreSpawn(void (*fn)(void *), void *arg, int id, int tickets, int currency, int joinable); // NULL if out of memory
+int coreFund(int currency, int funding); // Base tickets of a currency (> 0), -1 if out of memory
+void coresRun(void); // Run until all tasks have exited
+void coresDestroy(void); // Release the cores
+int coreCount(void); // Number of cores
+Core *coreGet(int index); // Core by index
+long long coreNow(void); // Monotonic time (ns)
+
+// Called from inside a task
+Task *coreSelf(void); // Running task
+void coreTick(int ran); // Charge time, may switch to another task
+void coreYield(void); // Give up the rest of the slice
+void coreSleepUntil(long long deadline); // Block until the deadline (ns)
+void corePark(pthread_mutex_t *lock); // Block, lock is held and released after the switch
+void coreUnpark(Task *task); // Make a parked task ready on this core
+void coreAddTickets(Task *task, int delta); // Negative to take them back
+int coreTicketValue(Task *task); // What the task lends when it blocks
+ssize_t coreRead(int fd, void *buf, size_t len, long long offset); // offset -1: current position
+ssize_t coreWrite(int fd, const void *buf, size_t len, long long offset); // -1 and errno on error
+ssize_t coreReadTimeout(int fd, void *buf, size_t len, long long offset, long long timeout_ns); // 0: none
+ssize_t coreWriteTimeout(int fd, const void *buf, size_t len, long long offset, long long timeout_ns);
+void coreJoin(Task *task); // Wait for a joinable task to exit and release it
+void corePreemptDisable(void); // Nests, the task stays on its core
+void corePreemptEnable(void); // Yields if a tick arrived meanwhile
+void coreExit(void); // Terminate the running task
+
+#endif /* CORE_H */
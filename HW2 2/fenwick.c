@@ -0,0 +1,106 @@
+///////////////////// FENWICK TREE SOURCE FILE README///////////////////////
+
+//This file contains the implementation (`fenwick.c`) of the Fenwick tree used
+//for lottery draws. Slots are 0-based for callers and 1-based internally.
+
+//Helped from Fenwick, P. M. (1994). A new data structure for cumulative
+//frequency tables.
+
+#include "fenwick.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Highest power of two not larger than n
+static int highestPower(int n) {
+  int top = 1;
+  while (top * 2 <= n) {
+    top *= 2;
+  }
+  return top;
+}
+
+// Initialize the tree
+int fenwickInit(Fenwick *fw, int size) {
+  if (size < 1) {
+    size = 1;
+  }
+  fw->tree = calloc(size + 1, sizeof(long long));
+  fw->weight = calloc(size, sizeof(long long));
+  if (fw->tree == NULL || fw->weight == NULL) {
+    free(fw->tree);
+    free(fw->weight);
+    return -1;
+  }
+  fw->total = 0;
+  fw->size = size;
+  fw->top = highestPower(size);
+  return 0;
+}
+
+// Enlarge the tree, the partial sums are rebuilt in O(n)
+int fenwickGrow(Fenwick *fw, int size) {
+  if (size <= fw->size) {
+    return 0;
+  }
+  long long *tree = calloc(size + 1, sizeof(long long));
+  long long *weight = calloc(size, sizeof(long long));
+  if (tree == NULL || weight == NULL) {
+    free(tree);
+    free(weight);
+    return -1;
+  }
+  memcpy(weight, fw->weight, fw->size * sizeof(long long));
+  for (int i = 1; i <= size; i++) {
+    tree[i] += weight[i - 1];
+    int parent = i + (i & -i);
+    if (parent <= size) {
+      tree[parent] += tree[i];
+    }
+  }
+  free(fw->tree);
+  free(fw->weight);
+  fw->tree = tree;
+  fw->weight = weight;
+  fw->size = size;
+  fw->top = highestPower(size);
+  return 0;
+}
+
+// Add to the weight of a slot
+void fenwickAdd(Fenwick *fw, int slot, long long delta) {
+  fw->weight[slot] += delta;
+  fw->total += delta;
+  for (int i = slot + 1; i <= fw->size; i += i & -i) {
+    fw->tree[i] += delta;
+  }
+}
+
+// Set the weight of a slot
+void fenwickSet(Fenwick *fw, int slot, long long weight) {
+  if (fw->weight[slot] != weight) {
+    fenwickAdd(fw, slot, weight - fw->weight[slot]);
+  }
+}
+
+// Find the slot owning a ticket by descending the implicit tree
+int fenwickFind(const Fenwick *fw, long long ticket) {
+  int pos = 0;
+  for (int step = fw->top; step > 0; step /= 2) {
+    int next = pos + step;
+    if (next <= fw->size && fw->tree[next] <= ticket) {
+      pos = next;
+      ticket -= fw->tree[next];
+    }
+  }
+  return pos; // 1-based pos + 1, converted back to 0-based
+}
+
+// Release the memory
+void fenwickDestroy(Fenwick *fw) {
+  free(fw->tree);
+  free(fw->weight);
+  fw->tree = NULL;
+  fw->weight = NULL;
+  fw->size = 0;
+  fw->total = 0;
+}
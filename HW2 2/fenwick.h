@@ -0,0 +1,34 @@
+///////////////////// FENWICK TREE HEADER FILE README///////////////////////
+
+//This file contains the header (`fenwick.h`) for a Fenwick (binary indexed)
+//tree over ticket counts. It replaces the flat `lottery_tickets` array: a
+//lottery draw becomes a prefix-sum search, so both drawing a winner and
+//changing a thread's tickets cost O(log n) instead of O(total tickets).
+
+// FUNCTIONALITY
+// *`fenwickInit`: Initialize a tree with all weights set to zero.
+// *`fenwickAdd`: Add a (possibly negative) amount to one slot.
+// *`fenwickFind`: Return the slot that owns the given ticket number.
+// *`fenwickDestroy`: Release the allocated memory.
+
+#ifndef FENWICK_H
+#define FENWICK_H
+
+// Structure
+typedef struct {
+  long long *tree; // 1-based partial sums
+  long long *weight; // Current weight of every slot
+  long long total; // Sum of all weights
+  int size;
+  int top; // Highest power of two not larger than size
+} Fenwick;
+
+// Function prototypes
+int fenwickInit(Fenwick *fw, int size); // Returns -1 if out of memory
+int fenwickGrow(Fenwick *fw, int size); // Enlarge keeping the weights
+void fenwickAdd(Fenwick *fw, int slot, long long delta); // weight[slot] += delta
+void fenwickSet(Fenwick *fw, int slot, long long weight); // weight[slot] = weight
+int fenwickFind(const Fenwick *fw, long long ticket); // Slot owning ticket in [0, total)
+void fenwickDestroy(Fenwick *fw); // Release the memory
+
+#endif /* FENWICK_H */
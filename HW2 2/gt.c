@@ -0,0 +1,144 @@
+///////////////////// GREEN THREAD SOURCE FILE README///////////////////////
+
+//This file contains the implementation (`gt.c`) of the green-thread library.
+//Everything is forwarded to the M:N runtime; this layer only hands out the
+//thread IDs and fixes the base slice to one tick. The ID of a joined thread
+//is reused, so the IDs stay below the most threads alive at once.
+
+#include "gt.h"
+#include <limits.h>
+#include <stdlib.h>
+
+#define pGT_QUANTUM 1 // Base slice in ticks, the policy may lengthen it (MLFQ)
+
+static pthread_mutex_t id_lock = PTHREAD_MUTEX_INITIALIZER; // Spawns and joins of all cores
+static int next_id; // Lowest ID never handed out
+static int *free_ids; // IDs of the joined threads
+static int nfree;
+static int free_size;
+static int next_currency; // Last currency created
+
+// Take a free ID, -1 if there are none left. Preemption is held off while
+// the lock is held, another task of the core would spin on it.
+static int takeId(void) {
+  int id = -1;
+  gt_preempt_disable();
+  pthread_mutex_lock(&id_lock);
+  if (nfree > 0) {
+    id = free_ids[--nfree];
+  } else if (next_id < INT_MAX) {
+    id = next_id++;
+  }
+  pthread_mutex_unlock(&id_lock);
+  gt_preempt_enable();
+  return id;
+}
+
+// Give an ID back, it is lost if the free list cannot grow
+static void releaseId(int id) {
+  gt_preempt_disable();
+  pthread_mutex_lock(&id_lock);
+  if (nfree == free_size) {
+    int size = free_size > 0 ? free_size * 2 : 16;
+    int *ids = realloc(free_ids, size * sizeof(int));
+    if (ids != NULL) {
+      free_ids = ids;
+      free_size = size;
+    }
+  }
+  if (nfree < free_size) {
+    free_ids[nfree++] = id;
+  }
+  pthread_mutex_unlock(&id_lock);
+  gt_preempt_enable();
+}
+
+// Create the cores
+int gt_init(int ncores, const char *policy, unsigned int seed, long long tick_ns) {
+  if (coresInit(ncores, policy, pGT_QUANTUM, seed) != 0) {
+    return -1;
+  }
+  coreSetPreemption(tick_ns);
+  next_id = 0;
+  nfree = 0;
+  next_currency = 0;
+  return 0;
+}
+
+// Create a thread in the currency of the caller
+gt_thread *gt_spawn(void (*fn)(void *), void *arg, int tickets) {
+  gt_thread *self = coreSelf();
+  return gt_spawn_in(fn, arg, tickets, self != NULL ? self->se.currency : 0);
+}
+
+gt_thread *gt_spawn_in(void (*fn)(void *), void *arg, int tickets, int currency) {
+  int id = takeId();
+  if (id < 0) {
+    return NULL;
+  }
+  gt_thread *thread = coreSpawn(fn, arg, id, tickets > 0 ? tickets : 1, currency, 1);
+  if (thread == NULL) {
+    releaseId(id);
+  }
+  return thread;
+}
+
+// Create a currency worth funding base tickets
+int gt_currency(int funding) {
+  int currency = __atomic_add_fetch(&next_currency, 1, __ATOMIC_RELAXED);
+  return coreFund(currency, funding > 0 ? funding : 1) == 0 ? currency : -1;
+}
+
+void gt_run(void) {
+  coresRun();
+}
+
+void gt_shutdown(void) {
+  coresDestroy();
+  free(free_ids);
+  free_ids = NULL;
+  nfree = 0;
+  free_size = 0;
+}
+
+void gt_yield(void) {
+  coreYield();
+}
+
+void gt_join(gt_thread *thread) {
+  int id = thread->se.id;
+  coreJoin(thread);
+  releaseId(id);
+}
+
+void gt_sleep_ns(long long ns) {
+  coreSleepUntil(coreNow() + ns);
+}
+
+ssize_t gt_read(int fd, void *buf, size_t len, long long offset) {
+  return coreRead(fd, buf, len, offset);
+}
+
+ssize_t gt_write(int fd, const void *buf, size_t len, long long offset) {
+  return coreWrite(fd, buf, len, offset);
+}
+
+ssize_t gt_read_timeout(int fd, void *buf, size_t len, long long offset, long long ns) {
+  return coreReadTimeout(fd, buf, len, offset, ns);
+}
+
+ssize_t gt_write_timeout(int fd, const void *buf, size_t len, long long offset, long long ns) {
+  return coreWriteTimeout(fd, buf, len, offset, ns);
+}
+
+int gt_self(void) {
+  return coreSelf()->se.id;
+}
+
+void gt_preempt_disable(void) {
+  corePreemptDisable();
+}
+
+void gt_preempt_enable(void) {
+  corePreemptEnable();
+}
@@ -0,0 +1,63 @@
+///////////////////// GREEN THREAD HEADER FILE README///////////////////////
+
+//This file contains the header (`gt.h`) for the green-thread library. It
+//runs user functions as lightweight threads on the M:N runtime of `core.h`:
+//a thread is a pooled stack and a context switch that never enters the
+//kernel, so tens of thousands of them cost less than a few kernel threads.
+//The threads are scheduled by any policy of `policy.h`; the tickets given to
+//`gt_spawn` are the lottery tickets (stride and CFS weight). With the
+//lottery, groups of threads can be isolated in currencies: a currency is
+//worth a fixed number of base tickets however many threads it holds.
+
+//Switching is cooperative when `tick_ns` is 0: a thread runs until it calls
+//`gt_yield`, `gt_sleep_ns`, `gt_join` or returns. With a tick, threads are
+//also preempted by a signal at the end of their slice. Code that must not be
+//interrupted, such as calls into a non-reentrant library (stdio, malloc),
+//goes between `gt_preempt_disable` and `gt_preempt_enable` in that mode.
+//Threads that wait for each other use the primitives of `gtsync.h`, a pthread
+//mutex or condition variable would block every thread of the core.
+
+// FUNCTIONALITY
+// *`gt_init`: Create the cores and select the policy and the switching mode.
+// *`gt_spawn`: Create a thread running fn(arg), joinable.
+// *`gt_currency`, `gt_spawn_in`: Create a currency and a thread paid in it.
+// *`gt_run`: Run the threads until all of them have returned.
+// *`gt_yield`: Give the core to another ready thread.
+// *`gt_join`: Wait for a thread to return and release it.
+// *`gt_sleep_ns`: Block the calling thread for a number of nanoseconds.
+// *`gt_read`, `gt_write`: Block the calling thread on an io_uring (or epoll)
+//  operation while the other threads run.
+// *`gt_read_timeout`, `gt_write_timeout`: The same, cancelled with errno
+//  ETIMEDOUT after a number of nanoseconds.
+// *`gt_self`: ID of the calling thread.
+// *`gt_shutdown`: Release the cores, the stacks and unjoined threads.
+
+#ifndef GT_H
+#define GT_H
+
+#include "core.h"
+
+// Structure
+typedef Task gt_thread; // Handle returned by gt_spawn
+
+// Function prototypes
+int gt_init(int ncores, const char *policy, unsigned int seed, long long tick_ns); // -1 on error
+gt_thread *gt_spawn(void (*fn)(void *), void *arg, int tickets); // NULL if out of memory or IDs, currency of the caller
+gt_thread *gt_spawn_in(void (*fn)(void *), void *arg, int tickets, int currency); // 0: base currency
+int gt_currency(int funding); // After gt_init, -1 if out of memory
+void gt_run(void); // Returns when every thread has returned
+void gt_shutdown(void); // After gt_run
+
+// Called from inside a thread
+void gt_yield(void); // Let another thread run
+void gt_join(gt_thread *thread); // Wait for the thread to return, the handle becomes invalid
+void gt_sleep_ns(long long ns); // Block for at least ns nanoseconds
+ssize_t gt_read(int fd, void *buf, size_t len, long long offset); // offset -1: current position
+ssize_t gt_write(int fd, const void *buf, size_t len, long long offset); // -1 and errno on error
+ssize_t gt_read_timeout(int fd, void *buf, size_t len, long long offset, long long ns); // ns 0: no timeout
+ssize_t gt_write_timeout(int fd, const void *buf, size_t len, long long offset, long long ns);
+int gt_self(void); // ID of the calling thread, from 0, reused after gt_join
+void gt_preempt_disable(void); // Nests
+void gt_preempt_enable(void);
+
+#endif /* GT_H */
@@ -0,0 +1,261 @@
+/////////////////////// GREEN THREAD BENCHMARK SOURCE FILE README/////////////////////////
+
+//This file contains an example and benchmark (`gtbench.c`) of the
+//green-thread library of `gt.h`. A root thread spawns many threads with
+//different tickets and joins them; every thread does a little work and
+//yields a number of times. The same work can be run on kernel threads for
+//comparison. With -t and -y 0 the threads never yield and only the
+//preemption tick moves them off the cores. With -m the work is done holding
+//one of a few shared `gtsync.h` mutexes, which exercises the handoff and
+//the ticket transfer, and the protected counters are checked at the end.
+//With -r every yield becomes a 4 KB read of a file at a random offset, so
+//the threads overlap their I/O on the cores (io_uring, or epoll with -e).
+
+// Build: gcc -O2 -o gtbench gtbench.c gt.c gtsync.c aio.c core.c policy.c heap.c rbtree.c fenwick.c switch.c stack.c trace.c metrics.c wheel.c -lpthread -lm
+
+// Command-line Options
+// * `-n`: Number of threads (default 10000)
+// * `-y`: Yields of every thread (default 100)
+// * `-w`: Busy work between two yields in microseconds (default 0)
+// * `-c`: Number of cores (default 1)
+// * `-p`: Scheduling policy (default lottery)
+// * `-t`: Preemption tick in microseconds, 0 for cooperative (default 0)
+// * `-m`: Do the work holding one of this many shared mutexes (default 0)
+// * `-r`: Read a 4 KB block of this file instead of every yield
+// * `-e`: Use the epoll backend instead of io_uring
+// * `-k`: Run the same work on kernel threads instead
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include "gt.h"
+#include "gtsync.h"
+
+#define DEFAULT_THREADS 10000
+#define DEFAULT_YIELDS 100
+#define BLOCK_SIZE 4096
+
+int nthreads = DEFAULT_THREADS;
+int yields = DEFAULT_YIELDS;
+int work_us;
+int kernel_threads;
+int nlocks;
+int file = -1; // Read instead of yielding if open
+long long file_blocks;
+gt_thread **handles;
+gt_mutex *locks;
+long long *counters; // Incremented under the lock of the same index
+
+// Busy work
+void spin(int usec) {
+  if (usec <= 0) {
+    return;
+  }
+  long long end = coreNow() + usec * 1000LL;
+  while (coreNow() < end) {
+  }
+}
+
+// Offset of the i-th read of a thread
+long long blockOffset(int id, int i) {
+  unsigned int seed = (unsigned int)(id * 7919 + i);
+  return (long long)(rand_r(&seed) % file_blocks) * BLOCK_SIZE;
+}
+
+// Body of every green thread
+void worker(void *arg) {
+  if (yields == 0) {
+    spin(work_us);
+  }
+  for (int i = 0; i < yields; i++) {
+    if (nlocks > 0) {
+      int lock = (int)(intptr_t)arg % nlocks;
+      gt_mutex_lock(&locks[lock]);
+      spin(work_us);
+      counters[lock]++;
+      gt_mutex_unlock(&locks[lock]);
+    } else {
+      spin(work_us);
+    }
+    if (file >= 0) {
+      char buf[BLOCK_SIZE];
+      if (gt_read(file, buf, BLOCK_SIZE, blockOffset((int)(intptr_t)arg, i)) < 0) {
+        perror("gt_read");
+        exit(EXIT_FAILURE);
+      }
+    } else {
+      gt_yield();
+    }
+  }
+}
+
+// Spawns the workers with 1 to 10 tickets and joins them
+void root(void *arg) {
+  (void)arg;
+  for (int i = 0; i < nthreads; i++) {
+    handles[i] = gt_spawn(worker, (void *)(intptr_t)i, 1 + i % 10);
+    if (handles[i] == NULL) {
+      fprintf(stderr, "gt_spawn: out of memory after %d threads\n", i);
+      exit(EXIT_FAILURE);
+    }
+  }
+  for (int i = 0; i < nthreads; i++) {
+    gt_join(handles[i]);
+  }
+}
+
+// Body of every kernel thread
+void *kernelWorker(void *arg) {
+  if (yields == 0) {
+    spin(work_us);
+  }
+  for (int i = 0; i < yields; i++) {
+    spin(work_us);
+    if (file >= 0) {
+      char buf[BLOCK_SIZE];
+      if (pread(file, buf, BLOCK_SIZE, blockOffset((int)(intptr_t)arg, i)) < 0) {
+        perror("pread");
+        exit(EXIT_FAILURE);
+      }
+    } else {
+      sched_yield();
+    }
+  }
+  return NULL;
+}
+
+int main(int argc, char *argv[]) {
+  int ncores = 1;
+  long long tick_us = 0;
+  char *policy = "lottery";
+
+  // Parse command line arguments
+  int opt;
+  while ((opt = getopt(argc, argv, "n:y:w:c:p:t:m:r:ek")) != -1) {
+    switch (opt) {
+      case 'n':
+        nthreads = atoi(optarg);
+        break;
+      case 'y':
+        yields = atoi(optarg);
+        break;
+      case 'w':
+        work_us = atoi(optarg);
+        break;
+      case 'c':
+        ncores = atoi(optarg);
+        break;
+      case 'p':
+        policy = optarg;
+        break;
+      case 't':
+        tick_us = atoll(optarg);
+        break;
+      case 'm':
+        nlocks = atoi(optarg);
+        break;
+      case 'r':
+        file = open(optarg, O_RDONLY);
+        if (file < 0) {
+          perror(optarg);
+          exit(EXIT_FAILURE);
+        }
+        break;
+      case 'e':
+        coreSetIoBackend(0);
+        break;
+      case 'k':
+        kernel_threads = 1;
+        break;
+      default:
+        fprintf(stderr, "Usage: %s [-n threads] [-y yields] [-w work us] [-c cores] [-p %s] [-t tick us] [-m locks] [-r file] [-e] [-k]\n",
+                argv[0], policyNames());
+        exit(EXIT_FAILURE);
+    }
+  }
+
+  if (file >= 0) {
+    struct stat st;
+    fstat(file, &st);
+    file_blocks = st.st_size / BLOCK_SIZE;
+    if (file_blocks < 1) {
+      fprintf(stderr, "The file must hold at least %d bytes\n", BLOCK_SIZE);
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  long long start = coreNow();
+  long long switches = 0;
+
+  if (kernel_threads) {
+    pthread_t *threads = malloc(nthreads * sizeof(pthread_t));
+    if (threads == NULL) {
+      perror("malloc");
+      exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < nthreads; i++) {
+      if (pthread_create(&threads[i], NULL, kernelWorker, (void *)(intptr_t)i) != 0) {
+        fprintf(stderr, "pthread_create: failed after %d threads\n", i);
+        exit(EXIT_FAILURE);
+      }
+    }
+    for (int i = 0; i < nthreads; i++) {
+      pthread_join(threads[i], NULL);
+    }
+    free(threads);
+  } else {
+    handles = malloc(nthreads * sizeof(gt_thread *));
+    if (nlocks > 0) {
+      locks = malloc(nlocks * sizeof(gt_mutex));
+      counters = calloc(nlocks, sizeof(long long));
+      if (locks == NULL || counters == NULL) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+      }
+      for (int i = 0; i < nlocks; i++) {
+        gt_mutex_init(&locks[i]);
+      }
+    }
+    if (handles == NULL || gt_init(ncores, policy, 1, tick_us * 1000) != 0) {
+      fprintf(stderr, "Could not create %d cores with the policy %s\n", ncores, policy);
+      exit(EXIT_FAILURE);
+    }
+    if (file >= 0) {
+      printf("I/O backend: %s\n", aioName(&coreGet(0)->aio));
+    }
+    gt_spawn(root, NULL, 1);
+    gt_run();
+    for (int i = 0; i < ncores; i++) {
+      switches += coreGet(i)->switches;
+    }
+    gt_shutdown();
+    free(handles);
+
+    // Every increment must have been made under the lock
+    long long total = 0;
+    for (int i = 0; i < nlocks; i++) {
+      total += counters[i];
+      gt_mutex_destroy(&locks[i]);
+    }
+    if (nlocks > 0 && total != (long long)nthreads * yields) {
+      fprintf(stderr, "Lost updates: %lld of %lld\n", total, (long long)nthreads * yields);
+      exit(EXIT_FAILURE);
+    }
+    free(locks);
+    free(counters);
+  }
+
+  double elapsed = (coreNow() - start) / 1e9;
+  printf("%s\t%d threads\t%d yields\t%.3f s", kernel_threads ? "kernel" : "green", nthreads, yields, elapsed);
+  if (!kernel_threads) {
+    printf("\t%lld switches\t%.1f ns/switch", switches, elapsed * 1e9 / (switches > 0 ? switches : 1));
+  }
+  printf("\n");
+  return 0;
+}
@@ -0,0 +1,357 @@
+///////////////////// GREEN THREAD SYNCHRONIZATION SOURCE FILE README///////////////////////
+
+//This file contains the implementation (`gtsync.c`) of the synchronization
+//primitives of the green threads. Every primitive is a queue of parked
+//threads behind a short pthread mutex. Preemption is disabled while the
+//mutex is held, so a preempted thread never keeps it; a waiter queues itself
+//and parks with `corePark`, which releases the mutex only once the thread
+//is off its stack, and the waker pops the node and calls `coreUnpark`.
+
+#include "gtsync.h"
+#include <stdlib.h>
+
+struct GtWaiter {
+  gt_thread *task;
+  int tickets; // Tickets lent to the mutex owner
+  void *item; // Channel item to send or received
+  int done; // The channel operation completed
+  GtWaiter *next;
+};
+
+// %%%%%%%%%%%%%%%%%%%%%% Wait Queue %%%%%%%%%%%%%%%%%%%%%%
+
+static void queueInit(GtQueue *queue) {
+  pthread_mutex_init(&queue->guard, NULL);
+  queue->head = NULL;
+  queue->tail = NULL;
+}
+
+static void queueDestroy(GtQueue *queue) {
+  pthread_mutex_destroy(&queue->guard);
+}
+
+// Disable preemption and take the guard
+static void queueLock(pthread_mutex_t *guard) {
+  corePreemptDisable();
+  pthread_mutex_lock(guard);
+}
+
+static void queueUnlock(pthread_mutex_t *guard) {
+  pthread_mutex_unlock(guard);
+  corePreemptEnable();
+}
+
+static void queuePush(GtQueue *queue, GtWaiter *waiter) {
+  waiter->next = NULL;
+  if (queue->tail != NULL) {
+    queue->tail->next = waiter;
+  } else {
+    queue->head = waiter;
+  }
+  queue->tail = waiter;
+}
+
+static GtWaiter *queuePop(GtQueue *queue) {
+  GtWaiter *waiter = queue->head;
+  if (waiter != NULL) {
+    queue->head = waiter->next;
+    if (queue->head == NULL) {
+      queue->tail = NULL;
+    }
+  }
+  return waiter;
+}
+
+// Queue the running thread and park it, guard is held and released
+static void queueWait(GtQueue *queue, pthread_mutex_t *guard, GtWaiter *waiter) {
+  waiter->task = coreSelf();
+  queuePush(queue, waiter);
+  corePark(guard);
+  corePreemptEnable();
+}
+
+// %%%%%%%%%%%%%%%%%%%%%% Mutex %%%%%%%%%%%%%%%%%%%%%%
+
+void gt_mutex_init(gt_mutex *mutex) {
+  queueInit(&mutex->queue);
+  mutex->owner = NULL;
+  mutex->lent = 0;
+}
+
+void gt_mutex_destroy(gt_mutex *mutex) {
+  queueDestroy(&mutex->queue);
+}
+
+void gt_mutex_lock(gt_mutex *mutex) {
+  gt_thread *self = coreSelf();
+  queueLock(&mutex->queue.guard);
+  if (mutex->owner == NULL) {
+    mutex->owner = self;
+    queueUnlock(&mutex->queue.guard);
+    return;
+  }
+
+  // Lend the tickets to the owner until the lock is handed over
+  GtWaiter waiter;
+  waiter.tickets = coreTicketValue(self);
+  mutex->lent += waiter.tickets;
+  coreAddTickets(mutex->owner, waiter.tickets);
+  queueWait(&mutex->queue, &mutex->queue.guard, &waiter);
+  // The unlocking thread made us the owner
+}
+
+int gt_mutex_trylock(gt_mutex *mutex) {
+  int result = -1;
+  queueLock(&mutex->queue.guard);
+  if (mutex->owner == NULL) {
+    mutex->owner = coreSelf();
+    result = 0;
+  }
+  queueUnlock(&mutex->queue.guard);
+  return result;
+}
+
+void gt_mutex_unlock(gt_mutex *mutex) {
+  queueLock(&mutex->queue.guard);
+  GtWaiter *waiter = queuePop(&mutex->queue);
+  if (waiter == NULL) {
+    mutex->owner = NULL;
+    queueUnlock(&mutex->queue.guard);
+    return;
+  }
+
+  // Give the lent tickets back and lend the rest to the next owner
+  gt_thread *next = waiter->task;
+  coreAddTickets(mutex->owner, -mutex->lent);
+  mutex->lent -= waiter->tickets;
+  mutex->owner = next;
+  if (mutex->lent > 0) {
+    coreAddTickets(next, mutex->lent);
+  }
+  pthread_mutex_unlock(&mutex->queue.guard);
+  coreUnpark(next);
+  corePreemptEnable();
+}
+
+// %%%%%%%%%%%%%%%%%%%%%% Condition Variable %%%%%%%%%%%%%%%%%%%%%%
+
+void gt_cond_init(gt_cond *cond) {
+  queueInit(&cond->queue);
+}
+
+void gt_cond_destroy(gt_cond *cond) {
+  queueDestroy(&cond->queue);
+}
+
+// Queued before the mutex is released, so a signal in between is not lost
+void gt_cond_wait(gt_cond *cond, gt_mutex *mutex) {
+  GtWaiter waiter;
+  queueLock(&cond->queue.guard);
+  gt_mutex_unlock(mutex);
+  queueWait(&cond->queue, &cond->queue.guard, &waiter);
+  gt_mutex_lock(mutex);
+}
+
+void gt_cond_signal(gt_cond *cond) {
+  queueLock(&cond->queue.guard);
+  GtWaiter *waiter = queuePop(&cond->queue);
+  gt_thread *task = waiter != NULL ? waiter->task : NULL;
+  pthread_mutex_unlock(&cond->queue.guard);
+  if (task != NULL) {
+    coreUnpark(task);
+  }
+  corePreemptEnable();
+}
+
+void gt_cond_broadcast(gt_cond *cond) {
+  queueLock(&cond->queue.guard);
+  GtWaiter *waiter = cond->queue.head;
+  cond->queue.head = NULL;
+  cond->queue.tail = NULL;
+  pthread_mutex_unlock(&cond->queue.guard);
+  // The nodes stay valid until their thread is unparked
+  while (waiter != NULL) {
+    GtWaiter *next = waiter->next;
+    coreUnpark(waiter->task);
+    waiter = next;
+  }
+  corePreemptEnable();
+}
+
+// %%%%%%%%%%%%%%%%%%%%%% Channel %%%%%%%%%%%%%%%%%%%%%%
+
+int gt_chan_init(gt_chan *chan, int size) {
+  chan->buffer = NULL;
+  if (size > 0) {
+    chan->buffer = malloc(size * sizeof(void *));
+    if (chan->buffer == NULL) {
+      return -1;
+    }
+  }
+  queueInit(&chan->senders);
+  queueInit(&chan->receivers);
+  chan->size = size > 0 ? size : 0;
+  chan->head = 0;
+  chan->count = 0;
+  chan->closed = 0;
+  return 0;
+}
+
+void gt_chan_destroy(gt_chan *chan) {
+  queueDestroy(&chan->senders);
+  queueDestroy(&chan->receivers);
+  free(chan->buffer);
+}
+
+// Complete the operation of a popped waiter, guard held
+static gt_thread *chanComplete(GtWaiter *waiter) {
+  gt_thread *task = waiter->task;
+  waiter->done = 1;
+  return task;
+}
+
+int gt_chan_send(gt_chan *chan, void *item) {
+  pthread_mutex_t *guard = &chan->senders.guard;
+  queueLock(guard);
+  if (chan->closed) {
+    queueUnlock(guard);
+    return -1;
+  }
+
+  // A waiting receiver means the buffer is empty, hand the item over
+  GtWaiter *receiver = queuePop(&chan->receivers);
+  if (receiver != NULL) {
+    receiver->item = item;
+    gt_thread *task = chanComplete(receiver);
+    pthread_mutex_unlock(guard);
+    coreUnpark(task);
+    corePreemptEnable();
+    return 0;
+  }
+  if (chan->count < chan->size) {
+    chan->buffer[(chan->head + chan->count) % chan->size] = item;
+    chan->count++;
+    queueUnlock(guard);
+    return 0;
+  }
+
+  // Full, a receiver takes the item from the node
+  GtWaiter waiter;
+  waiter.item = item;
+  waiter.done = 0;
+  queueWait(&chan->senders, guard, &waiter);
+  return waiter.done ? 0 : -1;
+}
+
+int gt_chan_recv(gt_chan *chan, void **item) {
+  pthread_mutex_t *guard = &chan->senders.guard;
+  queueLock(guard);
+  if (chan->count > 0) {
+    *item = chan->buffer[chan->head];
+    chan->head = (chan->head + 1) % chan->size;
+    chan->count--;
+    // Move the item of a blocked sender into the freed slot
+    GtWaiter *sender = queuePop(&chan->senders);
+    gt_thread *task = NULL;
+    if (sender != NULL) {
+      chan->buffer[(chan->head + chan->count) % chan->size] = sender->item;
+      chan->count++;
+      task = chanComplete(sender);
+    }
+    pthread_mutex_unlock(guard);
+    if (task != NULL) {
+      coreUnpark(task);
+    }
+    corePreemptEnable();
+    return 0;
+  }
+
+  // Unbuffered, or a sender was queued before the buffer had room
+  GtWaiter *sender = queuePop(&chan->senders);
+  if (sender != NULL) {
+    *item = sender->item;
+    gt_thread *task = chanComplete(sender);
+    pthread_mutex_unlock(guard);
+    coreUnpark(task);
+    corePreemptEnable();
+    return 0;
+  }
+  if (chan->closed) {
+    queueUnlock(guard);
+    return -1;
+  }
+
+  GtWaiter waiter;
+  waiter.done = 0;
+  queueWait(&chan->receivers, guard, &waiter);
+  if (!waiter.done) {
+    return -1;
+  }
+  *item = waiter.item;
+  return 0;
+}
+
+// Blocked senders fail, buffered items can still be received
+void gt_chan_close(gt_chan *chan) {
+  pthread_mutex_t *guard = &chan->senders.guard;
+  queueLock(guard);
+  chan->closed = 1;
+  GtWaiter *senders = chan->senders.head;
+  GtWaiter *receivers = chan->receivers.head;
+  chan->senders.head = chan->senders.tail = NULL;
+  chan->receivers.head = chan->receivers.tail = NULL;
+  pthread_mutex_unlock(guard);
+  GtWaiter *lists[2] = {senders, receivers};
+  for (int i = 0; i < 2; i++) {
+    GtWaiter *waiter = lists[i];
+    while (waiter != NULL) {
+      GtWaiter *next = waiter->next;
+      coreUnpark(waiter->task);
+      waiter = next;
+    }
+  }
+  corePreemptEnable();
+}
+
+// %%%%%%%%%%%%%%%%%%%%%% Wait-Group %%%%%%%%%%%%%%%%%%%%%%
+
+void gt_wg_init(gt_wg *wg) {
+  queueInit(&wg->queue);
+  wg->count = 0;
+}
+
+void gt_wg_destroy(gt_wg *wg) {
+  queueDestroy(&wg->queue);
+}
+
+void gt_wg_add(gt_wg *wg, int delta) {
+  queueLock(&wg->queue.guard);
+  wg->count += delta;
+  GtWaiter *waiter = NULL;
+  if (wg->count <= 0) {
+    waiter = wg->queue.head;
+    wg->queue.head = NULL;
+    wg->queue.tail = NULL;
+  }
+  pthread_mutex_unlock(&wg->queue.guard);
+  while (waiter != NULL) {
+    GtWaiter *next = waiter->next;
+    coreUnpark(waiter->task);
+    waiter = next;
+  }
+  corePreemptEnable();
+}
+
+void gt_wg_done(gt_wg *wg) {
+  gt_wg_add(wg, -1);
+}
+
+void gt_wg_wait(gt_wg *wg) {
+  queueLock(&wg->queue.guard);
+  if (wg->count <= 0) {
+    queueUnlock(&wg->queue.guard);
+    return;
+  }
+  GtWaiter waiter;
+  queueWait(&wg->queue, &wg->queue.guard, &waiter);
+}
@@ -0,0 +1,89 @@
+///////////////////// GREEN THREAD SYNCHRONIZATION HEADER FILE README///////////////////////
+
+//This file contains the header (`gtsync.h`) for the synchronization
+//primitives of the green threads of `gt.h`. A pthread mutex would block the
+//whole core with every thread queued on it, so these primitives park the
+//green thread instead and the core runs another ready thread; nothing enters
+//the kernel unless the short internal lock is contended by another core.
+//Waiters are queued first in, first out in nodes on their own stacks.
+
+//The mutex hands the lock directly to the first waiter on unlock, so a thread
+//that just released it cannot take it again ahead of the queue. While threads
+//wait for it, their tickets are transferred to the holder (Waldspurger's
+//ticket transfer): a holder with few tickets is not starved by the lottery
+//while threads with many tickets wait for it. What is lent is the worth of the
+//waiter's tickets in base tickets, so it holds across currencies. The
+//transfer is not transitive.
+
+// FUNCTIONALITY
+// *`gt_mutex_lock`, `gt_mutex_unlock`: Mutex with handoff and ticket transfer.
+// *`gt_cond_wait`, `gt_cond_signal`, `gt_cond_broadcast`: Condition variable.
+// *`gt_chan_send`, `gt_chan_recv`, `gt_chan_close`: Bounded channel of
+//  pointers for any number of senders and receivers, unbuffered with size 0.
+// *`gt_wg_add`, `gt_wg_done`, `gt_wg_wait`: Wait-group, waits for a count
+//  of threads to finish.
+
+#ifndef GTSYNC_H
+#define GTSYNC_H
+
+#include "gt.h"
+
+// Structure
+typedef struct GtWaiter GtWaiter; // Stack node of a parked thread
+
+typedef struct {
+  pthread_mutex_t guard; // Guards the fields, held only for a few instructions
+  GtWaiter *head, *tail; // Waiting threads
+} GtQueue;
+
+typedef struct {
+  GtQueue queue;
+  gt_thread *owner; // NULL if unlocked
+  int lent; // Tickets of the waiters, transferred to the owner
+} gt_mutex;
+
+typedef struct {
+  GtQueue queue;
+} gt_cond;
+
+typedef struct {
+  GtQueue senders; // Guard of the channel, and the senders of a full channel
+  GtQueue receivers; // Receivers of an empty channel, guard unused
+  void **buffer;
+  int size;
+  int head; // Oldest item
+  int count;
+  int closed;
+} gt_chan;
+
+typedef struct {
+  GtQueue queue;
+  int count;
+} gt_wg;
+
+// Function prototypes
+void gt_mutex_init(gt_mutex *mutex);
+void gt_mutex_destroy(gt_mutex *mutex);
+void gt_mutex_lock(gt_mutex *mutex);
+int gt_mutex_trylock(gt_mutex *mutex); // 0 if locked, -1 if held by another thread
+void gt_mutex_unlock(gt_mutex *mutex); // Hands the lock to the first waiter
+
+void gt_cond_init(gt_cond *cond);
+void gt_cond_destroy(gt_cond *cond);
+void gt_cond_wait(gt_cond *cond, gt_mutex *mutex); // mutex is held again on return
+void gt_cond_signal(gt_cond *cond); // Wake the first waiter
+void gt_cond_broadcast(gt_cond *cond); // Wake every waiter
+
+int gt_chan_init(gt_chan *chan, int size); // -1 if out of memory
+void gt_chan_destroy(gt_chan *chan);
+int gt_chan_send(gt_chan *chan, void *item); // Blocks while full, -1 if closed
+int gt_chan_recv(gt_chan *chan, void **item); // Blocks while empty, -1 if closed and empty
+void gt_chan_close(gt_chan *chan); // Wakes every blocked sender and receiver
+
+void gt_wg_init(gt_wg *wg);
+void gt_wg_destroy(gt_wg *wg);
+void gt_wg_add(gt_wg *wg, int delta); // Wakes the waiters when the count drops to 0
+void gt_wg_done(gt_wg *wg); // gt_wg_add(wg, -1)
+void gt_wg_wait(gt_wg *wg); // Blocks until the count is 0
+
+#endif /* GTSYNC_H */
@@ -0,0 +1,109 @@
+///////////////////// BINARY HEAP SOURCE FILE README///////////////////////
+
+//This file contains the implementation (`heap.c`) of the intrusive binary
+//min-heap. The array grows by doubling, so pushes are amortized O(log n).
+
+#include "heap.h"
+#include <stdlib.h>
+
+// Initialize the heap
+void heapInit(Heap *heap, int capacity, int (*less)(const HeapNode *, const HeapNode *)) {
+  if (capacity < 1) {
+    capacity = 1;
+  }
+  heap->array = malloc(capacity * sizeof(HeapNode *));
+  heap->capacity = heap->array != NULL ? capacity : 0;
+  heap->count = 0;
+  heap->less = less;
+}
+
+// Place a node at a position
+static void place(Heap *heap, HeapNode *node, int i) {
+  heap->array[i] = node;
+  node->index = i;
+}
+
+// Move the node at i towards the root
+static void siftUp(Heap *heap, int i) {
+  HeapNode *node = heap->array[i];
+  while (i > 0) {
+    int parent = (i - 1) / 2;
+    if (!heap->less(node, heap->array[parent])) {
+      break;
+    }
+    place(heap, heap->array[parent], i);
+    i = parent;
+  }
+  place(heap, node, i);
+}
+
+// Move the node at i towards the leaves
+static void siftDown(Heap *heap, int i) {
+  HeapNode *node = heap->array[i];
+  for (;;) {
+    int child = 2 * i + 1;
+    if (child >= heap->count) {
+      break;
+    }
+    if (child + 1 < heap->count && heap->less(heap->array[child + 1], heap->array[child])) {
+      child++;
+    }
+    if (!heap->less(heap->array[child], node)) {
+      break;
+    }
+    place(heap, heap->array[child], i);
+    i = child;
+  }
+  place(heap, node, i);
+}
+
+// Insert an element
+int heapPush(Heap *heap, HeapNode *node) {
+  if (heap->count == heap->capacity) {
+    int capacity = heap->capacity > 0 ? heap->capacity * 2 : 16;
+    HeapNode **array = realloc(heap->array, capacity * sizeof(HeapNode *));
+    if (array == NULL) {
+      return -1;
+    }
+    heap->array = array;
+    heap->capacity = capacity;
+  }
+  place(heap, node, heap->count++);
+  siftUp(heap, node->index);
+  return 0;
+}
+
+// Smallest element
+HeapNode *heapPeek(const Heap *heap) {
+  return heap->count > 0 ? heap->array[0] : NULL;
+}
+
+// Remove an element
+void heapRemove(Heap *heap, HeapNode *node) {
+  int i = node->index;
+  HeapNode *last = heap->array[--heap->count];
+  node->index = -1;
+  if (last == node) {
+    return;
+  }
+  place(heap, last, i);
+  siftUp(heap, i);
+  siftDown(heap, last->index);
+}
+
+// Remove the smallest element
+HeapNode *heapPop(Heap *heap) {
+  HeapNode *node = heapPeek(heap);
+  if (node != NULL) {
+    heapRemove(heap, node);
+  }
+  return node;
+}
+
+// Release the array
+void heapDestroy(Heap *heap) {
+  free(heap->array);
+  heap->array = NULL;
+  heap->count = 0;
+  heap->capacity = 0;
+}
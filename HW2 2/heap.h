@@ -0,0 +1,44 @@
+///////////////////// BINARY HEAP HEADER FILE README///////////////////////
+
+//This file contains the header (`heap.h`) for an intrusive binary min-heap
+//used as the ready structure of the SRTF and stride policies. Every element
+//embeds a `HeapNode` that remembers its position, so arbitrary elements can
+//be removed in O(log n) as well.
+
+// FUNCTIONALITY
+// *`heapInit`: Initialize an empty heap with a comparison function.
+// *`heapPush`: Insert an element in O(log n).
+// *`heapPop`: Remove and return the smallest element in O(log n).
+// *`heapRemove`: Remove an arbitrary element in O(log n).
+// *`heapDestroy`: Release the element array.
+
+#ifndef HEAP_H
+#define HEAP_H
+
+#include <stddef.h>
+
+// Get the enclosing structure of an embedded node
+#define heapEntry(ptr, type, member) \
+  ((type *)((char *)(ptr) - offsetof(type, member)))
+
+// Structure
+typedef struct HeapNode {
+  int index; // Position in the array, -1 if not in the heap
+} HeapNode;
+
+typedef struct {
+  HeapNode **array;
+  int count;
+  int capacity;
+  int (*less)(const HeapNode *a, const HeapNode *b); // Strict ordering
+} Heap;
+
+// Function prototypes
+void heapInit(Heap *heap, int capacity, int (*less)(const HeapNode *, const HeapNode *)); // Empty heap
+int heapPush(Heap *heap, HeapNode *node); // Insert, returns -1 if out of memory
+HeapNode *heapPop(Heap *heap); // Remove the smallest element or NULL
+HeapNode *heapPeek(const Heap *heap); // Smallest element or NULL
+void heapRemove(Heap *heap, HeapNode *node); // Remove an element
+void heapDestroy(Heap *heap); // Release the array
+
+#endif /* HEAP_H */
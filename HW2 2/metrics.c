@@ -0,0 +1,442 @@
+///////////////////// SCHEDULING METRICS SOURCE FILE README///////////////////////
+
+//This file contains the implementation (`metrics.c`) of the scheduling
+//metrics. Every event only updates the counters of one thread; the
+//percentiles are computed once at the end by sorting a copy of the values
+//(nearest-rank method). Events before the arrival of a thread are ignored,
+//the M:N mode spawns every thread at the start and lets it sleep until its
+//arrival.
+
+//The fairness integrates over the contention without visiting the other
+//threads at every event: `share_clock` sums the CPU given out over the
+//tickets competing for it, so a thread is entitled to its tickets times the
+//growth of the clock while it competes (the virtual time of fair queueing).
+
+//The contention state changes with every event of every core, so the M:N
+//mode cannot account the events as they happen without a lock shared by all
+//the cores. Instead every core logs its own events, which are already in
+//time order, and `metricsMerge` replays the logs by merging them on time.
+
+#include "metrics.h"
+#include "trace.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char *value_names[3] = {"wait", "response", "turnaround"};
+
+// Allocate the accounting
+int metricsInit(Metrics *metrics, int nthreads, int ncores, double scale, const char *unit) {
+  metrics->threads = malloc((nthreads > 0 ? nthreads : 1) * sizeof(ThreadMetrics));
+  if (metrics->threads == NULL) {
+    return -1;
+  }
+  for (int i = 0; i < nthreads; i++) {
+    ThreadMetrics *t = &metrics->threads[i];
+    memset(t, 0, sizeof(ThreadMetrics));
+    t->first_run = -1;
+    t->finish = -1;
+    t->ready_since = -1;
+    t->run_since = -1;
+  }
+  metrics->nthreads = nthreads;
+  metrics->last = 0;
+  metrics->competing = 0;
+  metrics->running = 0;
+  metrics->weight = 0;
+  metrics->share_clock = 0;
+  metrics->contended = 0;
+  metrics->logs = calloc(ncores > 0 ? ncores : 1, sizeof(MetricsLog));
+  if (metrics->logs == NULL) {
+    free(metrics->threads);
+    metrics->threads = NULL;
+    return -1;
+  }
+  metrics->ncores = ncores;
+  metrics->scale = scale;
+  metrics->unit = unit;
+  return 0;
+}
+
+void metricsArrive(Metrics *metrics, int thread, long long arrival, int tickets) {
+  metrics->threads[thread].arrival = arrival;
+  metrics->threads[thread].tickets = tickets;
+}
+
+// Tickets of a thread as a weight of the contention
+static long long weightOf(const ThreadMetrics *t) {
+  return t->tickets > 0 ? t->tickets : 0;
+}
+
+// Move the contention state to a time. Events of different cores may carry
+// the same time, a time in the past counts as now.
+static void advance(Metrics *m, long long time) {
+  if (time <= m->last) {
+    return;
+  }
+  if (m->competing >= 2 && m->weight > 0) {
+    m->share_clock += (double)m->running * (time - m->last) / m->weight;
+    m->contended += time - m->last;
+  }
+  m->last = time;
+}
+
+// The thread becomes ready or running
+static void startCompeting(Metrics *m, ThreadMetrics *t) {
+  if (!t->competing) {
+    t->competing = 1;
+    t->share_start = m->share_clock;
+    m->competing++;
+    m->weight += weightOf(t);
+  }
+}
+
+// The thread blocks or exits
+static void stopCompeting(Metrics *m, ThreadMetrics *t) {
+  if (t->competing) {
+    t->competing = 0;
+    t->entitled += weightOf(t) * (m->share_clock - t->share_start);
+    m->competing--;
+    m->weight -= weightOf(t);
+  }
+}
+
+// End the running interval of a thread
+static void stopRunning(Metrics *m, ThreadMetrics *t, long long time) {
+  if (t->run_since >= 0) {
+    t->cpu += time - t->run_since;
+    t->contended_cpu += m->contended - t->contended_start;
+    t->run_since = -1;
+    m->running--;
+  }
+}
+
+// Account a scheduling event
+void metricsEvent(Metrics *metrics, int type, long long time, int thread) {
+  ThreadMetrics *t = &metrics->threads[thread];
+  if (time < t->arrival) {
+    return;
+  }
+
+  advance(metrics, time);
+  switch (type) {
+    case trSWITCH:
+      if (t->ready_since >= 0) {
+        t->wait += time - t->ready_since;
+        t->ready_since = -1;
+      }
+      if (t->first_run < 0) {
+        t->first_run = time;
+      }
+      startCompeting(metrics, t);
+      if (t->run_since < 0) {
+        metrics->running++;
+      }
+      t->run_since = time;
+      t->contended_start = metrics->contended;
+      t->switches++;
+      break;
+    case trYIELD:
+      stopRunning(metrics, t, time);
+      t->ready_since = time;
+      break;
+    case trBLOCK:
+      stopRunning(metrics, t, time);
+      stopCompeting(metrics, t);
+      break;
+    case trWAKE:
+      startCompeting(metrics, t);
+      t->ready_since = time;
+      break;
+    case trEXIT:
+      stopRunning(metrics, t, time);
+      stopCompeting(metrics, t);
+      t->finish = time;
+      break;
+    case trSTEAL:
+      t->migrations++;
+      break;
+  }
+}
+
+// Log an event of a core, a new chunk every pMETRICS_CHUNK events
+void metricsRecord(Metrics *metrics, int core, int type, long long time, int thread) {
+  MetricsLog *log = &metrics->logs[core];
+  MetricsChunk *chunk = log->tail;
+  if (chunk == NULL || chunk->count == pMETRICS_CHUNK) {
+    chunk = malloc(sizeof(MetricsChunk));
+    if (chunk == NULL) {
+      log->lost = 1;
+      return;
+    }
+    chunk->next = NULL;
+    chunk->count = 0;
+    if (log->tail != NULL) {
+      log->tail->next = chunk;
+    } else {
+      log->head = chunk;
+    }
+    log->tail = chunk;
+  }
+  MetricsRecord *r = &chunk->records[chunk->count++];
+  r->time = time;
+  r->type = type;
+  r->thread = thread;
+}
+
+// Account the logs of all cores, always the oldest event first, and release
+// them
+int metricsMerge(Metrics *metrics) {
+  int lost = 0;
+  int *next = calloc(metrics->ncores, sizeof(int)); // Next record of every head chunk
+  if (next == NULL) {
+    return -1;
+  }
+  for (;;) {
+    int oldest = -1;
+    for (int i = 0; i < metrics->ncores; i++) {
+      MetricsLog *log = &metrics->logs[i];
+      while (log->head != NULL && next[i] == log->head->count) {
+        MetricsChunk *chunk = log->head;
+        log->head = chunk->next;
+        free(chunk);
+        next[i] = 0;
+      }
+      if (log->head != NULL &&
+          (oldest < 0 || log->head->records[next[i]].time <
+                             metrics->logs[oldest].head->records[next[oldest]].time)) {
+        oldest = i;
+      }
+    }
+    if (oldest < 0) {
+      break;
+    }
+    MetricsRecord *r = &metrics->logs[oldest].head->records[next[oldest]++];
+    metricsEvent(metrics, r->type, r->time, r->thread);
+  }
+  for (int i = 0; i < metrics->ncores; i++) {
+    metrics->logs[i].tail = NULL;
+    lost |= metrics->logs[i].lost;
+    metrics->logs[i].lost = 0;
+  }
+  free(next);
+  return lost ? -1 : 0;
+}
+
+// One of the per-thread values
+static long long threadValue(const ThreadMetrics *t, int which) {
+  switch (which) {
+    case mWAIT:
+      return t->wait;
+    case mRESPONSE:
+      return t->first_run >= 0 ? t->first_run - t->arrival : 0;
+    default:
+      return t->finish >= 0 ? t->finish - t->arrival : 0;
+  }
+}
+
+static int compareLong(const void *a, const void *b) {
+  long long x = *(const long long *)a;
+  long long y = *(const long long *)b;
+  return (x > y) - (x < y);
+}
+
+// Nearest-rank percentile of a sorted array
+static long long percentile(const long long *sorted, int n, int p) {
+  int rank = (int)(((long long)p * n + 99) / 100);
+  return sorted[rank > 0 ? rank - 1 : 0];
+}
+
+// Compute the aggregate figures
+int metricsSummary(const Metrics *metrics, MetricsSummary *s) {
+  int n = metrics->nthreads;
+  memset(s, 0, sizeof(MetricsSummary));
+  if (n == 0) {
+    return 0;
+  }
+
+  long long *values = malloc(n * sizeof(long long));
+  if (values == NULL) {
+    return -1;
+  }
+  for (int which = 0; which < 3; which++) {
+    double sum = 0;
+    for (int i = 0; i < n; i++) {
+      values[i] = threadValue(&metrics->threads[i], which);
+      sum += values[i];
+    }
+    qsort(values, n, sizeof(long long), compareLong);
+    MetricsPercentiles *p = &s->values[which];
+    p->p50 = percentile(values, n, 50) * metrics->scale;
+    p->p95 = percentile(values, n, 95) * metrics->scale;
+    p->p99 = percentile(values, n, 99) * metrics->scale;
+    p->mean = sum / n * metrics->scale;
+    p->max = values[n - 1] * metrics->scale;
+  }
+  free(values);
+
+  long long start = metrics->threads[0].arrival;
+  long long end = start;
+  for (int i = 0; i < n; i++) {
+    const ThreadMetrics *t = &metrics->threads[i];
+    s->switches += t->switches;
+    s->migrations += t->migrations;
+    s->cpu += t->cpu;
+    s->total_tickets += t->tickets;
+    s->contended_cpu += t->contended_cpu;
+    s->entitled += t->entitled;
+    if (t->arrival < start) {
+      start = t->arrival;
+    }
+    if (t->finish > end) {
+      end = t->finish;
+    }
+  }
+  s->start = start;
+  s->span = end - start;
+  s->utilization = s->span > 0 ? (double)s->cpu / ((double)s->span * metrics->ncores) : 0;
+
+  // Jain's index of the CPU time received under contention relative to the
+  // CPU time entitled, over the threads that competed
+  double sum = 0, sum_sq = 0;
+  int counted = 0;
+  for (int i = 0; i < n; i++) {
+    const ThreadMetrics *t = &metrics->threads[i];
+    if (t->entitled <= 0) {
+      continue;
+    }
+    double x = t->contended_cpu / t->entitled;
+    sum += x;
+    sum_sq += x * x;
+    counted++;
+  }
+  s->fairness = sum_sq > 0 ? sum * sum / (counted * sum_sq) : 1;
+  return 0;
+}
+
+static int compareDouble(const void *a, const void *b) {
+  double x = *(const double *)a;
+  double y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+// Distribution of a figure over runs. The confidence interval uses the
+// normal approximation, which is fine for the hundreds of runs it is meant for.
+int metricsSample(double *values, int n, MetricsSample *sample) {
+  memset(sample, 0, sizeof(MetricsSample));
+  if (n < 1) {
+    return -1;
+  }
+  double sum = 0;
+  for (int i = 0; i < n; i++) {
+    sum += values[i];
+  }
+  double mean = sum / n;
+  double sq = 0;
+  for (int i = 0; i < n; i++) {
+    sq += (values[i] - mean) * (values[i] - mean);
+  }
+  qsort(values, n, sizeof(double), compareDouble);
+
+  sample->n = n;
+  sample->mean = mean;
+  sample->sd = n > 1 && values[0] != values[n - 1] ? sqrt(sq / (n - 1)) : 0;
+  sample->ci = 1.96 * sample->sd / sqrt(n);
+  sample->p5 = values[(5 * n + 99) / 100 - 1];
+  sample->p50 = values[(50 * n + 99) / 100 - 1];
+  sample->p95 = values[(95 * n + 99) / 100 - 1];
+  return 0;
+}
+
+// CPU and ticket share of a thread under contention
+static double cpuShare(const ThreadMetrics *t, const MetricsSummary *s) {
+  return s->contended_cpu > 0 ? (double)t->contended_cpu / s->contended_cpu : 0;
+}
+
+static double ticketShare(const ThreadMetrics *t, const MetricsSummary *s) {
+  return s->entitled > 0 ? t->entitled / s->entitled : 0;
+}
+
+// Print the metrics
+void metricsReport(const Metrics *metrics, FILE *fp, int per_thread) {
+  MetricsSummary s;
+  if (metricsSummary(metrics, &s) != 0) {
+    fprintf(fp, "Could not compute the metrics\n");
+    return;
+  }
+  double scale = metrics->scale;
+
+  if (per_thread) {
+    fprintf(fp, "TID\tArrival\tResponse\tWait\tTurnaround\tCPU\tSwitches\tCPU share\tTicket share\n");
+    for (int i = 0; i < metrics->nthreads; i++) {
+      const ThreadMetrics *t = &metrics->threads[i];
+      fprintf(fp, "T%d\t%.6g\t%.6g\t\t%.6g\t%.6g\t\t%.6g\t%lld\t\t%.4f\t\t%.4f\n", i,
+              (t->arrival - s.start) * scale,
+              threadValue(t, mRESPONSE) * scale, t->wait * scale,
+              threadValue(t, mTURNAROUND) * scale, t->cpu * scale, t->switches,
+              cpuShare(t, &s), ticketShare(t, &s));
+    }
+    fprintf(fp, "\n");
+  }
+
+  fprintf(fp, "Times in %s\tp50\tp95\tp99\tmean\tmax\n", metrics->unit);
+  for (int which = 0; which < 3; which++) {
+    const MetricsPercentiles *p = &s.values[which];
+    fprintf(fp, "%-10s\t%.6g\t%.6g\t%.6g\t%.6g\t%.6g\n", value_names[which],
+            p->p50, p->p95, p->p99, p->mean, p->max);
+  }
+  fprintf(fp, "\nThreads: %d\n", metrics->nthreads);
+  fprintf(fp, "Context switches: %lld\n", s.switches);
+  if (s.migrations > 0) {
+    fprintf(fp, "Migrations: %lld\n", s.migrations);
+  }
+  fprintf(fp, "CPU utilization: %.2f%%\n", s.utilization * 100);
+  fprintf(fp, "Fairness (Jain, CPU share / ticket share under contention): %.4f\n", s.fairness);
+}
+
+// Write the metrics as JSON
+int metricsJson(const Metrics *metrics, FILE *fp, const char *policy) {
+  MetricsSummary s;
+  if (metricsSummary(metrics, &s) != 0) {
+    return -1;
+  }
+  double scale = metrics->scale;
+
+  fprintf(fp, "{\n  \"policy\": \"%s\",\n  \"unit\": \"%s\",\n  \"threads\": %d,\n",
+          policy, metrics->unit, metrics->nthreads);
+  fprintf(fp, "  \"context_switches\": %lld,\n  \"migrations\": %lld,\n", s.switches, s.migrations);
+  fprintf(fp, "  \"utilization\": %.6f,\n  \"fairness\": %.6f,\n", s.utilization, s.fairness);
+  for (int which = 0; which < 3; which++) {
+    const MetricsPercentiles *p = &s.values[which];
+    fprintf(fp, "  \"%s\": {\"p50\": %.6g, \"p95\": %.6g, \"p99\": %.6g, \"mean\": %.6g, \"max\": %.6g},\n",
+            value_names[which], p->p50, p->p95, p->p99, p->mean, p->max);
+  }
+  fprintf(fp, "  \"per_thread\": [");
+  for (int i = 0; i < metrics->nthreads; i++) {
+    const ThreadMetrics *t = &metrics->threads[i];
+    fprintf(fp, "%s\n    {\"id\": %d, \"arrival\": %.6g, \"response\": %.6g, \"wait\": %.6g, "
+            "\"turnaround\": %.6g, \"cpu\": %.6g, \"switches\": %lld, \"migrations\": %lld, "
+            "\"cpu_share\": %.6f, \"ticket_share\": %.6f}",
+            i == 0 ? "" : ",", i, (t->arrival - s.start) * scale, threadValue(t, mRESPONSE) * scale,
+            t->wait * scale, threadValue(t, mTURNAROUND) * scale, t->cpu * scale,
+            t->switches, t->migrations, cpuShare(t, &s), ticketShare(t, &s));
+  }
+  fprintf(fp, "\n  ]\n}\n");
+  return ferror(fp) ? -1 : 0;
+}
+
+// Release the memory
+void metricsDestroy(Metrics *metrics) {
+  for (int i = 0; i < metrics->ncores; i++) {
+    while (metrics->logs[i].head != NULL) {
+      MetricsChunk *chunk = metrics->logs[i].head;
+      metrics->logs[i].head = chunk->next;
+      free(chunk);
+    }
+  }
+  free(metrics->logs);
+  metrics->logs = NULL;
+  free(metrics->threads);
+  metrics->threads = NULL;
+  metrics->nthreads = 0;
+}
@@ -0,0 +1,144 @@
+///////////////////// SCHEDULING METRICS HEADER FILE README///////////////////////
+
+//This file contains the header (`metrics.h`) for the per-thread accounting of
+//a scheduling run. The metrics are fed with the same events as the trace of
+//`trace.h` (switch, yield, block, wake, exit, steal), so the simulation and
+//the M:N mode are measured in exactly the same way. The cores of the M:N
+//mode do not share the accounting: each one appends its events to its own
+//log, and the logs are replayed in time order once the run is over.
+
+// DEFINITIONS
+// *Wait: Total time spent ready but not running.
+// *Response: From the arrival to the first time the thread runs.
+// *Turnaround: From the arrival to the exit.
+// *Contention: The time during which at least two threads are ready or
+//  running. A thread that runs alone, or a run to completion, says nothing
+//  about how a policy divides the CPU, so the shares only count contention.
+// *CPU share: CPU time of the thread under contention over that of all
+//  threads.
+// *Ticket share: CPU time the tickets of the thread entitled it to under
+//  contention (the CPU given out times its tickets over the tickets of the
+//  threads ready or running at that moment), over that of all threads.
+// *Utilization: CPU time of all threads over the cores times the span from
+//  the first arrival to the last exit.
+// *Fairness: Jain's index of the CPU time received under contention over
+//  the CPU time entitled, 1 when every thread got exactly its share, 1/n at
+//  worst.
+
+// FUNCTIONALITY
+// *`metricsInit`: Allocate the accounting of n threads.
+// *`metricsArrive`: Set the arrival time and tickets of a thread.
+// *`metricsEvent`: Account a scheduling event.
+// *`metricsRecord`: Log an event of a core, accounted by `metricsMerge`.
+// *`metricsMerge`: Account the logged events of all cores in time order.
+// *`metricsSummary`: Compute the aggregate figures of a run.
+// *`metricsSample`: Mean, confidence interval and percentiles over runs.
+// *`metricsReport`: Print the per-thread table and the percentiles.
+// *`metricsJson`: Write the same figures as JSON.
+// *`metricsDestroy`: Release the memory.
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdio.h>
+
+#define pMETRICS_CHUNK 4096 // Events logged by a core per allocation
+
+// Structure
+typedef struct {
+  long long arrival;
+  int tickets; // Tickets at the start
+  long long first_run; // -1 until the thread runs
+  long long finish; // -1 until the thread exits
+  long long ready_since; // -1 unless ready
+  long long run_since; // -1 unless running
+  long long wait; // Time spent ready
+  long long cpu; // Time spent running
+  long long switches; // Number of times the thread was dispatched
+  long long migrations; // Number of times the thread was stolen
+  int competing; // Ready or running
+  double share_start; // share_clock when it started competing
+  long long contended_start; // contended when it started running
+  double entitled; // CPU time its tickets entitled it to under contention
+  long long contended_cpu; // CPU time received under contention
+} ThreadMetrics;
+
+typedef struct {
+  long long time;
+  int type;
+  int thread;
+} MetricsRecord;
+
+typedef struct MetricsChunk {
+  struct MetricsChunk *next;
+  int count;
+  MetricsRecord records[pMETRICS_CHUNK];
+} MetricsChunk;
+
+// Events of one core, in the order they happened
+typedef struct {
+  MetricsChunk *head;
+  MetricsChunk *tail;
+  int lost; // An allocation failed, events are missing
+} __attribute__((aligned(64))) MetricsLog;
+
+typedef struct {
+  ThreadMetrics *threads;
+  int nthreads;
+  int ncores; // Cores the CPU time is spread over, for the utilization
+  double scale; // Report unit per time unit of the events
+  const char *unit; // Name of the report unit
+  MetricsLog *logs; // One per core
+  long long last; // Time the contention state was last advanced to
+  int competing; // Threads ready or running
+  int running; // Threads running
+  long long weight; // Tickets of the threads ready or running
+  double share_clock; // CPU time a ticket was entitled to under contention so far
+  long long contended; // Contention time so far
+} Metrics;
+
+#define mWAIT 0
+#define mRESPONSE 1
+#define mTURNAROUND 2
+
+typedef struct {
+  double p50, p95, p99, mean, max;
+} MetricsPercentiles;
+
+// Aggregate figures of a run
+typedef struct {
+  MetricsPercentiles values[3]; // mWAIT, mRESPONSE, mTURNAROUND
+  long long switches;
+  long long migrations;
+  long long cpu;
+  long long start; // First arrival
+  long long span; // First arrival to last exit
+  long long total_tickets;
+  long long contended_cpu; // CPU time under contention
+  double entitled; // CPU time entitled under contention
+  double utilization;
+  double fairness;
+} MetricsSummary;
+
+// Distribution of a figure over many runs
+typedef struct {
+  int n;
+  double mean;
+  double sd; // Sample standard deviation
+  double ci; // Half width of the 95% confidence interval of the mean
+  double p5, p50, p95;
+} MetricsSample;
+
+// Function prototypes
+int metricsInit(Metrics *metrics, int nthreads, int ncores, double scale, const char *unit); // -1 if out of memory
+void metricsArrive(Metrics *metrics, int thread, long long arrival, int tickets); // Before any event
+void metricsEvent(Metrics *metrics, int type, long long time, int thread); // trSWITCH ... trSTEAL
+void metricsRecord(Metrics *metrics, int core, int type, long long time, int thread); // Only core may call it
+int metricsMerge(Metrics *metrics); // After the run, -1 if events were lost
+int metricsSummary(const Metrics *metrics, MetricsSummary *summary); // -1 if out of memory
+int metricsSample(double *values, int n, MetricsSample *sample); // Sorts values, -1 if n < 1
+void metricsReport(const Metrics *metrics, FILE *fp, int per_thread); // Human-readable
+int metricsJson(const Metrics *metrics, FILE *fp, const char *policy); // -1 if out of memory
+void metricsDestroy(Metrics *metrics); // Release the memory
+
+#endif /* METRICS_H */
@@ -0,0 +1,883 @@
+///////////////////// SCHEDULING POLICY SOURCE FILE README///////////////////////
+
+//This file contains the implementation (`policy.c`) of the scheduling
+//policies declared in `policy.h`. Each policy embeds `SchedPolicy` as its
+//first member and keeps its own ready structure:
+// *lottery: Fenwick tree of tickets, O(log n) draw and update. With
+//  currencies, a Fenwick tree of currency values on top of one per currency.
+// *srtf: Binary heap keyed by remaining burst, O(log n).
+// *stride: Binary heap keyed by pass, O(log n).
+// *mlfq: One FIFO per level and a bitmask of non-empty levels, O(1).
+// *cfs: Red-black tree keyed by virtual runtime, O(log n).
+
+//Helped from Waldspurger, C. A. (1995). Lottery and Stride Scheduling, and
+//Arpaci-Dusseau, R. H. & A. C. (2018). Operating Systems: Three Easy Pieces.
+
+#include "policy.h"
+#include "fenwick.h"
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define pSTRIDE1 (1 << 20) // Stride of a thread holding a single ticket
+#define pMLFQ_LEVELS 3 // Number of MLFQ levels
+#define pMLFQ_BOOST 50 // Time units between MLFQ priority boosts
+#define pCFS_WEIGHT 1024 // Weight that advances vruntime at wall clock rate
+
+// Tickets used as a weight, never zero, with the transferred ones
+static int weightOf(const SchedEntity *se) {
+  return (se->tickets > 0 ? se->tickets : 1) + (se->boost > 0 ? se->boost : 0);
+}
+
+// Common slice accounting of the fixed quantum policies
+static int sliceExpired(SchedPolicy *policy, SchedEntity *se, int ran) {
+  se->slice += ran;
+  return se->slice >= policy->quantum;
+}
+
+// Mark an entity as running
+static SchedEntity *setCurrent(SchedPolicy *policy, SchedEntity *se) {
+  if (se != NULL) {
+    policy->ready--;
+    se->slice = 0;
+  }
+  policy->current = se;
+  return se;
+}
+
+// Forget the running entity if it is being requeued or blocked
+static void clearCurrent(SchedPolicy *policy, SchedEntity *se) {
+  if (policy->current == se) {
+    policy->current = NULL;
+  }
+}
+
+// The other policies read the tickets on every tick or wake, and have no
+// currencies: every ticket is a base ticket
+static void setTickets(SchedPolicy *policy, SchedEntity *se, int tickets) {
+  (void)policy;
+  se->tickets = tickets;
+}
+
+static void transfer(SchedPolicy *policy, SchedEntity *se, int delta) {
+  (void)policy;
+  se->boost += delta;
+}
+
+static int value(SchedPolicy *policy, const SchedEntity *se) {
+  (void)policy;
+  return weightOf(se);
+}
+
+static int fund(SchedPolicy *policy, int currency, int funding) {
+  (void)policy;
+  (void)currency;
+  (void)funding;
+  return 0;
+}
+
+// %%%%%%%%%%%%%%%%%%%%%% Lottery %%%%%%%%%%%%%%%%%%%%%%
+
+// Slots of a draw: the tickets of every slot and the entity holding it. A
+// slot is taken when an entity enters the draw and given back when it
+// leaves, so the tree is only as large as the most entities ready together.
+typedef struct {
+  Fenwick tickets; // Tickets of every slot
+  SchedEntity **members; // Entity holding every slot, NULL if released
+  int *free; // Released slots, reused before new ones
+  int nfree;
+  int used; // Slots handed out at least once
+} Slots;
+
+// Tickets issued in a currency and the base tickets that fund them. Only the
+// tickets of ready entities are active, so the funding is always divided
+// among the entities that can run and a group cannot grow by adding threads.
+typedef struct {
+  Slots slots; // Active tickets, indexed by slot in the currency
+  long long funding; // Base tickets, 0 if the currency is not funded
+} Currency;
+
+typedef struct {
+  SchedPolicy base;
+  Slots slots; // Base currency: tickets of the ready entities and base
+               // tickets transferred to the others
+  Fenwick values; // Base value of every currency with ready entities
+  Currency *currencies; // currencies[0] is the base currency (unused)
+  int ncurrencies;
+} LotteryPolicy;
+
+// Draw a uniformly distributed ticket in [0, total)
+static long long drawTicket(SchedPolicy *policy, long long total) {
+  unsigned long long r = ((unsigned long long)rand_r(&policy->seed) << 31) ^
+                         (unsigned long long)rand_r(&policy->seed);
+  if (policy->draw != NULL) {
+    r = policy->draw(policy->draw_arg, r);
+  }
+  return (long long)(r % (unsigned long long)total);
+}
+
+static int slotsInit(Slots *s, int size) {
+  memset(s, 0, sizeof(Slots));
+  s->members = calloc(size, sizeof(SchedEntity *));
+  s->free = malloc(size * sizeof(int));
+  if (s->members == NULL || s->free == NULL || fenwickInit(&s->tickets, size) != 0) {
+    free(s->members);
+    free(s->free);
+    return -1;
+  }
+  return 0;
+}
+
+static void slotsDestroy(Slots *s) {
+  fenwickDestroy(&s->tickets);
+  free(s->members);
+  free(s->free);
+}
+
+// Whether the entity holds the slot
+static int slotsHeld(const Slots *s, int slot, const SchedEntity *se) {
+  return slot >= 0 && slot < s->used && s->members[slot] == se;
+}
+
+// Give the entity a slot, a released one if any, otherwise a new one and
+// the tree doubles when it is full. -1 if out of memory.
+static int slotsTake(Slots *s, int *slot, SchedEntity *se) {
+  if (slotsHeld(s, *slot, se)) {
+    return 0;
+  }
+  if (s->nfree > 0) {
+    *slot = s->free[--s->nfree];
+  } else {
+    int size = s->tickets.size;
+    if (s->used == size) {
+      if (size > INT_MAX / 2) {
+        return -1;
+      }
+      SchedEntity **members = realloc(s->members, size * 2 * sizeof(SchedEntity *));
+      if (members == NULL) {
+        return -1;
+      }
+      s->members = members;
+      int *released = realloc(s->free, size * 2 * sizeof(int));
+      if (released == NULL) {
+        return -1;
+      }
+      s->free = released;
+      if (fenwickGrow(&s->tickets, size * 2) != 0) {
+        return -1;
+      }
+    }
+    *slot = s->used++;
+  }
+  s->members[*slot] = se;
+  return 0;
+}
+
+// Give the slot of the entity back, with its tickets
+static void slotsRelease(Slots *s, int slot, const SchedEntity *se) {
+  if (slotsHeld(s, slot, se)) {
+    fenwickSet(&s->tickets, slot, 0);
+    s->members[slot] = NULL;
+    s->free[s->nfree++] = slot;
+  }
+}
+
+// Refresh the value of a currency in the top level draw
+static void currencyUpdate(LotteryPolicy *lp, int currency) {
+  long long value = 0;
+  if (currency == 0) {
+    value = lp->slots.tickets.total;
+  } else if (lp->currencies[currency].slots.tickets.total > 0) {
+    value = lp->currencies[currency].funding > 0 ? lp->currencies[currency].funding : 1;
+  }
+  fenwickSet(&lp->values, currency, value);
+}
+
+// Currency of an entity, NULL for the base currency or an unknown one
+static Currency *currencyOf(LotteryPolicy *lp, const SchedEntity *se) {
+  if (se->currency <= 0 || se->currency >= lp->ncurrencies) {
+    return NULL;
+  }
+  return &lp->currencies[se->currency];
+}
+
+// Tickets of an entity, inflated by a compensation if it used only a part
+// of its last quantum (Waldspurger's compensation tickets)
+static long long compensated(const SchedPolicy *policy, const SchedEntity *se, long long tickets) {
+  if (se->slice > 0 && se->slice < policy->quantum) {
+    return tickets * policy->quantum / se->slice;
+  }
+  return tickets;
+}
+
+// Put a ready entity in the draw
+static int lotteryInsert(LotteryPolicy *lp, SchedEntity *se) {
+  Currency *c = currencyOf(lp, se);
+  long long tickets = compensated(&lp->base, se, se->tickets > 0 ? se->tickets : 1);
+  if (c == NULL) {
+    if (slotsTake(&lp->slots, &se->slot, se) != 0) {
+      return -1;
+    }
+    fenwickSet(&lp->slots.tickets, se->slot, tickets + (se->boost > 0 ? se->boost : 0));
+  } else {
+    if (slotsTake(&c->slots, &se->cslot, se) != 0) {
+      return -1;
+    }
+    fenwickSet(&c->slots.tickets, se->cslot, tickets);
+    // Transferred tickets are base tickets, they are drawn in the base currency
+    if (se->boost > 0) {
+      if (slotsTake(&lp->slots, &se->slot, se) != 0) {
+        slotsRelease(&c->slots, se->cslot, se);
+        return -1;
+      }
+      fenwickSet(&lp->slots.tickets, se->slot, se->boost);
+    }
+    currencyUpdate(lp, se->currency);
+  }
+  currencyUpdate(lp, 0);
+  return 0;
+}
+
+// Take an entity out of the draw, its slots are given back
+static void lotteryRemove(LotteryPolicy *lp, SchedEntity *se) {
+  if (slotsHeld(&lp->slots, se->slot, se)) {
+    slotsRelease(&lp->slots, se->slot, se);
+    currencyUpdate(lp, 0);
+  }
+  Currency *c = currencyOf(lp, se);
+  if (c != NULL && slotsHeld(&c->slots, se->cslot, se)) {
+    slotsRelease(&c->slots, se->cslot, se);
+    currencyUpdate(lp, se->currency);
+  }
+}
+
+// Entity owning a ticket of a draw
+static SchedEntity *slotsDraw(LotteryPolicy *lp, Slots *s) {
+  return s->members[fenwickFind(&s->tickets, drawTicket(&lp->base, s->tickets.total))];
+}
+
+// Draw an entity and take it out. Without currencies this is a single draw
+// in the base currency; otherwise a currency is drawn by value first, then
+// an entity by its tickets in that currency.
+static SchedEntity *lotteryDraw(LotteryPolicy *lp) {
+  SchedEntity *se;
+  if (lp->ncurrencies <= 1) {
+    if (lp->slots.tickets.total <= 0) {
+      return NULL;
+    }
+    se = slotsDraw(lp, &lp->slots);
+  } else {
+    if (lp->values.total <= 0) {
+      return NULL;
+    }
+    int currency = fenwickFind(&lp->values, drawTicket(&lp->base, lp->values.total));
+    se = slotsDraw(lp, currency == 0 ? &lp->slots : &lp->currencies[currency].slots);
+  }
+  lotteryRemove(lp, se);
+  return se;
+}
+
+static SchedEntity *lotteryPick(SchedPolicy *policy) {
+  return setCurrent(policy, lotteryDraw((LotteryPolicy *)policy));
+}
+
+static SchedEntity *lotterySteal(SchedPolicy *policy) {
+  SchedEntity *se = lotteryDraw((LotteryPolicy *)policy);
+  if (se != NULL) {
+    policy->ready--;
+  }
+  return se;
+}
+
+static int lotteryWake(SchedPolicy *policy, SchedEntity *se) {
+  clearCurrent(policy, se);
+  if (lotteryInsert((LotteryPolicy *)policy, se) != 0) {
+    return -1;
+  }
+  policy->ready++;
+  return 0;
+}
+
+static void lotteryBlock(SchedPolicy *policy, SchedEntity *se) {
+  clearCurrent(policy, se);
+}
+
+// Ready if it holds a slot in its currency
+static int lotteryReady(LotteryPolicy *lp, const SchedEntity *se) {
+  Currency *c = currencyOf(lp, se);
+  if (c == NULL) {
+    return slotsHeld(&lp->slots, se->slot, se);
+  }
+  return slotsHeld(&c->slots, se->cslot, se);
+}
+
+// Reweight the entity in place if it is waiting in the draw
+static void lotterySetTickets(SchedPolicy *policy, SchedEntity *se, int tickets) {
+  LotteryPolicy *lp = (LotteryPolicy *)policy;
+  int ready = lotteryReady(lp, se);
+  if (ready) {
+    lotteryRemove(lp, se);
+  }
+  se->tickets = tickets;
+  if (ready) {
+    lotteryInsert(lp, se);
+  }
+}
+
+static void lotteryTransfer(SchedPolicy *policy, SchedEntity *se, int delta) {
+  LotteryPolicy *lp = (LotteryPolicy *)policy;
+  int ready = lotteryReady(lp, se);
+  if (ready) {
+    lotteryRemove(lp, se);
+  }
+  se->boost += delta;
+  if (ready) {
+    lotteryInsert(lp, se);
+  }
+}
+
+// Exchange rate of the currency: its funding over its active tickets, the
+// running entity included
+static int lotteryValue(SchedPolicy *policy, const SchedEntity *se) {
+  LotteryPolicy *lp = (LotteryPolicy *)policy;
+  Currency *c = currencyOf(lp, se);
+  int tickets = se->tickets > 0 ? se->tickets : 1;
+  int boost = se->boost > 0 ? se->boost : 0;
+  if (c == NULL) {
+    return tickets + boost;
+  }
+  long long active = c->slots.tickets.total;
+  if (!lotteryReady(lp, se)) {
+    active += tickets;
+  }
+  long long value = c->funding * tickets / active;
+  return (int)(value > 0 ? value : 1) + boost;
+}
+
+static int lotteryFund(SchedPolicy *policy, int currency, int funding) {
+  LotteryPolicy *lp = (LotteryPolicy *)policy;
+  if (currency <= 0) {
+    return -1;
+  }
+  if (currency >= lp->ncurrencies) {
+    Currency *currencies = realloc(lp->currencies, (currency + 1) * sizeof(Currency));
+    if (currencies == NULL) {
+      return -1;
+    }
+    lp->currencies = currencies;
+    for (int i = lp->ncurrencies; i <= currency; i++) {
+      Currency *c = &currencies[i];
+      memset(c, 0, sizeof(Currency));
+      if (slotsInit(&c->slots, 16) != 0) {
+        lp->ncurrencies = i;
+        return -1;
+      }
+    }
+    lp->ncurrencies = currency + 1;
+    if (fenwickGrow(&lp->values, lp->ncurrencies) != 0) {
+      return -1;
+    }
+  }
+  lp->currencies[currency].funding = funding;
+  currencyUpdate(lp, currency);
+  return 0;
+}
+
+static void lotteryDestroy(SchedPolicy *policy) {
+  LotteryPolicy *lp = (LotteryPolicy *)policy;
+  for (int i = 1; i < lp->ncurrencies; i++) {
+    slotsDestroy(&lp->currencies[i].slots);
+  }
+  free(lp->currencies);
+  fenwickDestroy(&lp->values);
+  slotsDestroy(&lp->slots);
+}
+
+static SchedPolicy *lotteryCreate(void) {
+  LotteryPolicy *lp = calloc(1, sizeof(LotteryPolicy));
+  if (lp == NULL) {
+    return NULL;
+  }
+  lp->ncurrencies = 1;
+  if (slotsInit(&lp->slots, 16) != 0) {
+    free(lp);
+    return NULL;
+  }
+  if (fenwickInit(&lp->values, 1) != 0) {
+    slotsDestroy(&lp->slots);
+    free(lp);
+    return NULL;
+  }
+  lp->base.pickNext = lotteryPick;
+  lp->base.onWake = lotteryWake;
+  lp->base.onBlock = lotteryBlock;
+  lp->base.onTick = sliceExpired;
+  lp->base.steal = lotterySteal;
+  lp->base.setTickets = lotterySetTickets;
+  lp->base.transfer = lotteryTransfer;
+  lp->base.value = lotteryValue;
+  lp->base.fund = lotteryFund;
+  lp->base.destroy = lotteryDestroy;
+  return &lp->base;
+}
+
+// %%%%%%%%%%%%%%%%%%%%%% Shortest Remaining Time First %%%%%%%%%%%%%%%%%%%%%%
+
+typedef struct {
+  SchedPolicy base;
+  Heap heap;
+} HeapPolicy;
+
+static int srtfLess(const HeapNode *a, const HeapNode *b) {
+  const SchedEntity *x = heapEntry(a, SchedEntity, heap);
+  const SchedEntity *y = heapEntry(b, SchedEntity, heap);
+  if (x->remaining != y->remaining) {
+    return x->remaining < y->remaining;
+  }
+  return x->seq < y->seq;
+}
+
+static SchedEntity *heapPick(SchedPolicy *policy) {
+  HeapNode *node = heapPop(&((HeapPolicy *)policy)->heap);
+  return setCurrent(policy, node != NULL ? heapEntry(node, SchedEntity, heap) : NULL);
+}
+
+static int heapWake(SchedPolicy *policy, SchedEntity *se) {
+  clearCurrent(policy, se);
+  se->seq = policy->seq++;
+  if (heapPush(&((HeapPolicy *)policy)->heap, &se->heap) != 0) {
+    return -1;
+  }
+  policy->ready++;
+  return 0;
+}
+
+// Steal the last leaf, it is rarely the next one to run here
+static SchedEntity *heapSteal(SchedPolicy *policy) {
+  Heap *heap = &((HeapPolicy *)policy)->heap;
+  if (heap->count == 0) {
+    return NULL;
+  }
+  HeapNode *node = heap->array[heap->count - 1];
+  heapRemove(heap, node);
+  policy->ready--;
+  return heapEntry(node, SchedEntity, heap);
+}
+
+static int srtfWake(SchedPolicy *policy, SchedEntity *se) {
+  SchedEntity *running = policy->current;
+  if (heapWake(policy, se) != 0) {
+    return -1;
+  }
+  // Preempt as soon as a shorter job becomes ready
+  return running != NULL && running != se && se->remaining < running->remaining;
+}
+
+static int srtfTick(SchedPolicy *policy, SchedEntity *se, int ran) {
+  (void)policy;
+  se->slice += ran;
+  return 0; // Runs until the burst ends or a shorter job arrives
+}
+
+static void heapBlock(SchedPolicy *policy, SchedEntity *se) {
+  clearCurrent(policy, se);
+}
+
+static void heapPolicyDestroy(SchedPolicy *policy) {
+  heapDestroy(&((HeapPolicy *)policy)->heap);
+}
+
+static SchedPolicy *heapPolicyCreate(int (*less)(const HeapNode *, const HeapNode *)) {
+  HeapPolicy *hp = calloc(1, sizeof(HeapPolicy));
+  if (hp == NULL) {
+    return NULL;
+  }
+  heapInit(&hp->heap, 16, less);
+  if (hp->heap.array == NULL) {
+    free(hp);
+    return NULL;
+  }
+  hp->base.pickNext = heapPick;
+  hp->base.onWake = heapWake;
+  hp->base.onBlock = heapBlock;
+  hp->base.steal = heapSteal;
+  hp->base.destroy = heapPolicyDestroy;
+  return &hp->base;
+}
+
+static SchedPolicy *srtfCreate(void) {
+  SchedPolicy *policy = heapPolicyCreate(srtfLess);
+  if (policy != NULL) {
+    policy->onWake = srtfWake;
+    policy->onTick = srtfTick;
+  }
+  return policy;
+}
+
+// %%%%%%%%%%%%%%%%%%%%%% Stride %%%%%%%%%%%%%%%%%%%%%%
+
+typedef struct {
+  HeapPolicy hp;
+  long long global_pass; // Pass of the last picked entity
+} StridePolicy;
+
+static int strideLess(const HeapNode *a, const HeapNode *b) {
+  const SchedEntity *x = heapEntry(a, SchedEntity, heap);
+  const SchedEntity *y = heapEntry(b, SchedEntity, heap);
+  if (x->pass != y->pass) {
+    return x->pass < y->pass;
+  }
+  return x->seq < y->seq;
+}
+
+static SchedEntity *stridePick(SchedPolicy *policy) {
+  StridePolicy *sp = (StridePolicy *)policy;
+  SchedEntity *se = heapPick(policy);
+  if (se != NULL && se->pass > sp->global_pass) {
+    sp->global_pass = se->pass;
+  }
+  return se;
+}
+
+static SchedEntity *strideSteal(SchedPolicy *policy) {
+  SchedEntity *se = heapSteal(policy);
+  if (se != NULL) {
+    se->pass -= ((StridePolicy *)policy)->global_pass;
+    se->migrated = 1;
+  }
+  return se;
+}
+
+static int strideWake(SchedPolicy *policy, SchedEntity *se) {
+  StridePolicy *sp = (StridePolicy *)policy;
+  if (se->migrated) {
+    se->pass += sp->global_pass;
+    se->migrated = 0;
+  }
+  // A thread that slept must not bank the pass it did not use
+  if (se->pass < sp->global_pass) {
+    se->pass = sp->global_pass;
+  }
+  return heapWake(policy, se);
+}
+
+static int strideTick(SchedPolicy *policy, SchedEntity *se, int ran) {
+  se->pass += (long long)ran * (pSTRIDE1 / weightOf(se));
+  return sliceExpired(policy, se, ran);
+}
+
+static SchedPolicy *strideCreate(void) {
+  StridePolicy *sp = calloc(1, sizeof(StridePolicy));
+  if (sp == NULL) {
+    return NULL;
+  }
+  heapInit(&sp->hp.heap, 16, strideLess);
+  if (sp->hp.heap.array == NULL) {
+    free(sp);
+    return NULL;
+  }
+  sp->hp.base.pickNext = stridePick;
+  sp->hp.base.onWake = strideWake;
+  sp->hp.base.onBlock = heapBlock;
+  sp->hp.base.onTick = strideTick;
+  sp->hp.base.steal = strideSteal;
+  sp->hp.base.destroy = heapPolicyDestroy;
+  return &sp->hp.base;
+}
+
+// %%%%%%%%%%%%%%%%%%%%%% Multilevel Feedback Queue %%%%%%%%%%%%%%%%%%%%%%
+
+typedef struct {
+  SchedPolicy base;
+  SchedEntity *head[pMLFQ_LEVELS];
+  SchedEntity *tail[pMLFQ_LEVELS];
+  unsigned int nonempty; // Bit i is set if level i has entities
+  long long clock; // Time units charged so far
+  long long last_boost; // Clock of the last priority boost
+} MlfqPolicy;
+
+// Quantum of a level, doubles at every level
+static int mlfqQuantum(SchedPolicy *policy, int level) {
+  return policy->quantum << level;
+}
+
+static void mlfqAppend(MlfqPolicy *mp, SchedEntity *se) {
+  int level = se->level;
+  se->next = NULL;
+  if (mp->tail[level] != NULL) {
+    mp->tail[level]->next = se;
+  } else {
+    mp->head[level] = se;
+  }
+  mp->tail[level] = se;
+  mp->nonempty |= 1u << level;
+}
+
+// Move every queued entity back to the top level
+static void mlfqBoost(MlfqPolicy *mp) {
+  for (int level = 1; level < pMLFQ_LEVELS; level++) {
+    SchedEntity *se = mp->head[level];
+    while (se != NULL) {
+      SchedEntity *next = se->next;
+      se->level = 0;
+      se->used = 0;
+      mlfqAppend(mp, se);
+      se = next;
+    }
+    mp->head[level] = NULL;
+    mp->tail[level] = NULL;
+    mp->nonempty &= ~(1u << level);
+  }
+  mp->last_boost = mp->clock;
+}
+
+static SchedEntity *mlfqPick(SchedPolicy *policy) {
+  MlfqPolicy *mp = (MlfqPolicy *)policy;
+  if (mp->nonempty == 0) {
+    return setCurrent(policy, NULL);
+  }
+  int level = __builtin_ctz(mp->nonempty);
+  SchedEntity *se = mp->head[level];
+  mp->head[level] = se->next;
+  if (mp->head[level] == NULL) {
+    mp->tail[level] = NULL;
+    mp->nonempty &= ~(1u << level);
+  }
+  se->next = NULL;
+  return setCurrent(policy, se);
+}
+
+// Steal from the lowest non-empty level
+static SchedEntity *mlfqSteal(SchedPolicy *policy) {
+  MlfqPolicy *mp = (MlfqPolicy *)policy;
+  if (mp->nonempty == 0) {
+    return NULL;
+  }
+  int level = 31 - __builtin_clz(mp->nonempty);
+  SchedEntity *se = mp->head[level];
+  mp->head[level] = se->next;
+  if (mp->head[level] == NULL) {
+    mp->tail[level] = NULL;
+    mp->nonempty &= ~(1u << level);
+  }
+  se->next = NULL;
+  se->stamp = mp->clock;
+  policy->ready--;
+  return se;
+}
+
+static int mlfqWake(SchedPolicy *policy, SchedEntity *se) {
+  MlfqPolicy *mp = (MlfqPolicy *)policy;
+  SchedEntity *running = policy->current;
+  clearCurrent(policy, se);
+  // Missed a boost while blocked
+  if (se->stamp < mp->last_boost) {
+    se->level = 0;
+    se->used = 0;
+  }
+  mlfqAppend(mp, se);
+  policy->ready++;
+  return running != NULL && running != se && se->level < running->level;
+}
+
+static void mlfqBlock(SchedPolicy *policy, SchedEntity *se) {
+  clearCurrent(policy, se);
+  se->stamp = ((MlfqPolicy *)policy)->clock;
+}
+
+static int mlfqTick(SchedPolicy *policy, SchedEntity *se, int ran) {
+  MlfqPolicy *mp = (MlfqPolicy *)policy;
+  mp->clock += ran;
+  se->slice += ran;
+  // The allotment is kept across I/O so that yielding early does not game it
+  se->used += ran;
+  if (mp->clock - mp->last_boost >= pMLFQ_BOOST) {
+    mlfqBoost(mp);
+    se->level = 0;
+    se->used = 0;
+    return 1;
+  }
+  if (se->used >= mlfqQuantum(policy, se->level)) {
+    if (se->level < pMLFQ_LEVELS - 1) {
+      se->level++;
+    }
+    se->used = 0;
+    return 1;
+  }
+  return se->slice >= mlfqQuantum(policy, se->level);
+}
+
+static void mlfqDestroy(SchedPolicy *policy) {
+  (void)policy;
+}
+
+static SchedPolicy *mlfqCreate(void) {
+  MlfqPolicy *mp = calloc(1, sizeof(MlfqPolicy));
+  if (mp == NULL) {
+    return NULL;
+  }
+  mp->base.pickNext = mlfqPick;
+  mp->base.onWake = mlfqWake;
+  mp->base.onBlock = mlfqBlock;
+  mp->base.onTick = mlfqTick;
+  mp->base.steal = mlfqSteal;
+  mp->base.destroy = mlfqDestroy;
+  return &mp->base;
+}
+
+// %%%%%%%%%%%%%%%%%%%%%% Completely Fair (vruntime) %%%%%%%%%%%%%%%%%%%%%%
+
+typedef struct {
+  SchedPolicy base;
+  RbTree tree;
+  long long min_vruntime; // Monotonic lower bound of the ready vruntimes
+} CfsPolicy;
+
+static int cfsLess(const RbNode *a, const RbNode *b) {
+  const SchedEntity *x = rbEntry(a, SchedEntity, rb);
+  const SchedEntity *y = rbEntry(b, SchedEntity, rb);
+  if (x->vruntime != y->vruntime) {
+    return x->vruntime < y->vruntime;
+  }
+  return x->seq < y->seq;
+}
+
+static void cfsUpdateMin(CfsPolicy *cp) {
+  long long min = cp->min_vruntime;
+  RbNode *first = rbFirst(&cp->tree);
+  SchedEntity *running = cp->base.current;
+  if (first != NULL) {
+    min = rbEntry(first, SchedEntity, rb)->vruntime;
+    if (running != NULL && running->vruntime < min) {
+      min = running->vruntime;
+    }
+  } else if (running != NULL) {
+    min = running->vruntime;
+  }
+  if (min > cp->min_vruntime) {
+    cp->min_vruntime = min;
+  }
+}
+
+static SchedEntity *cfsPick(SchedPolicy *policy) {
+  CfsPolicy *cp = (CfsPolicy *)policy;
+  RbNode *first = rbFirst(&cp->tree);
+  if (first == NULL) {
+    return setCurrent(policy, NULL);
+  }
+  rbRemove(&cp->tree, first);
+  setCurrent(policy, rbEntry(first, SchedEntity, rb));
+  cfsUpdateMin(cp);
+  return policy->current;
+}
+
+static SchedEntity *cfsSteal(SchedPolicy *policy) {
+  CfsPolicy *cp = (CfsPolicy *)policy;
+  RbNode *first = rbFirst(&cp->tree);
+  if (first == NULL) {
+    return NULL;
+  }
+  rbRemove(&cp->tree, first);
+  policy->ready--;
+  SchedEntity *se = rbEntry(first, SchedEntity, rb);
+  se->vruntime -= cp->min_vruntime;
+  se->migrated = 1;
+  return se;
+}
+
+static int cfsWake(SchedPolicy *policy, SchedEntity *se) {
+  CfsPolicy *cp = (CfsPolicy *)policy;
+  SchedEntity *running = policy->current;
+  long long credit = (long long)policy->quantum * pCFS_WEIGHT / 2;
+  clearCurrent(policy, se);
+  if (se->migrated) {
+    se->vruntime += cp->min_vruntime;
+    se->migrated = 0;
+  }
+  // Sleepers get at most half a slice of credit
+  if (se->vruntime < cp->min_vruntime - credit) {
+    se->vruntime = cp->min_vruntime - credit;
+  }
+  se->seq = policy->seq++;
+  rbInsert(&cp->tree, &se->rb);
+  policy->ready++;
+  return running != NULL && running != se &&
+         se->vruntime + pCFS_WEIGHT < running->vruntime;
+}
+
+static void cfsBlock(SchedPolicy *policy, SchedEntity *se) {
+  clearCurrent(policy, se);
+}
+
+static int cfsTick(SchedPolicy *policy, SchedEntity *se, int ran) {
+  se->vruntime += (long long)ran * pCFS_WEIGHT / weightOf(se);
+  cfsUpdateMin((CfsPolicy *)policy);
+  return sliceExpired(policy, se, ran);
+}
+
+static void cfsDestroy(SchedPolicy *policy) {
+  (void)policy;
+}
+
+static SchedPolicy *cfsCreate(void) {
+  CfsPolicy *cp = calloc(1, sizeof(CfsPolicy));
+  if (cp == NULL) {
+    return NULL;
+  }
+  rbInit(&cp->tree, cfsLess);
+  cp->base.pickNext = cfsPick;
+  cp->base.onWake = cfsWake;
+  cp->base.onBlock = cfsBlock;
+  cp->base.onTick = cfsTick;
+  cp->base.steal = cfsSteal;
+  cp->base.destroy = cfsDestroy;
+  return &cp->base;
+}
+
+// %%%%%%%%%%%%%%%%%%%%%% Registry %%%%%%%%%%%%%%%%%%%%%%
+
+static const struct {
+  const char *name;
+  SchedPolicy *(*create)(void);
+} policies[] = {
+  {"lottery", lotteryCreate},
+  {"srtf", srtfCreate},
+  {"stride", strideCreate},
+  {"mlfq", mlfqCreate},
+  {"cfs", cfsCreate},
+};
+
+// Create a policy by name
+SchedPolicy *policyCreate(const char *name, int quantum, unsigned int seed) {
+  for (size_t i = 0; i < sizeof(policies) / sizeof(policies[0]); i++) {
+    if (strcmp(policies[i].name, name) == 0) {
+      SchedPolicy *policy = policies[i].create();
+      if (policy != NULL) {
+        policy->name = policies[i].name;
+        if (policy->setTickets == NULL) {
+          policy->setTickets = setTickets;
+          policy->transfer = transfer;
+          policy->value = value;
+          policy->fund = fund;
+        }
+        policy->quantum = quantum > 0 ? quantum : 1;
+        policy->seed = seed;
+      }
+      return policy;
+    }
+  }
+  return NULL;
+}
+
+// Release a policy
+void policyDestroy(SchedPolicy *policy) {
+  if (policy != NULL) {
+    policy->destroy(policy);
+    free(policy);
+  }
+}
+
+// Names for the usage message
+const char *policyNames(void) {
+  return "lottery|srtf|stride|mlfq|cfs";
+}
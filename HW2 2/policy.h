@@ -0,0 +1,94 @@
+///////////////////// SCHEDULING POLICY HEADER FILE README///////////////////////
+
+//This file contains the header (`policy.h`) for the pluggable scheduling
+//policies of the user-level thread scheduler. A policy owns the ready
+//structure and is driven by the hooks below; the scheduler never looks
+//inside it.
+//The random numbers of a policy all go through `draw` if it is set, which is
+//how a run is recorded and replayed (see replay.h).
+
+// HOOKS
+// *`pickNext`: Remove and return the entity that runs next (NULL if none).
+// *`onBlock`: The running entity leaves the CPU to wait for I/O or to exit.
+// *`onWake`: An entity becomes runnable (arrival, I/O completion or the end of
+//  its slice). Returns 1 if it should preempt the running entity, -1 if it
+//  could not be queued (out of memory).
+// *`onTick`: The running entity used `ran` time units. Returns 1 if its slice
+//  is over and it should be put back with `onWake`.
+// *`steal`: Remove a ready entity so that another core can run it. Values
+//  that only make sense on this core (pass, vruntime) are made relative.
+// *`setTickets`: Change the tickets of an entity in any state. A ready
+//  lottery entity is reweighted in place.
+// *`transfer`: Add base tickets lent by a blocked entity (ticket transfer),
+//  negative to take them back.
+// *`value`: Worth of the tickets of an entity in base tickets, what it lends.
+// *`fund`: Create or refund a ticket currency with a number of base tickets.
+//  The entities with `currency` set share its funding in proportion to their
+//  tickets; only the lottery has currencies, the others use face values.
+
+// POLICIES
+// *`lottery`: Proportional share by tickets, drawn from a Fenwick tree, with
+//  currencies, ticket transfers and compensation tickets (Waldspurger).
+// *`srtf`: Preemptive shortest remaining time first on a binary heap.
+// *`stride`: Deterministic proportional share, binary heap ordered by pass.
+// *`mlfq`: Multilevel feedback queue with demotion and periodic boost.
+// *`cfs`: Red-black tree ordered by weighted virtual runtime.
+
+#ifndef POLICY_H
+#define POLICY_H
+
+#include "heap.h"
+#include "rbtree.h"
+
+// Scheduling entity, embedded in every schedulable thread
+typedef struct SchedEntity {
+  int id; // Thread ID
+  int tickets; // Lottery tickets, also the stride and CFS weight
+  int currency; // Currency of the tickets, 0 for the base currency
+  int boost; // Base tickets transferred to the entity
+  int slot; // Lottery slot in the base currency, held while ready
+  int cslot; // Lottery slot in its currency, held while ready
+  int remaining; // Remaining time of the current CPU burst (SRTF key)
+  int slice; // Time used since the last pick
+  long long pass; // Stride pass value
+  long long vruntime; // CFS virtual runtime
+  long long stamp; // Policy clock when the entity last blocked
+  int level; // MLFQ priority level
+  int used; // MLFQ time used at the current level
+  int migrated; // Set by steal until the next onWake
+  unsigned long long seq; // Enqueue order, breaks ties first come first served
+  HeapNode heap; // SRTF and stride ready heap link
+  RbNode rb; // CFS ready tree link
+  struct SchedEntity *next; // MLFQ ready queue link
+} SchedEntity;
+
+typedef struct SchedPolicy SchedPolicy;
+
+// Policy interface
+struct SchedPolicy {
+  const char *name;
+  SchedEntity *(*pickNext)(SchedPolicy *policy);
+  void (*onBlock)(SchedPolicy *policy, SchedEntity *se);
+  int (*onWake)(SchedPolicy *policy, SchedEntity *se); // -1 if out of memory
+  int (*onTick)(SchedPolicy *policy, SchedEntity *se, int ran);
+  SchedEntity *(*steal)(SchedPolicy *policy);
+  void (*setTickets)(SchedPolicy *policy, SchedEntity *se, int tickets);
+  void (*transfer)(SchedPolicy *policy, SchedEntity *se, int delta);
+  int (*value)(SchedPolicy *policy, const SchedEntity *se);
+  int (*fund)(SchedPolicy *policy, int currency, int funding); // -1 if out of memory
+  void (*destroy)(SchedPolicy *policy);
+  SchedEntity *current; // Running entity, not in the ready structure
+  int ready; // Number of entities in the ready structure
+  int quantum; // Base time slice
+  unsigned int seed; // Private random number generator state
+  unsigned long long (*draw)(void *arg, unsigned long long value); // Sees every random number and returns the one to use (record/replay), NULL if off
+  void *draw_arg;
+  unsigned long long seq; // Enqueue counter
+};
+
+// Function prototypes
+SchedPolicy *policyCreate(const char *name, int quantum, unsigned int seed); // NULL if name is unknown
+void policyDestroy(SchedPolicy *policy); // Release the policy
+const char *policyNames(void); // Names accepted by policyCreate
+
+#endif /* POLICY_H */
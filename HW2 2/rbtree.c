@@ -0,0 +1,265 @@
+///////////////////// RED-BLACK TREE SOURCE FILE README///////////////////////
+
+//This file contains the implementation (`rbtree.c`) of the intrusive
+//red-black tree. NULL pointers are used as the black leaves, and the smallest
+//node is cached so that picking the next element is O(1).
+
+//Helped from Cormen et al., Introduction to Algorithms, Chapter 13.
+
+#include "rbtree.h"
+
+// Initialize the tree
+void rbInit(RbTree *tree, int (*less)(const RbNode *, const RbNode *)) {
+  tree->root = NULL;
+  tree->leftmost = NULL;
+  tree->count = 0;
+  tree->less = less;
+}
+
+// Rotate the subtree rooted at x to the left
+static void rotateLeft(RbTree *tree, RbNode *x) {
+  RbNode *y = x->right;
+  x->right = y->left;
+  if (y->left != NULL) {
+    y->left->parent = x;
+  }
+  y->parent = x->parent;
+  if (x->parent == NULL) {
+    tree->root = y;
+  } else if (x == x->parent->left) {
+    x->parent->left = y;
+  } else {
+    x->parent->right = y;
+  }
+  y->left = x;
+  x->parent = y;
+}
+
+// Rotate the subtree rooted at x to the right
+static void rotateRight(RbTree *tree, RbNode *x) {
+  RbNode *y = x->left;
+  x->left = y->right;
+  if (y->right != NULL) {
+    y->right->parent = x;
+  }
+  y->parent = x->parent;
+  if (x->parent == NULL) {
+    tree->root = y;
+  } else if (x == x->parent->right) {
+    x->parent->right = y;
+  } else {
+    x->parent->left = y;
+  }
+  y->right = x;
+  x->parent = y;
+}
+
+// Insert a node
+void rbInsert(RbTree *tree, RbNode *node) {
+  RbNode *parent = NULL;
+  RbNode **link = &tree->root;
+  int leftmost = 1;
+
+  // Standard binary search tree descent
+  while (*link != NULL) {
+    parent = *link;
+    if (tree->less(node, parent)) {
+      link = &parent->left;
+    } else {
+      link = &parent->right;
+      leftmost = 0;
+    }
+  }
+
+  node->parent = parent;
+  node->left = NULL;
+  node->right = NULL;
+  node->red = 1;
+  *link = node;
+
+  if (leftmost) {
+    tree->leftmost = node;
+  }
+  tree->count++;
+
+  // Restore the red-black properties
+  while (node->parent != NULL && node->parent->red) {
+    RbNode *gparent = node->parent->parent;
+    if (node->parent == gparent->left) {
+      RbNode *uncle = gparent->right;
+      if (uncle != NULL && uncle->red) {
+        node->parent->red = 0;
+        uncle->red = 0;
+        gparent->red = 1;
+        node = gparent;
+      } else {
+        if (node == node->parent->right) {
+          node = node->parent;
+          rotateLeft(tree, node);
+        }
+        node->parent->red = 0;
+        gparent->red = 1;
+        rotateRight(tree, gparent);
+      }
+    } else {
+      RbNode *uncle = gparent->left;
+      if (uncle != NULL && uncle->red) {
+        node->parent->red = 0;
+        uncle->red = 0;
+        gparent->red = 1;
+        node = gparent;
+      } else {
+        if (node == node->parent->left) {
+          node = node->parent;
+          rotateRight(tree, node);
+        }
+        node->parent->red = 0;
+        gparent->red = 1;
+        rotateLeft(tree, gparent);
+      }
+    }
+  }
+  tree->root->red = 0;
+}
+
+// In-order successor
+RbNode *rbNext(const RbNode *node) {
+  if (node->right != NULL) {
+    node = node->right;
+    while (node->left != NULL) {
+      node = node->left;
+    }
+    return (RbNode *)node;
+  }
+  while (node->parent != NULL && node == node->parent->right) {
+    node = node->parent;
+  }
+  return node->parent;
+}
+
+// Replace subtree u with subtree v
+static void transplant(RbTree *tree, RbNode *u, RbNode *v) {
+  if (u->parent == NULL) {
+    tree->root = v;
+  } else if (u == u->parent->left) {
+    u->parent->left = v;
+  } else {
+    u->parent->right = v;
+  }
+  if (v != NULL) {
+    v->parent = u->parent;
+  }
+}
+
+// Remove a node
+void rbRemove(RbTree *tree, RbNode *node) {
+  if (tree->leftmost == node) {
+    tree->leftmost = rbNext(node);
+  }
+  tree->count--;
+
+  RbNode *x;        // Node that moves into the removed position
+  RbNode *xparent;  // Parent of x (x may be a NULL leaf)
+  int removed_red = node->red;
+
+  if (node->left == NULL) {
+    x = node->right;
+    xparent = node->parent;
+    transplant(tree, node, node->right);
+  } else if (node->right == NULL) {
+    x = node->left;
+    xparent = node->parent;
+    transplant(tree, node, node->left);
+  } else {
+    // Two children: splice out the successor
+    RbNode *y = node->right;
+    while (y->left != NULL) {
+      y = y->left;
+    }
+    removed_red = y->red;
+    x = y->right;
+    if (y->parent == node) {
+      xparent = y;
+    } else {
+      xparent = y->parent;
+      transplant(tree, y, y->right);
+      y->right = node->right;
+      y->right->parent = y;
+    }
+    transplant(tree, node, y);
+    y->left = node->left;
+    y->left->parent = y;
+    y->red = node->red;
+  }
+
+  if (removed_red) {
+    return;
+  }
+
+  // Restore the red-black properties
+  while (x != tree->root && (x == NULL || !x->red)) {
+    if (x == xparent->left) {
+      RbNode *w = xparent->right;
+      if (w->red) {
+        w->red = 0;
+        xparent->red = 1;
+        rotateLeft(tree, xparent);
+        w = xparent->right;
+      }
+      if ((w->left == NULL || !w->left->red) &&
+          (w->right == NULL || !w->right->red)) {
+        w->red = 1;
+        x = xparent;
+        xparent = x->parent;
+      } else {
+        if (w->right == NULL || !w->right->red) {
+          w->left->red = 0;
+          w->red = 1;
+          rotateRight(tree, w);
+          w = xparent->right;
+        }
+        w->red = xparent->red;
+        xparent->red = 0;
+        w->right->red = 0;
+        rotateLeft(tree, xparent);
+        x = tree->root;
+        break;
+      }
+    } else {
+      RbNode *w = xparent->left;
+      if (w->red) {
+        w->red = 0;
+        xparent->red = 1;
+        rotateRight(tree, xparent);
+        w = xparent->left;
+      }
+      if ((w->left == NULL || !w->left->red) &&
+          (w->right == NULL || !w->right->red)) {
+        w->red = 1;
+        x = xparent;
+        xparent = x->parent;
+      } else {
+        if (w->left == NULL || !w->left->red) {
+          w->right->red = 0;
+          w->red = 1;
+          rotateLeft(tree, w);
+          w = xparent->left;
+        }
+        w->red = xparent->red;
+        xparent->red = 0;
+        w->left->red = 0;
+        rotateRight(tree, xparent);
+        x = tree->root;
+        break;
+      }
+    }
+  }
+  if (x != NULL) {
+    x->red = 0;
+  }
+}
+
+// Smallest node
+RbNode *rbFirst(const RbTree *tree) {
+  return tree->leftmost;
+}
@@ -0,0 +1,44 @@
+///////////////////// RED-BLACK TREE HEADER FILE README///////////////////////
+
+//This file contains the header (`rbtree.h`) for an intrusive red-black tree
+//used by the scheduling policies. The node is embedded in the element that is
+//stored in the tree, so insertion and removal never allocate memory.
+
+// FUNCTIONALITY
+// *`rbInit`: Initialize an empty tree with a comparison function.
+// *`rbInsert`: Insert a node into the tree in O(log n).
+// *`rbRemove`: Remove a node from the tree in O(log n).
+// *`rbFirst`: Return the leftmost (smallest) node in O(1).
+
+#ifndef RBTREE_H
+#define RBTREE_H
+
+#include <stddef.h>
+
+// Get the enclosing structure of an embedded node
+#define rbEntry(ptr, type, member) \
+  ((type *)((char *)(ptr) - offsetof(type, member)))
+
+// Structure
+typedef struct RbNode {
+  struct RbNode *left;
+  struct RbNode *right;
+  struct RbNode *parent;
+  int red;
+} RbNode;
+
+typedef struct {
+  RbNode *root;
+  RbNode *leftmost; // Cached smallest node
+  int count;
+  int (*less)(const RbNode *a, const RbNode *b); // Strict ordering
+} RbTree;
+
+// Function prototypes
+void rbInit(RbTree *tree, int (*less)(const RbNode *, const RbNode *)); // Empty tree
+void rbInsert(RbTree *tree, RbNode *node); // Insert a node
+void rbRemove(RbTree *tree, RbNode *node); // Remove a node
+RbNode *rbFirst(const RbTree *tree); // Smallest node or NULL
+RbNode *rbNext(const RbNode *node); // In-order successor or NULL
+
+#endif /* RBTREE_H */
@@ -0,0 +1,171 @@
+///////////////////// RECORD/REPLAY SOURCE FILE README///////////////////////
+
+//This file contains the implementation (`replay.c`) of the record/replay log.
+//Records are written through a large stdio buffer; the simulation is single
+//threaded, so the log needs no lock. Varints keep a pick of a thread below
+//16384 in at most 4 bytes, which matters for runs of millions of decisions.
+
+#include "replay.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define pREPLAY_BUFFER (64 * 1024)
+#define pFNV_OFFSET 0xcbf29ce484222325ULL
+#define pFNV_PRIME 0x100000001b3ULL
+
+// Write an unsigned LEB128 varint
+static void putVarint(Replay *replay, unsigned long long value) {
+  do {
+    int byte = value & 0x7f;
+    value >>= 7;
+    if (putc(value != 0 ? byte | 0x80 : byte, replay->fp) == EOF) {
+      replay->failed = 1;
+    }
+  } while (value != 0);
+}
+
+// Read an unsigned LEB128 varint, -1 if the log ends inside it
+static int getVarint(Replay *replay, unsigned long long *value) {
+  *value = 0;
+  for (int shift = 0; shift < 64; shift += 7) {
+    int byte = getc(replay->fp);
+    if (byte == EOF) {
+      return -1;
+    }
+    *value |= (unsigned long long)(byte & 0x7f) << shift;
+    if (!(byte & 0x80)) {
+      return 0;
+    }
+  }
+  return -1;
+}
+
+// Create a log for recording
+int replayCreate(Replay *replay, const char *path, const ReplayHeader *header) {
+  memset(replay, 0, sizeof(Replay));
+  replay->fp = fopen(path, "wb");
+  if (replay->fp == NULL) {
+    return -1;
+  }
+  setvbuf(replay->fp, NULL, _IOFBF, pREPLAY_BUFFER);
+  replay->recording = 1;
+  replay->header = *header;
+  memcpy(replay->header.magic, pREPLAY_MAGIC, sizeof(replay->header.magic));
+  replay->header.version = pREPLAY_VERSION;
+  if (fwrite(&replay->header, sizeof(ReplayHeader), 1, replay->fp) != 1) {
+    replayClose(replay);
+    return -1;
+  }
+  return 0;
+}
+
+// Open a log for replaying
+int replayOpen(Replay *replay, const char *path) {
+  memset(replay, 0, sizeof(Replay));
+  replay->fp = fopen(path, "rb");
+  if (replay->fp == NULL) {
+    return -1;
+  }
+  setvbuf(replay->fp, NULL, _IOFBF, pREPLAY_BUFFER);
+  if (fread(&replay->header, sizeof(ReplayHeader), 1, replay->fp) != 1 ||
+      memcmp(replay->header.magic, pREPLAY_MAGIC, sizeof(replay->header.magic)) != 0 ||
+      replay->header.version != pREPLAY_VERSION) {
+    fclose(replay->fp);
+    replay->fp = NULL;
+    return -1;
+  }
+  replay->header.policy[sizeof(replay->header.policy) - 1] = '\0';
+  return 0;
+}
+
+// Read the next record
+int replayNext(Replay *replay, ReplayRecord *record) {
+  unsigned long long value, dt;
+  int tag = getc(replay->fp);
+  if (tag == rDRAW && getVarint(replay, &value) == 0) {
+    record->type = rDRAW;
+    record->value = value;
+    replay->draws++;
+    return 1;
+  }
+  if (tag == rPICK && getVarint(replay, &value) == 0 && getVarint(replay, &dt) == 0) {
+    replay->time += (long long)dt;
+    record->type = rPICK;
+    record->thread = (int)value;
+    record->time = replay->time;
+    replay->picks++;
+    return 1;
+  }
+  if (tag != EOF) {
+    replay->failed = 1; // Truncated or corrupt
+  }
+  record->type = 0;
+  return 0;
+}
+
+// Record a random number, or take the recorded one
+unsigned long long replayDraw(Replay *replay, unsigned long long value) {
+  if (replay->recording) {
+    putc(rDRAW, replay->fp);
+    putVarint(replay, value);
+    replay->draws++;
+    return value;
+  }
+  if (replay->diverged) {
+    return value; // The schedule differs already, draw freely
+  }
+  ReplayRecord record;
+  if (replayNext(replay, &record) && record.type == rDRAW) {
+    return record.value;
+  }
+  replay->diverged = 1;
+  replay->expected = record;
+  replay->actual = -1;
+  return value;
+}
+
+// Record a pick, or check it against the recorded one
+int replayPick(Replay *replay, long long time, int thread) {
+  if (replay->recording) {
+    putc(rPICK, replay->fp);
+    putVarint(replay, (unsigned long long)thread);
+    putVarint(replay, (unsigned long long)(time - replay->time));
+    replay->time = time;
+    replay->picks++;
+    return 0;
+  }
+  if (replay->diverged) {
+    return -1;
+  }
+  ReplayRecord record;
+  if (replayNext(replay, &record) && record.type == rPICK && record.thread == thread &&
+      record.time == time) {
+    return 0;
+  }
+  replay->diverged = 1;
+  replay->expected = record;
+  replay->actual = thread;
+  replay->actual_time = time;
+  return -1;
+}
+
+// Flush and close the log
+int replayClose(Replay *replay) {
+  if (replay->fp != NULL && fclose(replay->fp) != 0) {
+    replay->failed = 1;
+  }
+  replay->fp = NULL;
+  return replay->failed ? -1 : 0;
+}
+
+// FNV-1a hash of a block
+uint64_t replayChecksum(uint64_t hash, const void *data, size_t size) {
+  const unsigned char *p = data;
+  if (hash == 0) {
+    hash = pFNV_OFFSET;
+  }
+  for (size_t i = 0; i < size; i++) {
+    hash = (hash ^ p[i]) * pFNV_PRIME;
+  }
+  return hash;
+}
@@ -0,0 +1,78 @@
+///////////////////// RECORD/REPLAY HEADER FILE README///////////////////////
+
+//This file contains the header (`replay.h`) for the record/replay log of a
+//simulation run. The log holds the seed, the policy and a checksum of the
+//workload, then every random number drawn by the policy and every thread it
+//picked, in order. Replaying the log feeds the recorded random numbers back
+//to the policy instead of its generator and checks every pick against the
+//recorded one, so the exact schedule is re-executed and the first decision
+//that differs (a regression of the scheduler) is reported. `replaydiff.c`
+//compares two logs the same way.
+
+// FILE FORMAT
+// *Header: `ReplayHeader`, the magic "HW2REPLY", in native byte order.
+// *Records: a tag byte followed by LEB128 varints, most are 2 to 4 bytes.
+//  `rDRAW value`: A random number drawn by the policy.
+//  `rPICK thread dt`: The policy picked a thread, dt time units after the
+//  previous pick.
+
+// FUNCTIONALITY
+// *`replayCreate`: Create a log for recording.
+// *`replayOpen`: Open a log for replaying or comparing.
+// *`replayDraw`: Record a random number, or return the recorded one.
+// *`replayPick`: Record a pick, or check it against the recorded one.
+// *`replayNext`: Read the next record.
+// *`replayClose`: Flush and close the log.
+
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#define rDRAW 1 // Record tags
+#define rPICK 2
+#define pREPLAY_MAGIC "HW2REPLY"
+#define pREPLAY_VERSION 1
+
+// Structure
+typedef struct {
+  char magic[8];
+  uint32_t version;
+  uint32_t seed; // Seed of the policy
+  char policy[16]; // Name of the policy
+  int32_t quantum;
+  uint32_t nthreads;
+  uint64_t checksum; // FNV-1a of the workload
+} ReplayHeader;
+
+typedef struct {
+  int type; // rDRAW or rPICK
+  unsigned long long value; // Random number
+  int thread; // Picked thread
+  long long time; // Time of the pick
+} ReplayRecord;
+
+typedef struct {
+  FILE *fp;
+  int recording; // 1 while recording, 0 while replaying
+  ReplayHeader header;
+  long long time; // Time of the last pick
+  long long picks, draws; // Records so far
+  int diverged; // Replaying: a pick or a draw did not match
+  ReplayRecord expected; // Replaying: the record that did not match
+  long long actual; // Replaying: the thread picked instead, -1 for a draw
+  long long actual_time; // Replaying: time of that pick
+  int failed; // A read or write failed
+} Replay;
+
+// Function prototypes
+int replayCreate(Replay *replay, const char *path, const ReplayHeader *header); // -1 on error
+int replayOpen(Replay *replay, const char *path); // -1 if it is not a log
+unsigned long long replayDraw(Replay *replay, unsigned long long value); // Value to use
+int replayPick(Replay *replay, long long time, int thread); // 0 if it matches, -1 on the first divergence
+int replayNext(Replay *replay, ReplayRecord *record); // 1 if read, 0 at the end
+int replayClose(Replay *replay); // -1 if a write failed
+uint64_t replayChecksum(uint64_t hash, const void *data, size_t size); // FNV-1a, start with 0
+
+#endif /* REPLAY_H */
@@ -0,0 +1,124 @@
+/////////////////////// REPLAY DIFF SOURCE FILE README/////////////////////////
+
+//This file contains a tool (`replaydiff.c`) that compares two record/replay
+//logs of the scheduler (see replay.h) and prints the first record where they
+//differ, with the picks just before it. The exit status is 0 if the runs are
+//identical and 1 otherwise, so it can drive `git bisect run` on a log
+//recorded before a regression:
+//  ./scheduler -q -d 0 -s 7 -r new.log && ./replaydiff good.log new.log
+
+// Build: gcc -O2 -o replaydiff replaydiff.c replay.c
+
+// Command-line Options
+// * `-c`: Picks of context shown before the divergence (default 5)
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "replay.h"
+
+#define DEFAULT_CONTEXT 5
+
+// Open a log or exit
+void openLog(Replay *replay, const char *path) {
+  if (replayOpen(replay, path) != 0) {
+    fprintf(stderr, "%s: not a replay log\n", path);
+    exit(2);
+  }
+  printf("%s: %s, seed %u, quantum %d, %u threads, input %016llx\n", path, replay->header.policy,
+         replay->header.seed, replay->header.quantum, replay->header.nthreads,
+         (unsigned long long)replay->header.checksum);
+}
+
+// Print a record, or the end of the log
+void printRecord(const char *path, const ReplayRecord *record, int more) {
+  if (!more) {
+    printf("  %s: end of the log\n", path);
+  } else if (record->type == rDRAW) {
+    printf("  %s: draw %llu\n", path, record->value);
+  } else {
+    printf("  %s: T%d at %lld\n", path, record->thread, record->time);
+  }
+}
+
+int main(int argc, char *argv[]) {
+  int context = DEFAULT_CONTEXT;
+
+  // Parse command line arguments
+  int opt;
+  while ((opt = getopt(argc, argv, "c:")) != -1) {
+    switch (opt) {
+      case 'c':
+        context = atoi(optarg);
+        break;
+      default:
+        fprintf(stderr, "Usage: %s [-c context] a.log b.log\n", argv[0]);
+        exit(2);
+    }
+  }
+  if (argc - optind != 2 || context < 0) {
+    fprintf(stderr, "Usage: %s [-c context] a.log b.log\n", argv[0]);
+    exit(2);
+  }
+
+  Replay a, b;
+  openLog(&a, argv[optind]);
+  openLog(&b, argv[optind + 1]);
+  if (strcmp(a.header.policy, b.header.policy) != 0 || a.header.seed != b.header.seed ||
+      a.header.checksum != b.header.checksum) {
+    printf("Warning: the runs have another policy, seed or input\n");
+  }
+
+  // The last picks both runs agree on, in a ring
+  ReplayRecord *recent = malloc((context > 0 ? context : 1) * sizeof(ReplayRecord));
+  if (recent == NULL) {
+    perror("malloc");
+    exit(2);
+  }
+  long long picks = 0, draws = 0; // Records both runs agree on
+
+  ReplayRecord x, y;
+  for (;;) {
+    int more_a = replayNext(&a, &x);
+    int more_b = replayNext(&b, &y);
+    if (!more_a && !more_b) {
+      break;
+    }
+    int same = more_a && more_b && x.type == y.type &&
+               (x.type == rDRAW ? x.value == y.value : x.thread == y.thread && x.time == y.time);
+    if (same && x.type == rDRAW) {
+      draws++;
+      continue;
+    }
+    if (same) {
+      if (context > 0) {
+        recent[picks % context] = x;
+      }
+      picks++;
+      continue;
+    }
+
+    // First divergence
+    printf("First divergence after %lld picks and %lld draws:\n", picks, draws);
+    for (long long i = picks > context ? picks - context : 0; i < picks; i++) {
+      printf("  both: T%d at %lld\n", recent[i % context].thread, recent[i % context].time);
+    }
+    printRecord(argv[optind], &x, more_a);
+    printRecord(argv[optind + 1], &y, more_b);
+    free(recent);
+    replayClose(&a);
+    replayClose(&b);
+    return 1;
+  }
+
+  printf("Identical: %lld picks, %lld draws\n", picks, draws);
+  int failed = a.failed || b.failed;
+  if (failed) {
+    fprintf(stderr, "A log is truncated\n");
+  }
+  free(recent);
+  replayClose(&a);
+  replayClose(&b);
+  return failed ? 2 : 0;
+}
@@ -0,0 +1,286 @@
+/////////////////////// SCHEDULER SCALING BENCHMARK SOURCE FILE README/////////////////////////
+
+//This file contains a scaling benchmark (`schedbench.c`) of the scheduling
+//policies of `policy.h`. For every policy and for 10, 100, ... threads up to
+//the maximum, a synthetic workload is generated with `workloadGenerate` and
+//played by an event-driven simulation: arrivals and I/O completions wake
+//threads, the running thread is ticked one time unit at a time as in the
+//scheduler, and a thread that is woken can preempt it. The simulation
+//itself is O(log n) per event, so the rate of scheduling decisions shows
+//where the ready structure of a policy stops scaling. Every size runs in a
+//child process whose resident memory growth, divided by the number of
+//threads, is reported as the memory per thread (workload included).
+
+// Build: gcc -O2 -o schedbench schedbench.c policy.c heap.c rbtree.c fenwick.c workload.c -lm
+
+// Command-line Options
+// * `-p`: Policy to measure (default all)
+// * `-n`: Largest number of threads (default 1000000)
+// * `-b`: CPU bursts of every thread (default 2)
+// * `-c`: CPU burst distribution (default exp:10)
+// * `-i`: I/O burst distribution (default exp:5)
+// * `-a`: Inter-arrival time distribution (default exp:5)
+// * `-q`: Quantum in time units (default 3)
+// * `-s`: Seed (default 1)
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#include "policy.h"
+#include "workload.h"
+
+#define DEFAULT_MAX_THREADS 1000000
+#define DEFAULT_QUANTUM 3
+
+// Structure
+typedef struct {
+  SchedEntity se;
+  HeapNode timer; // I/O completion heap link
+  long long wake; // End of the current I/O burst
+  int phase; // Current burst
+  int remaining; // Remaining time of the current burst
+} BenchThread;
+
+Workload workload;
+BenchThread *threads;
+Heap timers; // Threads in I/O, by completion time
+SchedPolicy *policy;
+long long now; // Simulation time
+long long decisions, ticks;
+
+// Earlier I/O completion first, then lower ID
+int timerLess(const HeapNode *a, const HeapNode *b) {
+  const BenchThread *x = heapEntry(a, BenchThread, timer);
+  const BenchThread *y = heapEntry(b, BenchThread, timer);
+  return x->wake != y->wake ? x->wake < y->wake : x->se.id < y->se.id;
+}
+
+// Seconds of a monotonic clock
+double seconds() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Resident memory of the process in bytes
+long long residentBytes() {
+  long long size = 0, resident = 0;
+  FILE *fp = fopen("/proc/self/statm", "r");
+  if (fp != NULL) {
+    if (fscanf(fp, "%lld %lld", &size, &resident) != 2) {
+      resident = 0;
+    }
+    fclose(fp);
+  }
+  return resident * sysconf(_SC_PAGESIZE);
+}
+
+// Hand a ready thread to the policy, returns 1 if it should preempt the running one
+int queueThread(SchedEntity *se) {
+  int preempt = policy->onWake(policy, se);
+  if (preempt < 0) {
+    perror("onWake: Could not queue the thread");
+    exit(EXIT_FAILURE);
+  }
+  return preempt;
+}
+
+// Move a thread to its next burst, returns 1 if it preempts the running one
+int nextPhase(int id) {
+  BenchThread *t = &threads[id];
+  t->phase++;
+  if (t->phase >= workload.threads[id].nbursts) {
+    return 0; // Finished
+  }
+  t->remaining = workloadBursts(&workload, id)[t->phase];
+  if (t->phase % 2 == 1) {
+    t->wake = now + t->remaining;
+    heapPush(&timers, &t->timer);
+    return 0;
+  }
+  t->se.remaining = t->remaining;
+  return queueThread(&t->se);
+}
+
+// Wake the threads whose arrival or I/O completion is due
+int wakeDue(int *next_arrival) {
+  int preempt = 0;
+  while (*next_arrival < workload.nthreads && workload.threads[*next_arrival].arrival <= now) {
+    threads[*next_arrival].phase = -1;
+    preempt |= nextPhase((*next_arrival)++);
+  }
+  HeapNode *node;
+  while ((node = heapPeek(&timers)) != NULL && heapEntry(node, BenchThread, timer)->wake <= now) {
+    heapPop(&timers);
+    preempt |= nextPhase(heapEntry(node, BenchThread, timer)->se.id);
+  }
+  return preempt;
+}
+
+// Play the workload to the end
+void simulate() {
+  int next_arrival = 0;
+  int finished = 0;
+  now = 0;
+  while (finished < workload.nthreads) {
+    wakeDue(&next_arrival);
+    SchedEntity *se = policy->pickNext(policy);
+    decisions++;
+
+    // Idle, skip to the next event
+    if (se == NULL) {
+      long long next = -1;
+      if (next_arrival < workload.nthreads) {
+        next = workload.threads[next_arrival].arrival;
+      }
+      HeapNode *node = heapPeek(&timers);
+      if (node != NULL && (next < 0 || heapEntry(node, BenchThread, timer)->wake < next)) {
+        next = heapEntry(node, BenchThread, timer)->wake;
+      }
+      now = next > now ? next : now + 1;
+      continue;
+    }
+
+    // Run until the burst ends, the slice expires or a woken thread preempts
+    BenchThread *t = (BenchThread *)se;
+    int expired = 0;
+    int preempted = 0;
+    while (t->remaining > 0 && !expired && !preempted) {
+      t->remaining--;
+      se->remaining = t->remaining;
+      now++;
+      ticks++;
+      preempted = wakeDue(&next_arrival);
+      expired = policy->onTick(policy, se, 1);
+    }
+
+    if (t->remaining == 0) {
+      policy->onBlock(policy, se);
+      nextPhase(se->id);
+      if (t->phase >= workload.threads[se->id].nbursts) {
+        finished++;
+      }
+    } else {
+      queueThread(se);
+    }
+  }
+}
+
+// Measure one policy with one number of threads, in a child process
+void runOne(const char *name, WorkloadSpec *spec, int quantum, unsigned int seed) {
+  fflush(stdout);
+  pid_t pid = fork();
+  if (pid < 0) {
+    perror("fork");
+    exit(EXIT_FAILURE);
+  }
+  if (pid > 0) {
+    int status;
+    waitpid(pid, &status, 0);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+      printf("%-8s\t%d\tfailed\n", name, spec->nthreads);
+    }
+    return;
+  }
+
+  long long before = residentBytes();
+  policy = policyCreate(name, quantum, seed);
+  threads = calloc(spec->nthreads, sizeof(BenchThread));
+  if (policy == NULL || threads == NULL || workloadGenerate(&workload, spec) != 0) {
+    _exit(EXIT_FAILURE);
+  }
+  heapInit(&timers, 16, timerLess);
+  for (int i = 0; i < spec->nthreads; i++) {
+    threads[i].se.id = i;
+    threads[i].se.tickets = spec->tickets > 0 ? spec->tickets : (int)workloadTotal(&workload, i);
+  }
+
+  double start = seconds();
+  simulate();
+  double elapsed = seconds() - start;
+  long long bytes = residentBytes() - before;
+
+  printf("%-8s\t%d\t%lld\t%.2f\t\t%.1f\t\t%lld\n", name, spec->nthreads, decisions,
+         decisions / (elapsed > 0 ? elapsed : 1e-9) / 1e6, elapsed * 1e9 / (decisions > 0 ? decisions : 1),
+         bytes / spec->nthreads);
+  fflush(stdout);
+  _exit(0);
+}
+
+// Parse a distribution option or exit
+void parseDist(const char *text, WorkloadDist *dist) {
+  if (workloadParseDist(text, dist) != 0) {
+    fprintf(stderr, "Bad distribution: %s\n", text);
+    exit(EXIT_FAILURE);
+  }
+}
+
+int main(int argc, char *argv[]) {
+  WorkloadSpec spec = {0, 2, {dEXP, 10, 0, 0}, {dEXP, 5, 0, 0}, {dEXP, 5, 0, 0}, 0, 1};
+  int max_threads = DEFAULT_MAX_THREADS;
+  int quantum = DEFAULT_QUANTUM;
+  char *only = NULL;
+
+  // Parse command line arguments
+  int opt;
+  while ((opt = getopt(argc, argv, "p:n:b:c:i:a:q:s:")) != -1) {
+    switch (opt) {
+      case 'p':
+        only = optarg;
+        break;
+      case 'n':
+        max_threads = atoi(optarg);
+        break;
+      case 'b':
+        spec.ncpu = atoi(optarg);
+        break;
+      case 'c':
+        parseDist(optarg, &spec.cpu);
+        break;
+      case 'i':
+        parseDist(optarg, &spec.io);
+        break;
+      case 'a':
+        parseDist(optarg, &spec.arrival);
+        break;
+      case 'q':
+        quantum = atoi(optarg);
+        break;
+      case 's':
+        spec.seed = strtoull(optarg, NULL, 10);
+        break;
+      default:
+        fprintf(stderr, "Usage: %s [-p %s] [-n max threads] [-b CPU bursts] [-c dist] [-i dist] [-a dist] [-q quantum] [-s seed]\n",
+                argv[0], policyNames());
+        exit(EXIT_FAILURE);
+    }
+  }
+  if (max_threads < 10 || spec.ncpu < 1 || quantum < 1) {
+    fprintf(stderr, "At least 10 threads, one CPU burst and a quantum of 1 are needed\n");
+    exit(EXIT_FAILURE);
+  }
+
+  // The policies to measure, one name after the other
+  char names[64];
+  snprintf(names, sizeof(names), "%s", only != NULL ? only : policyNames());
+  SchedPolicy *check = policyCreate(strtok(names, "|"), quantum, 1);
+  if (check == NULL) {
+    fprintf(stderr, "Unknown policy: %s (expected %s)\n", only, policyNames());
+    exit(EXIT_FAILURE);
+  }
+  policyDestroy(check);
+  snprintf(names, sizeof(names), "%s", only != NULL ? only : policyNames());
+
+  printf("Entity: %zu bytes\n", sizeof(BenchThread));
+  printf("Policy  \tThreads\tDecisions\tM decisions/s\tns/decision\tBytes/thread\n");
+  for (char *name = strtok(names, "|"); name != NULL; name = strtok(NULL, "|")) {
+    for (long long n = 10; n <= max_threads; n *= 10) {
+      spec.nthreads = (int)n;
+      runOne(name, &spec, quantum, (unsigned int)spec.seed);
+    }
+  }
+  return 0;
+}
@@ -1,85 +1,173 @@
 // %%%%%%%%%%%%%%%%%%%%%% EE442 PA2 %%%%%%%%%%%%%%%%%%%%%%//
 
-// Please note that the input is taken from the file input.txt
+// Please note that the input is taken from the file input.txt unless -i is given
 // The input file format is given in the InputFormat.txt
 
+// Build: gcc -o scheduler scheduler.c policy.c heap.c rbtree.c fenwick.c aio.c core.c switch.c stack.c workload.c trace.c metrics.c replay.c wheel.c -lpthread -lm
+
+// Command-line Options
+// * `-p`: Scheduling policy, one of lottery, srtf, stride, mlfq, cfs (default lottery)
+// * `-s`: Seed of the lottery draws (default time(NULL))
+// * `-d`: Delay of one time unit in milliseconds (default 1000)
+// * `-c`: Run the threads for real on this many cores (M:N mode, default off)
+// * `-u`: Length of one time unit in microseconds in the M:N mode (default 1000)
+// * `-x`: Context switch of the simulation steps and the M:N mode, fast or ucontext (default fast)
+// * `-k`: Stack size of every thread in KB (default 64)
+// * `-i`: Input file, - for the standard input (default input.txt)
+// * `-q`: Quiet, do not print every step
+// * `-t`: Write a binary event trace to this file, see trace.h and tracejson.c
+// * `-j`: Write the metrics as JSON to this file, - for the standard output
+// * `-b`: Batch mode, run the simulation this many times with the seeds seed, seed+1, ...
+// * `-w`: Parallel runs of the batch mode (default number of processors)
+// * `-a`: M:N mode, an IO burst of n units reads n blocks of 4 KB of this file
+// * `-e`: M:N mode, do the reads of -a with epoll instead of io_uring
+// * `-r`: Record the seed, the random draws and the picks to this file
+// * `-R`: Replay a recorded file (its policy and seed) and report the first
+//  pick that differs, see replay.h and replaydiff.c
+
 // In the code, there are multiple usage of IA code generators 
 // accompanying with different open source repositories. The used
 // repositories are given in the reference at the end.
 
+#include <fcntl.h>
 #include <signal.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <sys/time.h>
+#include <sys/wait.h>
 #include <time.h>
 #include <ucontext.h>
 #include <unistd.h>
+#include "core.h"
+#include "metrics.h"
+#include "policy.h"
+#include "stack.h"
+#include "replay.h"
+#include "trace.h"
+#include "wheel.h"
+#include "workload.h"
 
 #define pREARDY 1
 #define pFINISHED 4
 #define pRUNNING 2
 #define pIO 3
 #define pEMPTY 0
-#define pMAX_NUM_THREAD 7
 #define pMAX_NUM_TICKET 500
-#define pSTACK_SIZE 4096
+#define pSTACK_SIZE (64 * 1024)
 #define pBREAK_TIME 3
+#define pDEFAULT_POLICY "lottery"
+#define pDEFAULT_INPUT "input.txt"
+#define pDEFAULT_DELAY 1000
+#define pDEFAULT_UNIT 1000
+#define pIO_BLOCK 4096 // Bytes read per IO time unit with -a
 
 struct ThreadInfo {
-  ucontext_t context; // Context of thread
-  int BurstOfCpu[2]; // 2 CPU burst times
+  Context context; // Context of thread
+  void *stack; // Stack of the thread, NULL until it hosts a step
+  int *bursts; // Bursts of the workload: CPU, IO, CPU, IO, ...
+  int nbursts;
+  int remaining; // Remaining time of the current burst
   int state; // State of Thread
-  int BurstOfIo[2];  // 2 I/O burst times
   int NumberOfTickets; //Total Number of Tickets
+  int fixed_tickets; // Tickets given in the input, 0 if derived from the bursts
   int AllBurst; // Total Burst Time of the Thread
   int arrival_time;
+  int phase; // Current burst, even phases are CPU and odd phases are IO
+  int next; // Link of the finished list
+  TimerNode io_timer; // End of the current IO burst
+  long long io_seq; // Order in which the thread started doing IO
+  SchedEntity se; // Scheduling policy bookkeeping
 };
 
-struct ThreadInfo threads[pMAX_NUM_THREAD];
-ucontext_t main_uc; // Context
-
-
-// Arrays to hold burst times for all threads
-int BurstOfCpu[pMAX_NUM_THREAD][2];
-int BurstOfIo[pMAX_NUM_THREAD][2];
+struct ThreadInfo *threads;
+int num_threads;
+Workload workload; // Parsed input
+int legacy_input; // Every thread is a CPU1 CPU2 IO1 IO2 line
+Context main_ctx; // Context
+int step_thread; // Thread whose stack runs the current step
+int sim_fast_switch; // The steps use the fast switch of switch.h instead of ucontext
+StackPool stack_pool; // Guard-paged stacks of the threads
+
+// Selected scheduling policy
+SchedPolicy *policy;
+int tick_delay = pDEFAULT_DELAY;
+int quiet; // Do not print every step
+
+// Simulation clock and arrivals
+int sim_time;
+int *arrival_order; // Thread IDs sorted by arrival time
+int next_arrival; // Next entry of arrival_order to admit
+Wheel io_timers; // End of the IO bursts, one timer per thread in IO
+long long io_seq; // IO burst counter
+int finished_head = -1; // Finished threads whose stacks are not recycled yet
+int host_thread; // Lowest thread that is not finished
+
+// Results of the M:N mode
+int unit_usec = pDEFAULT_UNIT;
+long long start_ns;
+int io_file = -1; // Read during the IO bursts if open
+long long io_blocks; // Blocks of io_file
+
+// Wait, response and turnaround accounting of both modes
+Metrics metrics;
+
+// Record/replay of the simulation
+Replay replay;
+Replay *replay_log; // &replay while recording or replaying, NULL if off
+uint64_t schedule_hash; // FNV-1a of the picks, tells the schedules of a batch apart
 
-// Arrays to hold tickets
-int lottery_tickets[pMAX_NUM_TICKET];
-int TicketIndex;
 int TotalBurst;
 int TotoalNumberOfTickets;
+long long *currency_tickets; // Initial tickets of every currency
 int all_finished;
 
 void exitThread(int id);
 
+// Record an event of the simulation in the trace and the metrics, the time
+// is the simulation clock
+void simEvent(int type, int id) {
+  if (type == trSWITCH) {
+    int pick[2] = {sim_time, id};
+    schedule_hash = replayChecksum(schedule_hash, pick, sizeof(pick));
+  }
+  traceEvent(0, type, sim_time, id, 0);
+  metricsEvent(&metrics, type, sim_time, id);
+}
+
 // Print status of threads
 void printStatus(int TypeOfPrint) {
   if (TypeOfPrint == 0) {
-    printf("TID\tBursts\tState\tTickets\tCPU1\tIO1\tCPU2\tIO2\n"); // Adjust headers
-    for (int i = 0; i < pMAX_NUM_THREAD; i++) {
+    int max_bursts = 0;
+    for (int i = 0; i < num_threads; i++) {
+      if (threads[i].nbursts > max_bursts) {
+        max_bursts = threads[i].nbursts;
+      }
+    }
+    printf("TID\tBursts\tState\tTickets"); // Adjust headers
+    for (int j = 0; j < max_bursts; j++) {
+      printf("\t%s%d", j % 2 == 0 ? "CPU" : "IO", j / 2 + 1);
+    }
+    printf("\n");
+    for (int i = 0; i < num_threads; i++) {
       printf("T%d\t", i);
       printf("%d\t", threads[i].AllBurst);
       printf("%d\t", threads[i].state);
       printf("%d/%d\t", threads[i].NumberOfTickets, TotoalNumberOfTickets);
-      for (int j = 0; j < 2; j++) { 
-        printf("%d\t", threads[i].BurstOfCpu[j]); // CPU Burst Times
-        printf("%d\t", threads[i].BurstOfIo[j]); // IO Burst Times
+      for (int j = 0; j < threads[i].nbursts; j++) {
+        printf("%d\t", threads[i].bursts[j]); // CPU and IO Burst Times
       }
 
       printf("\n");
     }
     printf("\n");
   } else if (TypeOfPrint == 1) {
-    int states[pMAX_NUM_THREAD] = {0, 0, 0, 0, 0, 0, 0};
-
-    // Fill states array with current thread states
-    for (int i = 0; i < pMAX_NUM_THREAD; i++) {
-      states[i] = threads[i].state;
-    }
-
     printf("running>");
-    for (int i = 0; i < pMAX_NUM_THREAD; i++) {
-        switch(states[i]) {
+    for (int i = 0; i < num_threads; i++) {
+        switch(threads[i].state) {
             case pRUNNING:
                 printf("T%d", i);
                 break;
@@ -91,8 +179,8 @@ void printStatus(int TypeOfPrint) {
     int ready = 0;
     int FirstPrintedCase = 0;
     printf("\tready>");
-    for (int i = 0; i < pMAX_NUM_THREAD; i++) {
-      if (states[i] == pREARDY) {
+    for (int i = 0; i < num_threads; i++) {
+      if (threads[i].state == pREARDY) {
         ready++;
         if (FirstPrintedCase) {
           printf(",");
@@ -102,15 +190,15 @@ void printStatus(int TypeOfPrint) {
       }
     }
 
-    for (int i = 0; i < pMAX_NUM_THREAD - ready; i++) {
+    for (int i = 0; i < num_threads - ready; i++) {
       printf("   ");
     }
 
     int finished = 0;
     FirstPrintedCase = 0;
     printf("\tfinished>");
-    for (int i = 0; i < pMAX_NUM_THREAD; i++) {
-      if (states[i] == pFINISHED) {
+    for (int i = 0; i < num_threads; i++) {
+      if (threads[i].state == pFINISHED) {
         finished++;
         if (FirstPrintedCase) {
           printf(",");
@@ -120,478 +208,999 @@ void printStatus(int TypeOfPrint) {
       }
     }
 
-    for (int i = 0; i < pMAX_NUM_THREAD - finished; i++) {
+    for (int i = 0; i < num_threads - finished; i++) {
       printf("   ");
     }
 
     printf("\t\tIO>");
-    for (int i = 0; i < pMAX_NUM_THREAD; i++) {
-      if (states[i] == pIO) {
+    for (int i = 0; i < num_threads; i++) {
+      if (threads[i].state == pIO) {
         printf("T%d ", i);
       }
     }
     printf("\n");
   } else if (TypeOfPrint == 2) {
-    printf("T0\tT1\tT2\tT3\tT4\tT5\tT6\n"); // Thread ID Header
+    // Thread ID Header
+    for (int i = 0; i < num_threads; i++) {
+      printf(i == 0 ? "T%d" : "\tT%d", i);
+    }
+    printf("\n");
   }
 }
 
-// Check IO bursts
-void checkIO(int wait) {
-  if (wait > pBREAK_TIME) {
-    wait = pBREAK_TIME;
+// Hand a ready thread to the policy, returns 1 if it should preempt the running one
+int queueThread(SchedEntity *se) {
+  int preempt = policy->onWake(policy, se);
+  if (preempt < 0) {
+    perror("onWake: Could not queue the thread");
+    exit(EXIT_FAILURE);
+  }
+  return preempt;
+}
+
+// Move a thread to its next non-empty burst
+// Returns 1 if the thread became ready and should preempt the running one
+// A thread that moves to IO is not put on the IO list, the caller does it
+int nextPhase(int id) {
+  struct ThreadInfo *t = &threads[id];
+  do {
+    t->phase++;
+  } while (t->phase < t->nbursts && t->bursts[t->phase] == 0);
+
+  // All bursts are completed
+  if (t->phase >= t->nbursts) {
+    simEvent(trEXIT, id);
+    exitThread(id);
+    return 0;
   }
+  t->remaining = t->bursts[t->phase];
 
-  // Check IO
-  for (int i = 0; i < pMAX_NUM_THREAD; i++) {
-    int temp_state = threads[i].state;
+  // Input/output burst
+  if (t->phase % 2 == 1) {
+    simEvent(trBLOCK, id);
+    t->state = pIO;
+    return 0;
+  }
 
-    // If thread is finished
-    if (temp_state != pIO) {
-      continue;
+  // CPU burst, hand the thread to the policy
+  simEvent(trWAKE, id);
+  t->state = pREARDY;
+  t->se.remaining = t->remaining;
+  t->se.tickets = t->NumberOfTickets;
+  return queueThread(&t->se);
+}
+
+// Arm the IO timer of a thread that moved to IO, starting at time now
+void armIO(int id, int now) {
+  wheelAdd(&io_timers, &threads[id].io_timer, (unsigned long long)now + threads[id].remaining);
+}
+
+// Start the IO burst of a thread that moved to IO
+void startIO(int id) {
+  if (threads[id].state == pIO) {
+    threads[id].io_seq = io_seq++;
+    armIO(id, sim_time);
+  }
+}
+
+// Latest IO first, the order the IO list used to be scanned in
+int compareIO(const void *a, const void *b) {
+  long long x = threads[*(const int *)a].io_seq;
+  long long y = threads[*(const int *)b].io_seq;
+  return x < y ? 1 : x > y ? -1 : 0;
+}
+
+// Check IO bursts
+// Completes the input/output bursts that end within `wait` units, returns 1
+// if a thread that completed its input/output should preempt the running
+// one. Only the expired timers are visited; the time a thread spent in IO is
+// accounted once, when its burst ends.
+int checkIO(int wait) {
+  static int *due;
+  static int capacity;
+  int preempt = 0;
+  int count = 0;
+
+  int end = sim_time + wait;
+  for (TimerNode *timer = wheelAdvance(&io_timers, end); timer != NULL; timer = timer->next) {
+    if (count == capacity) {
+      capacity = capacity > 0 ? capacity * 2 : 64;
+      due = realloc(due, capacity * sizeof(int));
+      if (due == NULL) {
+        perror("Could not allocate the IO timers");
+        exit(EXIT_FAILURE);
+      }
+    }
+    due[count++] = wheelEntry(timer, struct ThreadInfo, io_timer) - threads;
+  }
+  qsort(due, count, sizeof(int), compareIO);
+
+  for (int k = 0; k < count; k++) {
+    int i = due[k];
+    int elapsed = threads[i].remaining;
+    threads[i].remaining = 0;
+    threads[i].AllBurst += elapsed;
+    if (!threads[i].fixed_tickets) {
+      threads[i].NumberOfTickets -= elapsed;
     }
 
-    // Temp variables
-    int TempAllBurst = threads[i].AllBurst;
-    int TempCpu1 = BurstOfCpu[i][0];
-    int TempCpu2 = BurstOfCpu[i][1];
-
-    int TempIo1 = BurstOfIo[i][0];
-    int TempIo2 = BurstOfIo[i][1];
-
-    int CurrentIo1 = threads[i].BurstOfIo[0];
-    int CurrentIo2 = threads[i].BurstOfIo[1];
-
-    int FirstTemp = TempCpu1 + TempIo1;
-    int SecondTemp = TempCpu2 + TempIo2;
-
-    int WaitTemp = 0;
-    int CheckTemp = 0;
-    int TempFrom = 0;
-
-    // First IO state 
-    if (TempAllBurst < FirstTemp) {
-        int remainingIo = threads[i].BurstOfIo[0];
-        if (remainingIo > wait) {
-            threads[i].BurstOfIo[0] -= wait;
-            WaitTemp = wait;
-            CheckTemp = 1;
-        } 
-        else {
-            threads[i].BurstOfIo[0] -= CurrentIo1;
-            WaitTemp = CurrentIo1;
-            CheckTemp = 2;
-        }
-        TempFrom = 1;
-    }
-
-    // Second IO state
-    else if (TempAllBurst < FirstTemp + SecondTemp) {
-        int remainingIo = threads[i].BurstOfIo[1];
-        if (remainingIo > wait) {
-            threads[i].BurstOfIo[1] -= wait;
-            WaitTemp = wait;
-            CheckTemp = 1;
-        } 
-        else {
-            threads[i].BurstOfIo[1] -= CurrentIo2;
-            WaitTemp = CurrentIo2;
-            CheckTemp = 2;
-        }
-        TempFrom = 2;
-    }
-
-    if (CheckTemp != 0) {
-        threads[i].AllBurst += WaitTemp;
-        threads[i].NumberOfTickets -= WaitTemp;
-
-        // If additional rest is required
-        if (CheckTemp == 1) {
-            threads[i].state = pIO;
-            break;
-        } 
-        /// The input/output operation is finished.
-        else if (CheckTemp == 2) {
-            // Final input/output burst
-            if (TempFrom == 2) {
-                /// Exit the thread since all input/output bursts have been completed.
-                exitThread(i);
-                return;
-            }
-
-            threads[i].state = pREARDY;
-            if (wait == 0) {
-                break;
-            }
-            wait -= WaitTemp;
-        }
+    /// The input/output operation is finished.
+    preempt |= nextPhase(i);
+
+    // A thread that skipped an empty CPU burst keeps its place in the order
+    if (threads[i].state == pIO) {
+      armIO(i, end);
     }
   }
+  return preempt;
 }
 
 // Determine number of tickets initially for lottery scheduling
 void determineRemainingBursts() {
   TotalBurst = 0;
-  for (int i = 0; i < pMAX_NUM_THREAD; i++) {
-    TotalBurst += threads[i].BurstOfCpu[0] + threads[i].BurstOfCpu[1] +
-                    threads[i].BurstOfIo[0] + threads[i].BurstOfIo[1]; // Total burst times
-  }
-
-  printf("Total Tickets: %d\n", TotalBurst);
-  printf("\n");
+  TotoalNumberOfTickets = 0;
 
-  for (int i = 0; i < pMAX_NUM_TICKET; i++) {
-    lottery_tickets[i] = -1;
+  // Determine number of tickets for each thread, the total burst time
+  // unless the input gives a fixed number of tickets
+  for (int i = 0; i < num_threads; i++) {
+    int burst = (int)workloadTotal(&workload, i); //Total burst times
+    TotalBurst += burst;
+    threads[i].NumberOfTickets = threads[i].fixed_tickets ? threads[i].fixed_tickets : burst;
+    TotoalNumberOfTickets += threads[i].NumberOfTickets;
   }
 
-  TicketIndex = 0;
-  TotoalNumberOfTickets = 0;
+  // Tickets issued in every currency, the funding is shared among them
+  free(currency_tickets);
+  currency_tickets = calloc(workload.ncurrencies, sizeof(long long));
+  if (currency_tickets == NULL) {
+    perror("Could not allocate the currencies");
+    exit(EXIT_FAILURE);
+  }
+  for (int i = 0; i < num_threads; i++) {
+    currency_tickets[threads[i].se.currency] += threads[i].NumberOfTickets;
+  }
 
-  // Determine number of tickets for each thread
-  for (int i = 0; i < pMAX_NUM_THREAD; i++) {
-    int ticket = (BurstOfCpu[i][0] + BurstOfCpu[i][1] +
-                  BurstOfIo[i][0] + BurstOfIo[i][1]); //Total burst times
-    threads[i].NumberOfTickets = ticket;
+  if (!quiet) {
+    printf("Total Tickets: %d\n", TotoalNumberOfTickets);
+    printf("\n");
+  }
+}
 
-    for (int j = TicketIndex; j < TicketIndex + ticket; j++) {
-      lottery_tickets[j] = i;
+// Fund the currencies of the input, on every core in the M:N mode
+void fundCurrencies(int multicore) {
+  for (int c = 1; c < workload.ncurrencies; c++) {
+    int failed = multicore ? coreFund(c, workload.funding[c]) != 0
+                           : policy->fund(policy, c, workload.funding[c]) != 0;
+    if (failed) {
+      perror("Could not fund the currencies");
+      exit(EXIT_FAILURE);
     }
-    TicketIndex += ticket;
-    TotoalNumberOfTickets += ticket;
   }
 }
 
+// Initial tickets of a thread in base tickets, its fair share for the metrics
+int baseTickets(int id) {
+  int c = threads[id].se.currency;
+  if (c == 0) {
+    return threads[id].NumberOfTickets;
+  }
+  long long total = currency_tickets[c];
+  return total > 0 ? (int)((long long)workload.funding[c] * threads[id].NumberOfTickets / total) : 0;
+}
 
+// Creation
+// The thread arrives, its first CPU burst goes to the policy or it starts with IO
+int createThread(int id) {
+  threads[id].se.id = id;
+  threads[id].phase = -1;
+  int preempt = nextPhase(id);
+  startIO(id);
+  return preempt;
+}
 
-// Output the current step of the process and then wait for one second.
-void printStep(int wait, int selected_thread, int check) {
-  for (int val = wait; val > check; val--) {
-    for (int j = 0; j < selected_thread; j++) {
-      printf("\t");
-    }
-    printf("%d\n", val - 1);
-    sleep(1);
+// Admit the threads whose arrival time has come
+int admitArrivals() {
+  int preempt = 0;
+  while (next_arrival < num_threads && threads[arrival_order[next_arrival]].arrival_time <= sim_time) {
+    preempt |= createThread(arrival_order[next_arrival++]);
   }
+  return preempt;
 }
 
-// Lottery scheduling
-void SRTFScheduler() {
-  // Check if all threads are finished
-  all_finished = 0;
-  int all_io = 0;
-  for (int i = 0; i < pMAX_NUM_THREAD; i++) {
-    if (threads[i].state == pFINISHED) {
-      all_finished++;
-    }
+// Advance the simulation clock, returns 1 if the running thread is preempted
+int advanceTime(int units) {
+  int preempt = checkIO(units);
+  sim_time += units;
+  preempt |= admitArrivals();
+  return preempt;
+}
 
-    if (threads[i].state == pIO) {
-      all_io++;
-    }
+// Output the remaining time of the running burst and then wait for one time unit.
+void printStep(int remaining, int selected_thread) {
+  if (quiet) {
+    return;
+  }
+  for (int j = 0; j < selected_thread; j++) {
+    printf("\t");
+  }
+  printf("%d\n", remaining);
+  if (tick_delay > 0) {
+    usleep(tick_delay * 1000);
   }
+}
 
-// Select a random number from the ticket index
-  int random_number = rand() % TicketIndex;
-  int selected_thread = lottery_tickets[random_number];
-  int state = threads[selected_thread].state;
+// Hook of the random numbers of the policy
+unsigned long long replayHook(void *arg, unsigned long long value) {
+  return replayDraw(arg, value);
+}
 
-  // If only input/output threads remain
-  if (all_io + all_finished == pMAX_NUM_THREAD) {
-    checkIO(pBREAK_TIME);
-    return;
+// Checksum of the workload, a replay of another input is reported
+uint64_t workloadChecksum() {
+  uint64_t hash = 0;
+  for (int i = 0; i < workload.nthreads; i++) {
+    WorkloadThread *w = &workload.threads[i];
+    int fields[4] = {w->arrival, w->tickets, w->currency, w->nbursts};
+    hash = replayChecksum(hash, fields, sizeof(fields));
+    hash = replayChecksum(hash, workloadBursts(&workload, i), w->nbursts * sizeof(int));
   }
+  return replayChecksum(hash, workload.funding, workload.ncurrencies * sizeof(int));
+}
 
-  else if (all_finished == pMAX_NUM_THREAD - 1 && all_io == 1) {
-    // If in the final step
-    for (int i = 0; i < pMAX_NUM_THREAD; i++) {
-        // Last thread is in IO
-      if (threads[i].state == pREARDY) {
-        selected_thread = i;
-        state = threads[i].state;
-        return;
-      }
+// Start recording, or check that the replayed log matches the input
+void startReplay(const char *record_path, unsigned int seed) {
+  if (record_path != NULL) {
+    ReplayHeader header;
+    memset(&header, 0, sizeof(header));
+    header.seed = seed;
+    snprintf(header.policy, sizeof(header.policy), "%s", policy->name);
+    header.quantum = pBREAK_TIME;
+    header.nthreads = num_threads;
+    header.checksum = workloadChecksum();
+    if (replayCreate(&replay, record_path, &header) != 0) {
+      perror(record_path);
+      exit(EXIT_FAILURE);
+    }
+  } else if (replay.header.nthreads != (uint32_t)num_threads ||
+             replay.header.checksum != workloadChecksum()) {
+    fprintf(stderr, "Warning: the recorded run had another input\n");
+  }
+  replay_log = &replay;
+  policy->draw = replayHook;
+  policy->draw_arg = &replay;
+}
 
-      if (threads[i].state == pIO) {
-        exitThread(i);
-        return;
-      }
+// Close the log, a replay reports the first divergence. Returns 1 if the
+// replay diverged.
+int finishReplay(const char *path) {
+  int diverged = 0;
+  if (!replay.recording) {
+    ReplayRecord record;
+    if (!replay.diverged && replayNext(&replay, &record)) {
+      replay.diverged = 1; // The recorded run went on
+      replay.expected = record;
+      replay.actual = -2;
     }
-  } else {
-    // Whther the Thread is ready
-    while (state != pREARDY) {
-      selected_thread += 1;
-      selected_thread %= pMAX_NUM_THREAD;
-      state = threads[selected_thread].state;
+    diverged = replay.diverged;
+    if (!diverged) {
+      printf("Replay: %lld picks and %lld draws matched\n", replay.picks, replay.draws);
+    } else if (replay.actual == -2) {
+      printf("Replay: diverged after %lld picks, the recorded run made more decisions\n",
+             replay.picks - (replay.expected.type == rPICK));
+    } else if (replay.expected.type == 0) {
+      printf("Replay: diverged at pick %lld (time %lld), the recorded run ended\n", replay.picks + 1,
+             replay.actual_time);
+    } else if (replay.actual == -1) {
+      printf("Replay: diverged at pick %lld, the policy drew a random number where T%d was picked at %lld\n",
+             replay.picks, replay.expected.thread, replay.expected.time);
+    } else if (replay.expected.type == rDRAW) {
+      printf("Replay: diverged at pick %lld, T%lld was picked where the policy drew a random number\n",
+             replay.picks, replay.actual);
+    } else {
+      printf("Replay: diverged at pick %lld, recorded T%d at %lld, picked T%lld at %lld\n", replay.picks,
+             replay.expected.thread, replay.expected.time, replay.actual, replay.actual_time);
     }
   }
-
-  if (threads[selected_thread].state == pREARDY) {
-    threads[selected_thread].state = pRUNNING;
-    TotoalNumberOfTickets--;
+  if (replayClose(&replay) != 0) {
+    fprintf(stderr, "%s: %s\n", path, replay.recording ? "write failed" : "truncated log");
   }
+  replay_log = NULL;
+  return diverged;
+}
 
+// One scheduling decision of the selected policy
+void schedulerStep() {
+  SchedEntity *se = policy->pickNext(policy);
 
-  printStatus(1);
-
-  // Parameters
-  int AllBurst = threads[selected_thread].AllBurst;
-
-  int cpu1 = BurstOfCpu[selected_thread][0];
-  int cpu2 = BurstOfCpu[selected_thread][1];
-
-  int io1 = BurstOfIo[selected_thread][0];
-  int io2 = BurstOfIo[selected_thread][1];
-
-  int first = BurstOfCpu[selected_thread][0] + BurstOfIo[selected_thread][0];
-  int second = BurstOfCpu[selected_thread][1] + BurstOfIo[selected_thread][1];
-  int wait = 0;
-
-  // If we are in the first CPU burst
-  if (AllBurst < cpu1) {
-    wait = cpu1 - AllBurst;
-    if (wait > pBREAK_TIME) {
-      threads[selected_thread].BurstOfCpu[0] -= pBREAK_TIME;
+  // If only input/output threads remain, the processor idles for one unit.
+  // If nothing runs at all, skip ahead to the next arrival.
+  if (se == NULL) {
+    if (io_timers.count == 0 && next_arrival < num_threads) {
+      advanceTime(threads[arrival_order[next_arrival]].arrival_time - sim_time);
     } else {
-      threads[selected_thread].BurstOfCpu[0] -= wait;
+      advanceTime(1);
     }
+    return;
+  }
 
+  int selected_thread = se->id;
+  struct ThreadInfo *t = &threads[selected_thread];
+  t->state = pRUNNING;
+  if (replay_log != NULL) {
+    replayPick(replay_log, sim_time, selected_thread);
   }
+  simEvent(trSWITCH, selected_thread);
+  TotoalNumberOfTickets--;
 
-  // If we are in the second CPU burst
-  else if (AllBurst < first + cpu2) {
-    wait = first + cpu2 - AllBurst;
-    if (wait > pBREAK_TIME) {
-      threads[selected_thread].BurstOfCpu[1] -= pBREAK_TIME;
-    } else {
-      threads[selected_thread].BurstOfCpu[1] -= wait;
-    }
+  if (!quiet) {
+    printStatus(1);
   }
 
-  // Check IO
-  checkIO(wait);
+  // Run the CPU burst one unit at a time until it ends, the slice
+  // expires or a thread returning from input/output preempts it
+  int expired = 0;
+  int preempted = 0;
+  while (t->remaining > 0 && !expired && !preempted) {
+    t->remaining--;
+    t->AllBurst++;
+    if (!t->fixed_tickets) {
+      t->NumberOfTickets--;
+    }
+    se->remaining = t->remaining;
 
-  int check = 0;
+    printStep(t->remaining, selected_thread);
 
-  if (wait > pBREAK_TIME) {
-    threads[selected_thread].AllBurst += pBREAK_TIME;
-    threads[selected_thread].NumberOfTickets -= pBREAK_TIME;
-    threads[selected_thread].state = pREARDY;
-    check = wait - pBREAK_TIME;
-  } else if (wait <= pBREAK_TIME && threads[selected_thread].state == pRUNNING) {
-    threads[selected_thread].AllBurst += wait;
-    threads[selected_thread].NumberOfTickets -= wait;
-    threads[selected_thread].state = pIO;
-    check = 0;
+    // Check IO and arrivals
+    preempted = advanceTime(1);
+    expired = policy->onTick(policy, se, 1);
   }
 
-  printStep(wait, selected_thread, check);
+  if (t->remaining == 0) {
+    // The CPU burst is finished, continue with input/output or exit
+    policy->onBlock(policy, se);
+    nextPhase(selected_thread);
+    startIO(selected_thread);
+  } else {
+    // Put the thread back to the ready structure
+    simEvent(trYIELD, selected_thread);
+    t->state = pREARDY;
+    se->tickets = t->NumberOfTickets;
+    queueThread(se);
+  }
 }
 
 // Selection
+// The scheduling step runs on the context of the first unfinished thread
 int selectThread() {
-  int id = -2;
-  for (int i = 0; i < pMAX_NUM_THREAD; i++) {
-    if (threads[i].state != pFINISHED) {
-      id = i;
-      return id;
-    }
+  while (threads[host_thread].state == pFINISHED) {
+    host_thread++;
   }
+  return host_thread;
 }
 
 // Initilization
 void initializeThread() {
-  for (int i = 0; i < pMAX_NUM_THREAD; i++) {
+  wheelInit(&io_timers, 0);
+  for (int i = 0; i < num_threads; i++) {
     threads[i].state = pEMPTY;
+    threads[i].AllBurst = 0;
+    threads[i].remaining = 0;
+    threads[i].stack = NULL;
+  }
+}
 
-    threads[i].BurstOfCpu[0] = BurstOfCpu[i][0];
-    threads[i].BurstOfCpu[1] = BurstOfCpu[i][1];
+// Body of a step on the stack of a thread, switches back to the main context
+void stepEntry(void) {
+  schedulerStep();
+  contextSwitch(&threads[step_thread].context, &main_ctx, sim_fast_switch);
+}
 
-    threads[i].BurstOfIo[0] = BurstOfIo[i][0];
-    threads[i].BurstOfIo[1] = BurstOfIo[i][1];
+// Run
+void runThread(int signal) {
+  int id = selectThread();
 
-    threads[i].AllBurst = 0;
+  // Stacks are only given to the threads that host a step, not to all of them
+  if (threads[id].stack == NULL) {
+    threads[id].stack = stackAlloc(&stack_pool);
+    if (threads[id].stack == NULL) {
+      perror("stackAlloc: Could not allocate stack"); //system unable to create new thread
+      exit(EXIT_FAILURE);
+    }
+  }
+  step_thread = id;
+  contextMake(&threads[id].context, threads[id].stack, stackSize(&stack_pool), stepEntry, sim_fast_switch);
+  contextSwitch(&main_ctx, &threads[id].context, sim_fast_switch); // P&WF_scheduler
+
+  // Recycle the stacks of the threads that finished during the step. The
+  // step may have run on one of them, so this waits until we are back here.
+  while (finished_head != -1) {
+    int i = finished_head;
+    finished_head = threads[i].next;
+    if (threads[i].stack != NULL) {
+      stackFree(&stack_pool, threads[i].stack);
+      threads[i].stack = NULL;
+    }
   }
 }
+// Exit 
+void exitThread(int id) {
+  // Update the state to "FINISHED".
+  threads[id].state = pFINISHED;
+  threads[id].next = finished_head;
+  finished_head = id;
 
-// Creation
-int createThread() {
-  for (int i = 0; i < pMAX_NUM_THREAD; i++) {
-    if (threads[i].state == pEMPTY) {
-      // Get context
-      ucontext_t *uc = &threads[i].context;
+  // Increase all finished
+  all_finished++;
 
-      getcontext(uc);
+  // If we reached the last thread
+  if (all_finished == num_threads && !quiet) {
+    printStatus(1);
+  }
+}
 
-      // Set context values
-      uc->uc_stack.ss_sp = malloc(pSTACK_SIZE);
-      uc->uc_stack.ss_size = pSTACK_SIZE;
+// Print inputs
+void printInputData() {
+  printf("Input: \n");
+  if (legacy_input) {
+    // Print CPU and IO bursts for each thread
+    printf("TID\tCPU1\tCPU2\tIO1\tIO2\n"); //Creating table
+    for (int i = 0; i < num_threads; i++) {
+      int *b = threads[i].bursts;
+      printf("T%d\t%d\t%d\t%d\t%d\t\n", i, b[0], b[2], b[1], b[3]);
+    }
+  } else {
+    printf("TID\tArrival\tTickets\tBursts (CPU IO CPU ...)\n"); //Creating table
+    for (int i = 0; i < num_threads; i++) {
+      printf("T%d\t%d\t", i, threads[i].arrival_time);
+      if (threads[i].fixed_tickets) {
+        printf("%d\t", threads[i].fixed_tickets);
+      } else {
+        printf("-\t");
+      }
+      for (int j = 0; j < threads[i].nbursts; j++) {
+        printf(j == 0 ? "%d" : " %d", threads[i].bursts[j]);
+      }
+      printf("\n");
+    }
+  }
+  printf("\n");
+}
 
-       // Set context link to main context
-      uc->uc_link = &main_uc;
+// Order of the arrivals, the thread ID breaks ties
+int compareArrival(const void *a, const void *b) {
+  int x = *(const int *)a;
+  int y = *(const int *)b;
+  if (threads[x].arrival_time != threads[y].arrival_time) {
+    return threads[x].arrival_time < threads[y].arrival_time ? -1 : 1;
+  }
+  return x - y;
+}
 
-      if (uc->uc_stack.ss_sp == NULL) {
-        perror("malloc: Could not allocate stack"); //system unable to create new thread
-        return (-1);
-      }
+// Read input data from txt file
+// Details and structure of input.txt file is in the InputFormat.txt file
+void readInputFromTxt(const char *path) {
+  if (workloadLoad(&workload, path) != 0) {
+    exit(EXIT_FAILURE);
+  }
+  if (workload.nthreads == 0) {
+    fprintf(stderr, "%s: no threads\n", path);
+    exit(EXIT_FAILURE);
+  }
 
-      // Make context and set function to run
-      makecontext(uc, (void (*)(void))SRTFScheduler, 1);
+  num_threads = workload.nthreads;
+  threads = calloc(num_threads, sizeof(struct ThreadInfo));
+  arrival_order = malloc(num_threads * sizeof(int));
+  if (threads == NULL || arrival_order == NULL) {
+    perror("Could not allocate the threads");
+    exit(EXIT_FAILURE);
+  }
 
-      // Set state to Ready
-      threads[i].state = pREARDY;
-      return i;
+  legacy_input = 1;
+  for (int i = 0; i < num_threads; i++) {
+    WorkloadThread *w = &workload.threads[i];
+    threads[i].bursts = workloadBursts(&workload, i);
+    threads[i].nbursts = w->nbursts;
+    threads[i].arrival_time = w->arrival;
+    threads[i].fixed_tickets = w->tickets;
+    threads[i].se.currency = w->currency;
+    arrival_order[i] = i;
+    if (w->nbursts != 4 || w->arrival != 0 || w->tickets != 0 || w->currency != 0) {
+      legacy_input = 0;
     }
   }
-  return -1;
+  qsort(arrival_order, num_threads, sizeof(int), compareArrival);
 }
 
-// Run
-void runThread(int signal) {
-  int id = selectThread();
-  ucontext_t *uc = &threads[id].context;
-  getcontext(uc);
-  makecontext(uc, (void (*)(void))SRTFScheduler, 1);
-  swapcontext(&main_uc, &threads[id].context); // P&WF_scheduler
+// Busy CPU work for one time unit
+void spinUnit() {
+  long long end = coreNow() + unit_usec * 1000LL;
+  while (coreNow() < end) {
+  }
 }
-// Exit 
-void exitThread(int id) {
-  // If we reached the last thread
-  if (all_finished == pMAX_NUM_THREAD - 1) {
-    // Increase all bursts
-    threads[id].AllBurst += threads[id].BurstOfIo[1];
 
-    threads[id].NumberOfTickets -= threads[id].BurstOfIo[1];
-    threads[id].BurstOfIo[1] -= threads[id].BurstOfIo[1];
+// Real IO burst: one read per time unit, the thread blocks while the core
+// runs the others
+void ioBurst(int id, int phase, int units) {
+  char buf[pIO_BLOCK];
+  for (int u = 0; u < units; u++) {
+    long long block = ((long long)id * 7919 + phase * 131 + u) % io_blocks;
+    if (coreRead(io_file, buf, pIO_BLOCK, block * pIO_BLOCK) < 0) {
+      perror("coreRead");
+      exit(EXIT_FAILURE);
+    }
+  }
+}
 
-    // Finalize the last one
-    threads[id].state = pFINISHED;
+// Body of a thread in the M:N mode, the bursts are executed for real
+void workloadThread(void *arg) {
+  int id = (int)(intptr_t)arg;
+  struct ThreadInfo *t = &threads[id];
+  if (t->arrival_time > 0) {
+    coreSleepUntil(start_ns + t->arrival_time * unit_usec * 1000LL);
+  }
+  for (int j = 0; j < t->nbursts; j++) {
+    if (j % 2 == 1) {
+      if (io_file >= 0) {
+        ioBurst(id, j, t->bursts[j]);
+      } else if (t->bursts[j] > 0) {
+        coreSleepUntil(coreNow() + t->bursts[j] * unit_usec * 1000LL);
+      }
+      continue;
+    }
+    for (int u = t->bursts[j]; u > 0; u--) {
+      spinUnit();
+      coreSelf()->se.remaining = u - 1;
+      coreTick(1);
+    }
+  }
+}
+
+// Run the threads on a pool of kernel threads
+void runMultiCore(int ncores, char *policy_name, unsigned int seed, int fast_switch) {
+  if (coresInit(ncores, policy_name, pBREAK_TIME, seed) != 0) {
+    fprintf(stderr, "Could not create %d cores\n", ncores);
+    exit(EXIT_FAILURE);
+  }
+  fundCurrencies(1);
+  printf("Context switch: %s\n", coreUseFastSwitch(fast_switch) ? "fast" : "ucontext");
+  if (io_file >= 0) {
+    printf("I/O: %s\n", aioName(&coreGet(0)->aio));
+  }
 
-    // Increase all finished
-    all_finished++;
+  // The metrics count from the arrival times, in nanoseconds
+  start_ns = coreNow();
+  for (int i = 0; i < num_threads; i++) {
+    metricsArrive(&metrics, i, start_ns + threads[i].arrival_time * unit_usec * 1000LL,
+                  baseTickets(i));
+  }
+  coreSetMetrics(&metrics);
 
-    // printStatus(0);
-    printStatus(1);
+  for (int i = 0; i < num_threads; i++) {
+    if (coreSpawn(workloadThread, (void *)(intptr_t)i, i, threads[i].NumberOfTickets,
+                  threads[i].se.currency, 0) == NULL) {
+      perror("coreSpawn: Could not create thread");
+      exit(EXIT_FAILURE);
+    }
+  }
 
-    //If we are not currently processing the last thread
-  } else {
-    // Update the state to "FINISHED".
-    threads[id].state = pFINISHED;
+  coresRun();
+  coreSetMetrics(NULL);
+  if (metricsMerge(&metrics) != 0) {
+    fprintf(stderr, "metricsMerge: Events were lost, the metrics are incomplete\n");
   }
 
-  // Free stack
-  free(threads[id].context.uc_stack.ss_sp);
+  printf("\nCore\tSwitches\tSteals\tIdle(ms)\n");
+  for (int i = 0; i < ncores; i++) {
+    Core *core = coreGet(i);
+    printf("%d\t%lld\t\t%lld\t%.2f\n", i, core->switches, core->steals, core->idle_ns / 1e6);
+  }
+  coresDestroy();
 }
 
-// Print inputs
-void printInputData() {
-  printf("Input: \n");
-  // Print CPU and IO bursts for each thread
-  printf("TID\tCPU1\tCPU2\tIO1\tIO2\n"); //Creating table
-  for (int i = 0; i < pMAX_NUM_THREAD; i++) {
-    printf("T%d\t", i);
-    for (int j = 0; j < 2; j++) { 
-      printf("%d\t", BurstOfCpu[i][j]);
+// Print the metrics, and write them as JSON if asked
+void reportMetrics(const char *json_path) {
+  printf("\n");
+  metricsReport(&metrics, stdout, !quiet);
+
+  if (json_path != NULL) {
+    FILE *fp = strcmp(json_path, "-") == 0 ? stdout : fopen(json_path, "w");
+    if (fp == NULL || metricsJson(&metrics, fp, policy->name) != 0) {
+      perror(json_path);
     }
-    for (int j = 0; j < 2; j++) {
-      printf("%d\t", BurstOfIo[i][j]);
+    if (fp != NULL && fp != stdout) {
+      fclose(fp);
     }
+  }
+  metricsDestroy(&metrics);
+}
+
+// Run the simulation of the loaded workload with the current policy
+void runSimulation(int stack_kb) {
+  if (stackPoolInit(&stack_pool, (size_t)stack_kb * 1024) != 0) {
+    perror("stackPoolInit: Could not create the stack pool");
+    exit(EXIT_FAILURE);
+  }
+
+  //Signal handler
+  signal(SIGALRM, runThread);
+
+  // Total Number of Tickets
+  determineRemainingBursts();
+  fundCurrencies(0);
+
+  // Metrics in simulation time units
+  if (metricsInit(&metrics, num_threads, 1, 1, "units") != 0) {
+    perror("metricsInit: Could not allocate the metrics");
+    exit(EXIT_FAILURE);
+  }
+  for (int i = 0; i < num_threads; i++) {
+    metricsArrive(&metrics, i, threads[i].arrival_time, baseTickets(i));
+  }
+
+  // Thread Creation, the threads that arrive at time 0
+  admitArrivals();
+
+  // Show all values
+  if (!quiet) {
+    printStatus(0);
     printf("\n");
+    printStatus(2);
+  }
+
+  // Set alarm till all threads are finished
+  while (all_finished != num_threads) {
+    raise(SIGALRM); //Interrupt Creation
   }
-  printf("\n");
 }
 
-// Read input data from txt file
-// Details and structure of input.txt file is in the InputFormat.txt file
-void readInputFromTxt() {
-  FILE *fp;
-  char filename[] = "input.txt";
-  int cpu1, cpu2, io1, io2; 
-  fp = fopen(filename, "r");
-  // If the File Does Not Exists
-  if (fp == NULL) {
-    perror("The File Does Not Exists.\n");
+// Figures of the batch mode
+#define pBATCH_FIGURES 10
+const char *batch_names[pBATCH_FIGURES] = {
+  "turnaround_mean", "turnaround_p95", "turnaround_p99", "wait_mean", "wait_p99",
+  "response_mean", "response_p95", "fairness", "utilization", "switches"
+};
+
+double batchValue(const MetricsSummary *s, int figure) {
+  switch (figure) {
+    case 0: return s->values[mTURNAROUND].mean;
+    case 1: return s->values[mTURNAROUND].p95;
+    case 2: return s->values[mTURNAROUND].p99;
+    case 3: return s->values[mWAIT].mean;
+    case 4: return s->values[mWAIT].p99;
+    case 5: return s->values[mRESPONSE].mean;
+    case 6: return s->values[mRESPONSE].p95;
+    case 7: return s->fairness;
+    case 8: return s->utilization;
+    default: return (double)s->switches;
+  }
+}
+
+// Result of one run, written by the child process into shared memory
+struct RunResult {
+  int done;
+  MetricsSummary summary;
+  uint64_t schedule; // schedule_hash of the run
+};
+
+int compareSchedule(const void *a, const void *b) {
+  uint64_t x = *(const uint64_t *)a;
+  uint64_t y = *(const uint64_t *)b;
+  return (x > y) - (x < y);
+}
+
+// Batch mode
+// Every run is a child process with its own copy of the simulator and its own
+// seed, so the runs share no state at all. At most `workers` run at a time;
+// the results come back through a shared anonymous mapping.
+void runBatch(int runs, int workers, unsigned int seed, char *policy_name, int stack_kb,
+              const char *json_path) {
+  struct RunResult *results = mmap(NULL, runs * sizeof(struct RunResult), PROT_READ | PROT_WRITE,
+                                   MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (results == MAP_FAILED) {
+    perror("mmap: Could not allocate the batch results");
     exit(EXIT_FAILURE);
   }
 
-  int thread_number = 0;
-  while (fscanf(fp, "%d %d %d %d", &cpu1, &cpu2, &io1, &io2) != EOF) { 
-    BurstOfCpu[thread_number][0] = cpu1;
-    BurstOfCpu[thread_number][1] = cpu2;
-    BurstOfIo[thread_number][0] = io1;
-    BurstOfIo[thread_number][1] = io2;
-    thread_number++;
+  long long start = coreNow();
+  int running = 0;
+  fflush(stdout);
+  for (int run = 0; run < runs || running > 0;) {
+    if (run < runs && running < workers) {
+      pid_t pid = fork();
+      if (pid < 0) {
+        perror("fork");
+        exit(EXIT_FAILURE);
+      }
+      if (pid == 0) {
+        policyDestroy(policy);
+        policy = policyCreate(policy_name, pBREAK_TIME, seed + run);
+        runSimulation(stack_kb);
+        results[run].schedule = schedule_hash;
+        results[run].done = metricsSummary(&metrics, &results[run].summary) == 0;
+        _exit(0);
+      }
+      run++;
+      running++;
+      continue;
+    }
+
+    // A run that crashed leaves its result not done
+    if (wait(NULL) > 0) {
+      running--;
+    }
+  }
+  double seconds = (coreNow() - start) / 1e9;
+
+  // Distribution of every figure over the completed runs
+  double *values = malloc(runs * sizeof(double));
+  uint64_t *schedules = malloc(runs * sizeof(uint64_t));
+  MetricsSample samples[pBATCH_FIGURES];
+  if (values == NULL || schedules == NULL) {
+    perror("Could not allocate the batch results");
+    exit(EXIT_FAILURE);
+  }
+  int done = 0;
+  for (int f = 0; f < pBATCH_FIGURES; f++) {
+    done = 0;
+    for (int run = 0; run < runs; run++) {
+      if (results[run].done) {
+        values[done++] = batchValue(&results[run].summary, f);
+      }
+    }
+    metricsSample(values, done, &samples[f]);
+  }
+  free(values);
+
+  // The seeds must change the schedule, or the distribution says nothing
+  // about the policy
+  int distinct = 0;
+  for (int run = 0, n = 0; run < runs; run++) {
+    if (results[run].done) {
+      schedules[n++] = results[run].schedule;
+    }
+  }
+  qsort(schedules, done, sizeof(uint64_t), compareSchedule);
+  for (int i = 0; i < done; i++) {
+    distinct += i == 0 || schedules[i] != schedules[i - 1];
+  }
+  free(schedules);
+
+  printf("Batch: %d runs on %d workers, seeds %u..%u, %.2f s (%.0f runs/s)\n", runs, workers,
+         seed, seed + runs - 1, seconds, runs / seconds);
+  if (done < runs) {
+    printf("Failed runs: %d\n", runs - done);
+  }
+  printf("Distinct schedules: %d of %d runs\n", distinct, done);
+  if (done > 1 && distinct == 1) {
+    printf("Warning: every seed gave the same schedule, the figures do not depend on the seed\n");
+  }
+  printf("\nFigure (%s)\tmean\t95%% CI\t\tsd\tp5\tp50\tp95\n", policy->name);
+  for (int f = 0; f < pBATCH_FIGURES; f++) {
+    MetricsSample *m = &samples[f];
+    printf("%-15s\t%.4g\t+-%-8.3g\t%.3g\t%.4g\t%.4g\t%.4g\n", batch_names[f], m->mean, m->ci,
+           m->sd, m->p5, m->p50, m->p95);
   }
 
-  fclose(fp);
+  if (json_path != NULL) {
+    FILE *fp = strcmp(json_path, "-") == 0 ? stdout : fopen(json_path, "w");
+    if (fp == NULL) {
+      perror(json_path);
+    } else {
+      fprintf(fp, "{\n  \"policy\": \"%s\",\n  \"runs\": %d,\n  \"completed\": %d,\n  \"distinct_schedules\": %d,\n  \"first_seed\": %u,\n  \"seconds\": %.6f",
+              policy->name, runs, done, distinct, seed, seconds);
+      for (int f = 0; f < pBATCH_FIGURES; f++) {
+        MetricsSample *m = &samples[f];
+        fprintf(fp, ",\n  \"%s\": {\"mean\": %.6g, \"ci95\": %.6g, \"sd\": %.6g, \"p5\": %.6g, \"p50\": %.6g, \"p95\": %.6g}",
+                batch_names[f], m->mean, m->ci, m->sd, m->p5, m->p50, m->p95);
+      }
+      fprintf(fp, "\n}\n");
+      if (fp != stdout) {
+        fclose(fp);
+      }
+    }
+  }
+  munmap(results, runs * sizeof(struct RunResult));
 }
 
-int main(int argc) {
+int main(int argc, char *argv[]) {
    // Initialize the RNG
   unsigned int seed = time(NULL);
-  srand(seed);
+  char *policy_name = pDEFAULT_POLICY;
+  char *input_path = pDEFAULT_INPUT;
+  char *trace_path = NULL;
+  char *json_path = NULL;
+  int ncores = 0;
+  int fast_switch = 1;
+  sim_fast_switch = contextFastAvailable();
+  int stack_kb = pSTACK_SIZE / 1024;
+  int runs = 0;
+  int workers = (int)sysconf(_SC_NPROCESSORS_ONLN);
+  char *io_path = NULL;
+  char *record_path = NULL;
+  char *replay_path = NULL;
+
+  // Parse command line arguments
+  int opt;
+  while ((opt = getopt(argc, argv, "p:s:d:c:u:x:k:i:qt:j:b:w:a:er:R:")) != -1) {
+    switch (opt) {
+      case 'p':
+        policy_name = optarg;
+        break;
+      case 's':
+        seed = (unsigned int)strtoul(optarg, NULL, 10);
+        break;
+      case 'd':
+        tick_delay = atoi(optarg);
+        break;
+      case 'c':
+        ncores = atoi(optarg);
+        break;
+      case 'u':
+        unit_usec = atoi(optarg);
+        break;
+      case 'x':
+        fast_switch = strcmp(optarg, "ucontext") != 0;
+        sim_fast_switch = fast_switch && contextFastAvailable();
+        break;
+      case 'k':
+        stack_kb = atoi(optarg);
+        break;
+      case 'i':
+        input_path = optarg;
+        break;
+      case 'q':
+        quiet = 1;
+        break;
+      case 't':
+        trace_path = optarg;
+        break;
+      case 'j':
+        json_path = optarg;
+        break;
+      case 'b':
+        runs = atoi(optarg);
+        break;
+      case 'w':
+        workers = atoi(optarg);
+        break;
+      case 'a':
+        io_path = optarg;
+        break;
+      case 'e':
+        coreSetIoBackend(0);
+        break;
+      case 'r':
+        record_path = optarg;
+        break;
+      case 'R':
+        replay_path = optarg;
+        break;
+      default:
+        fprintf(stderr, "Usage: %s [-p %s] [-s seed] [-d delay ms] [-c cores] [-u unit us] [-x fast|ucontext] [-k stack KB] [-i input|-] [-q] [-t trace] [-j json|-] [-b runs] [-w workers] [-a io file] [-e] [-r record] [-R replay]\n", argv[0], policyNames());
+        exit(EXIT_FAILURE);
+    }
+  }
+
+  // A replay runs the recorded policy with the recorded seed
+  if (record_path != NULL || replay_path != NULL) {
+    if (ncores > 0 || runs > 0 || (record_path != NULL && replay_path != NULL)) {
+      fprintf(stderr, "Record (-r) or replay (-R) a single simulation, without -c and -b\n");
+      exit(EXIT_FAILURE);
+    }
+    if (replay_path != NULL) {
+      if (replayOpen(&replay, replay_path) != 0) {
+        fprintf(stderr, "%s: not a replay log\n", replay_path);
+        exit(EXIT_FAILURE);
+      }
+      policy_name = replay.header.policy;
+      seed = replay.header.seed;
+      printf("Replay: %s, seed %u\n", replay_path, seed);
+    }
+  }
+
+  // Create the scheduling policy
+  policy = policyCreate(policy_name, pBREAK_TIME, seed);
+  if (policy == NULL) {
+    fprintf(stderr, "Unknown policy: %s (expected %s)\n", policy_name, policyNames());
+    exit(EXIT_FAILURE);
+  }
+  printf("Policy: %s\n", policy->name);
+
+  if (runs > 0 && (ncores > 0 || trace_path != NULL)) {
+    fprintf(stderr, "The batch mode runs the simulation only, without -c and -t\n");
+    exit(EXIT_FAILURE);
+  }
+  if (io_path != NULL) {
+    struct stat st;
+    if (ncores == 0) {
+      fprintf(stderr, "The IO bursts read the file in the M:N mode only, with -c\n");
+      exit(EXIT_FAILURE);
+    }
+    io_file = open(io_path, O_RDONLY);
+    if (io_file < 0 || fstat(io_file, &st) != 0) {
+      perror(io_path);
+      exit(EXIT_FAILURE);
+    }
+    io_blocks = st.st_size / pIO_BLOCK;
+    if (io_blocks < 1) {
+      fprintf(stderr, "%s: At least %d bytes are needed\n", io_path, pIO_BLOCK);
+      exit(EXIT_FAILURE);
+    }
+  }
+  if (runs > 0) {
+    quiet = 1;
+    tick_delay = 0;
+    workers = workers > 0 ? workers : 1;
+  }
 
   // Read input data from txt file
-  readInputFromTxt();
+  readInputFromTxt(input_path);
 
   // Show the input
-  printInputData();
-
-  // Get main context
-  getcontext(&main_uc);
+  if (!quiet) {
+    printInputData();
+  }
 
   // Thread Initilization
   initializeThread();
 
-  //Signal handler
-  signal(SIGALRM, runThread);
-
-  // Total Number of Tickets
-  determineRemainingBursts();
+  // Event trace, one buffer per core. The simulation records its own clock,
+  // the M:N mode records nanoseconds.
+  if (trace_path != NULL &&
+      traceOpen(trace_path, ncores > 0 ? ncores : 1, ncores > 0 ? 1 : unit_usec * 1000LL) != 0) {
+    perror(trace_path);
+    exit(EXIT_FAILURE);
+  }
 
-  // Thread Creation
-  for (int i = 0; i < pMAX_NUM_THREAD; i++) {
-    createThread();
+  // M:N mode, the threads run for real on several cores
+  if (ncores > 0) {
+    coreSetStackSize((size_t)stack_kb * 1024);
+    determineRemainingBursts();
+    if (metricsInit(&metrics, num_threads, ncores, 1e-6, "ms") != 0) {
+      perror("metricsInit: Could not allocate the metrics");
+      exit(EXIT_FAILURE);
+    }
+    runMultiCore(ncores, policy_name, seed, fast_switch);
+    if (traceClose() != 0) {
+      perror(trace_path);
+    }
+    reportMetrics(json_path);
+    policyDestroy(policy);
+    workloadDestroy(&workload);
+    return 0;
   }
 
-  // Show all values
-  printStatus(0);
-  printf("\n");
-  printStatus(2);
+  // Many independent runs with consecutive seeds
+  if (runs > 0) {
+    runBatch(runs, workers, seed, policy_name, stack_kb, json_path);
+    policyDestroy(policy);
+    workloadDestroy(&workload);
+    return 0;
+  }
 
-  all_finished = 0;
+  if (record_path != NULL || replay_path != NULL) {
+    startReplay(record_path, seed);
+  }
+  runSimulation(stack_kb);
 
-  // Set alarm till all threads are finished
-  while (all_finished != pMAX_NUM_THREAD) {
-    raise(SIGALRM); //Interrupt Creation
+  if (traceClose() != 0) {
+    perror(trace_path);
+  }
+  int diverged = 0;
+  if (replay_log != NULL) {
+    diverged = finishReplay(record_path != NULL ? record_path : replay_path);
   }
 
-  // Calculate processor utilization and turnaround times
-  int TotalBurst = 0;
-  int total_turnaround = 0;
-    for (int i = 0; i < pMAX_NUM_THREAD; i++) {
-        TotalBurst += threads[i].AllBurst;
-        total_turnaround += threads[i].AllBurst + BurstOfIo[i][0] + BurstOfIo[i][1]; 
-        
-        // Calculate turnaround time for each thread
-        int turnaround_time = threads[i].AllBurst + BurstOfIo[i][0] + BurstOfIo[i][1] - threads[i].arrival_time;
-        printf("Turnaround time for Thread %d: %d\n", i, turnaround_time); // turnaround time of each of the processes
-    }
-  float utilization = (float)TotalBurst / total_turnaround * 100;
-
-  // Print processor utilization and turnaround times
-  printf("\nProcessor Utilization: %.2f%%\n", utilization); // processor utilization
-  printf("Test4");
-  printf("Average Turnaround Time: %.2f\n", (float)total_turnaround / pMAX_NUM_THREAD);
-  printf("Test3");
-  // Free main context
-  free(main_uc.uc_stack.ss_sp);
-  free(main_uc.uc_link);
-  printf("Test1");
-  // Free threads
-  for (int i = 0; i < pMAX_NUM_THREAD; i++) {
-    free(threads[i].context.uc_stack.ss_sp);
-  }
-  printf("Test2");
-  return 0;
+  // Wait, response and turnaround times, fairness
+  reportMetrics(json_path);
+
+  // Free threads, their stacks were already recycled by runThread
+  stackPoolDestroy(&stack_pool);
+  policyDestroy(policy);
+  free(threads);
+  free(arrival_order);
+  free(currency_tickets);
+  workloadDestroy(&workload);
+  return diverged ? EXIT_FAILURE : 0; // For git bisect run
   
   // Referneces:
   // *Saadet, T. (n.d.). EE442_OS_homeworks. GitHub. https://github.com/ttsaadet/EE442_OS_homeworks
@@ -0,0 +1,130 @@
+///////////////////// STACK POOL SOURCE FILE README///////////////////////
+
+//This file contains the implementation (`stack.c`) of the stack pool. A chunk
+//is one `mmap` of `pSTACKS_PER_CHUNK` slots; every slot starts with a guard
+//page followed by the stack. Memory is reserved with MAP_NORESERVE, so only
+//the pages a thread actually touches are backed by RAM. Every guard page
+//splits the mapping, so a guarded stack costs two of the process's
+//`vm.max_map_count` mappings; once half of that budget is used, new chunks
+//are mapped without guard pages so that the pool can still grow.
+
+#include "stack.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#define pMAP_COUNT_DEFAULT 65530 // Linux default of vm.max_map_count
+
+// Number of stacks that may get a guard page
+static long long guardBudget(void) {
+  long long limit = pMAP_COUNT_DEFAULT;
+  FILE *fp = fopen("/proc/sys/vm/max_map_count", "r");
+  if (fp != NULL) {
+    if (fscanf(fp, "%lld", &limit) != 1) {
+      limit = pMAP_COUNT_DEFAULT;
+    }
+    fclose(fp);
+  }
+  // Half of the mappings, two per guarded stack
+  return limit / 4;
+}
+
+// Initialize the pool
+int stackPoolInit(StackPool *pool, size_t stack_size) {
+  size_t page = (size_t)sysconf(_SC_PAGESIZE);
+  if (stack_size < page) {
+    stack_size = page;
+  }
+  pool->stack_size = (stack_size + page - 1) & ~(page - 1);
+  pool->slot_size = pool->stack_size + page;
+  pool->free_list = NULL;
+  pool->chunks = NULL;
+  pool->nchunks = 0;
+  pool->chunk_capacity = 0;
+  pool->allocated = 0;
+  pool->guarded = 0;
+  pool->guard_budget = guardBudget();
+  return pthread_mutex_init(&pool->lock, NULL) == 0 ? 0 : -1;
+}
+
+// Map a new chunk and put its stacks on the free list, called with the lock held
+static int mapChunk(StackPool *pool) {
+  size_t page = pool->slot_size - pool->stack_size;
+
+  if (pool->nchunks == pool->chunk_capacity) {
+    int capacity = pool->chunk_capacity > 0 ? pool->chunk_capacity * 2 : 16;
+    void **chunks = realloc(pool->chunks, capacity * sizeof(void *));
+    if (chunks == NULL) {
+      return -1;
+    }
+    pool->chunks = chunks;
+    pool->chunk_capacity = capacity;
+  }
+
+  char *chunk = mmap(NULL, pool->slot_size * pSTACKS_PER_CHUNK, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (chunk == MAP_FAILED) {
+    return -1;
+  }
+  pool->chunks[pool->nchunks++] = chunk;
+
+  // Guard pages below every stack, stacks grow down into them
+  int guard = pool->guarded + pSTACKS_PER_CHUNK <= pool->guard_budget;
+  if (guard) {
+    pool->guarded += pSTACKS_PER_CHUNK;
+  }
+  for (int i = pSTACKS_PER_CHUNK - 1; i >= 0; i--) {
+    char *slot = chunk + i * pool->slot_size;
+    if (guard) {
+      mprotect(slot, page, PROT_NONE);
+    }
+    void **stack = (void **)(slot + page);
+    *stack = pool->free_list;
+    pool->free_list = stack;
+  }
+  return 0;
+}
+
+// Take a stack
+void *stackAlloc(StackPool *pool) {
+  pthread_mutex_lock(&pool->lock);
+  if (pool->free_list == NULL && mapChunk(pool) != 0) {
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+  }
+  void **stack = pool->free_list;
+  pool->free_list = *stack;
+  pool->allocated++;
+  pthread_mutex_unlock(&pool->lock);
+  return stack;
+}
+
+// Recycle a stack
+void stackFree(StackPool *pool, void *stack) {
+  if (stack == NULL) {
+    return;
+  }
+  pthread_mutex_lock(&pool->lock);
+  *(void **)stack = pool->free_list;
+  pool->free_list = stack;
+  pool->allocated--;
+  pthread_mutex_unlock(&pool->lock);
+}
+
+size_t stackSize(const StackPool *pool) {
+  return pool->stack_size;
+}
+
+// Unmap all stacks
+void stackPoolDestroy(StackPool *pool) {
+  for (int i = 0; i < pool->nchunks; i++) {
+    munmap(pool->chunks[i], pool->slot_size * pSTACKS_PER_CHUNK);
+  }
+  free(pool->chunks);
+  pool->chunks = NULL;
+  pool->nchunks = 0;
+  pool->chunk_capacity = 0;
+  pool->free_list = NULL;
+  pthread_mutex_destroy(&pool->lock);
+}
@@ -0,0 +1,46 @@
+///////////////////// STACK POOL HEADER FILE README///////////////////////
+
+//This file contains the header (`stack.h`) for the pool of coroutine stacks.
+//Stacks are carved out of large `mmap` chunks, each with a PROT_NONE guard
+//page below it so that an overflow faults instead of silently corrupting the
+//neighbouring stack (as long as the mapping limit of the process allows
+//it, see `stack.c`). Released stacks are kept on a free list and handed out
+//again, so creating and destroying threads does not call the system
+//allocator once the pool is warm.
+
+// FUNCTIONALITY
+// *`stackPoolInit`: Initialize a pool of stacks of a given size.
+// *`stackAlloc`: Take a stack from the free list, mapping a chunk if empty.
+// *`stackFree`: Return a stack to the free list.
+// *`stackPoolDestroy`: Unmap every chunk of the pool.
+
+#ifndef STACK_H
+#define STACK_H
+
+#include <pthread.h>
+#include <stddef.h>
+
+#define pSTACKS_PER_CHUNK 64 // Stacks mapped by a single mmap
+
+// Structure
+typedef struct {
+  size_t stack_size; // Usable bytes of every stack
+  size_t slot_size; // Stack plus its guard page
+  pthread_mutex_t lock;
+  void *free_list; // Released stacks, linked through their first word
+  void **chunks; // Every mapping, for stackPoolDestroy
+  int nchunks;
+  int chunk_capacity;
+  long long allocated; // Stacks currently in use
+  long long guarded; // Stacks mapped with a guard page
+  long long guard_budget; // Stacks that may get a guard page (mapping limit)
+} StackPool;
+
+// Function prototypes
+int stackPoolInit(StackPool *pool, size_t stack_size); // Rounded up to pages, -1 on error
+void *stackAlloc(StackPool *pool); // Lowest usable address, NULL if out of memory
+void stackFree(StackPool *pool, void *stack); // Recycle a stack
+size_t stackSize(const StackPool *pool); // Usable bytes of every stack
+void stackPoolDestroy(StackPool *pool); // Unmap all stacks
+
+#endif /* STACK_H */
@@ -0,0 +1,142 @@
+///////////////////// CONTEXT SWITCH SOURCE FILE README///////////////////////
+
+//This file contains the implementation (`switch.c`) of the context switch.
+//`fastSwitch(&from->sp, to->sp)` pushes the callee-saved registers on the
+//current stack, stores the stack pointer, loads the other stack pointer and
+//pops the registers saved there. A new context is a stack prepared to look
+//as if it had been switched out just before the first instruction of entry.
+
+//Helped from the System V AMD64 ABI and the Procedure Call Standard for the
+//Arm 64-bit Architecture (callee-saved registers).
+
+#include "switch.h"
+#include <stdint.h>
+
+#if pFAST_SWITCH
+
+void fastSwitch(void **save_sp, void *load_sp);
+
+#if defined(__x86_64__)
+// rbp, rbx, r12-r15, the SSE control/status word and the x87 control word
+__asm__(
+    ".text\n"
+    ".globl fastSwitch\n"
+    ".type fastSwitch, @function\n"
+    "fastSwitch:\n"
+    "  pushq %rbp\n"
+    "  pushq %rbx\n"
+    "  pushq %r12\n"
+    "  pushq %r13\n"
+    "  pushq %r14\n"
+    "  pushq %r15\n"
+    "  subq $8, %rsp\n"
+    "  stmxcsr (%rsp)\n"
+    "  fnstcw 4(%rsp)\n"
+    "  movq %rsp, (%rdi)\n"
+    "  movq %rsi, %rsp\n"
+    "  ldmxcsr (%rsp)\n"
+    "  fldcw 4(%rsp)\n"
+    "  addq $8, %rsp\n"
+    "  popq %r15\n"
+    "  popq %r14\n"
+    "  popq %r13\n"
+    "  popq %r12\n"
+    "  popq %rbx\n"
+    "  popq %rbp\n"
+    "  ret\n"
+    ".size fastSwitch, .-fastSwitch\n");
+#define pFRAME_WORDS 7 // Control words and six registers below the return address
+#else
+// x19-x28, the frame pointer, the link register and d8-d15
+__asm__(
+    ".text\n"
+    ".globl fastSwitch\n"
+    ".type fastSwitch, %function\n"
+    "fastSwitch:\n"
+    "  sub sp, sp, #160\n"
+    "  stp x19, x20, [sp, #0]\n"
+    "  stp x21, x22, [sp, #16]\n"
+    "  stp x23, x24, [sp, #32]\n"
+    "  stp x25, x26, [sp, #48]\n"
+    "  stp x27, x28, [sp, #64]\n"
+    "  stp x29, x30, [sp, #80]\n"
+    "  stp d8, d9, [sp, #96]\n"
+    "  stp d10, d11, [sp, #112]\n"
+    "  stp d12, d13, [sp, #128]\n"
+    "  stp d14, d15, [sp, #144]\n"
+    "  mov x9, sp\n"
+    "  str x9, [x0]\n"
+    "  mov sp, x1\n"
+    "  ldp x19, x20, [sp, #0]\n"
+    "  ldp x21, x22, [sp, #16]\n"
+    "  ldp x23, x24, [sp, #32]\n"
+    "  ldp x25, x26, [sp, #48]\n"
+    "  ldp x27, x28, [sp, #64]\n"
+    "  ldp x29, x30, [sp, #80]\n"
+    "  ldp d8, d9, [sp, #96]\n"
+    "  ldp d10, d11, [sp, #112]\n"
+    "  ldp d12, d13, [sp, #128]\n"
+    "  ldp d14, d15, [sp, #144]\n"
+    "  add sp, sp, #160\n"
+    "  ret\n"
+    ".size fastSwitch, .-fastSwitch\n");
+#define pFRAME_WORDS 20 // 160 bytes saved by fastSwitch
+#endif
+
+// Build the frame that the first fastSwitch to the context pops
+static void *fastMake(void *stack, size_t size, void (*entry)(void)) {
+  uintptr_t top = ((uintptr_t)stack + size) & ~(uintptr_t)15;
+  uint64_t *sp = (uint64_t *)top;
+
+#if defined(__x86_64__)
+  *--sp = 0; // Fake return address of entry, keeps the ABI stack alignment
+  *--sp = (uint64_t)(uintptr_t)entry; // Popped by ret
+  for (int i = 0; i < pFRAME_WORDS - 1; i++) {
+    *--sp = 0;
+  }
+  // Start with the control words of the creating thread
+  uint32_t mxcsr;
+  uint16_t fpucw;
+  __asm__ volatile("stmxcsr %0" : "=m"(mxcsr));
+  __asm__ volatile("fnstcw %0" : "=m"(fpucw));
+  *--sp = (uint64_t)mxcsr | ((uint64_t)fpucw << 32);
+#else
+  for (int i = 0; i < pFRAME_WORDS; i++) {
+    *--sp = 0;
+  }
+  sp[11] = (uint64_t)(uintptr_t)entry; // x30, the link register
+#endif
+  return sp;
+}
+
+#endif /* pFAST_SWITCH */
+
+// Prepare a context
+void contextMake(Context *ctx, void *stack, size_t size, void (*entry)(void), int fast) {
+#if pFAST_SWITCH
+  if (fast) {
+    ctx->sp = fastMake(stack, size, entry);
+    return;
+  }
+#endif
+  getcontext(&ctx->uc);
+  ctx->uc.uc_stack.ss_sp = stack;
+  ctx->uc.uc_stack.ss_size = size;
+  ctx->uc.uc_link = NULL;
+  makecontext(&ctx->uc, entry, 0);
+}
+
+// Save the current context and resume another one
+void contextSwitch(Context *from, Context *to, int fast) {
+#if pFAST_SWITCH
+  if (fast) {
+    fastSwitch(&from->sp, to->sp);
+    return;
+  }
+#endif
+  swapcontext(&from->uc, &to->uc);
+}
+
+int contextFastAvailable(void) {
+  return pFAST_SWITCH;
+}
@@ -0,0 +1,38 @@
+///////////////////// CONTEXT SWITCH HEADER FILE README///////////////////////
+
+//This file contains the header (`switch.h`) for the user-space context switch
+//of the M:N runtime. glibc's `swapcontext` saves the whole register file and
+//issues an `rt_sigprocmask` system call on every switch. The fast path only
+//saves the callee-saved registers and the stack pointer, which is all a
+//function call has to preserve, and never enters the kernel. It is written
+//for x86-64 and AArch64; on other machines the `ucontext_t` path is used.
+
+// FUNCTIONALITY
+// *`contextMake`: Prepare a context that starts `entry` on a new stack.
+// *`contextSwitch`: Save the current context and resume another one.
+// *`contextFastAvailable`: Whether the fast switch exists on this machine.
+
+#ifndef SWITCH_H
+#define SWITCH_H
+
+#include <stddef.h>
+#include <ucontext.h>
+
+#if defined(__x86_64__) || defined(__aarch64__)
+#define pFAST_SWITCH 1
+#else
+#define pFAST_SWITCH 0
+#endif
+
+// Structure
+typedef struct {
+  void *sp; // Saved stack pointer of the fast switch
+  ucontext_t uc; // Saved state of the ucontext fallback
+} Context;
+
+// Function prototypes
+void contextMake(Context *ctx, void *stack, size_t size, void (*entry)(void), int fast); // entry must not return
+void contextSwitch(Context *from, Context *to, int fast); // Save from, resume to
+int contextFastAvailable(void); // 1 if the fast switch is compiled in
+
+#endif /* SWITCH_H */
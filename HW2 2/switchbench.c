@@ -0,0 +1,84 @@
+/////////////////////// SWITCH BENCHMARK SOURCE FILE README/////////////////////////
+
+//This file contains a ping-pong microbenchmark (`switchbench.c`) for the
+//context switch of `switch.h`. The main context and one coroutine switch
+//back and forth, and the number of switches per second is reported for the
+//`ucontext_t` path and for the hand-written path.
+
+// Build: gcc -O2 -o switchbench switchbench.c switch.c
+
+// Command-line Options
+// * `-n`: Number of round trips (default 1000000)
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include "switch.h"
+
+#define DEFAULT_ROUND_TRIPS 1000000
+#define STACK_SIZE (64 * 1024)
+
+Context main_ctx, pong_ctx;
+int use_fast;
+
+// Coroutine that immediately switches back, forever
+void pong() {
+  for (;;) {
+    contextSwitch(&pong_ctx, &main_ctx, use_fast);
+  }
+}
+
+// Seconds of a monotonic clock
+double now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Run the ping-pong and report the switch rate
+void runBenchmark(const char *name, int fast, long round_trips) {
+  void *stack = malloc(STACK_SIZE);
+  if (stack == NULL) {
+    perror("malloc: Could not allocate stack");
+    exit(EXIT_FAILURE);
+  }
+  use_fast = fast;
+  contextMake(&pong_ctx, stack, STACK_SIZE, pong, fast);
+
+  double start = now();
+  for (long i = 0; i < round_trips; i++) {
+    contextSwitch(&main_ctx, &pong_ctx, fast);
+  }
+  double elapsed = now() - start;
+
+  long switches = 2 * round_trips;
+  printf("%-10s\t%ld switches\t%.3f s\t%.1f M switches/s\t%.1f ns/switch\n", name,
+         switches, elapsed, switches / elapsed / 1e6, elapsed * 1e9 / switches);
+  free(stack);
+}
+
+int main(int argc, char *argv[]) {
+  long round_trips = DEFAULT_ROUND_TRIPS;
+
+  // Parse command line arguments
+  int opt;
+  while ((opt = getopt(argc, argv, "n:")) != -1) {
+    switch (opt) {
+      case 'n':
+        round_trips = atol(optarg);
+        break;
+      default:
+        fprintf(stderr, "Usage: %s [-n round trips]\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+  }
+
+  runBenchmark("ucontext", 0, round_trips);
+  if (contextFastAvailable()) {
+    runBenchmark("fast", 1, round_trips);
+  } else {
+    printf("fast\t\tnot available on this machine\n");
+  }
+  return 0;
+}
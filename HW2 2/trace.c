@@ -0,0 +1,129 @@
+///////////////////// EVENT TRACE SOURCE FILE README///////////////////////
+
+//This file contains the implementation (`trace.c`) of the binary event log.
+//The buffers are allocated once by `traceOpen` and reused after every write,
+//so recording an event is a bounds check and a 16-byte store. Only the
+//writes of full buffers are serialized by a lock, since several cores may
+//flush at the same time.
+
+#include "trace.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+typedef struct {
+  TraceEvent *events;
+  int count;
+} __attribute__((aligned(64))) TraceBuffer;
+
+static TraceBuffer *buffers;
+static int nbuffers;
+static int fd = -1;
+static int failed; // A write failed, the log is incomplete
+static pthread_mutex_t write_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Write a whole block, retrying short writes
+static int writeAll(const void *data, size_t size) {
+  const char *p = data;
+  while (size > 0) {
+    ssize_t n = write(fd, p, size);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return -1;
+    }
+    p += n;
+    size -= (size_t)n;
+  }
+  return 0;
+}
+
+// Write the events of a buffer and empty it
+static void flushBuffer(TraceBuffer *buffer) {
+  pthread_mutex_lock(&write_lock);
+  if (writeAll(buffer->events, buffer->count * sizeof(TraceEvent)) != 0) {
+    failed = 1;
+  }
+  pthread_mutex_unlock(&write_lock);
+  buffer->count = 0;
+}
+
+// Create the log file
+int traceOpen(const char *path, int ncores, int64_t unit_ns) {
+  buffers = calloc(ncores, sizeof(TraceBuffer));
+  if (buffers == NULL) {
+    return -1;
+  }
+  for (int i = 0; i < ncores; i++) {
+    buffers[i].events = malloc(pTRACE_BUFFER * sizeof(TraceEvent));
+    if (buffers[i].events == NULL) {
+      nbuffers = i;
+      traceClose();
+      return -1;
+    }
+  }
+  nbuffers = ncores;
+
+  fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    traceClose();
+    return -1;
+  }
+
+  TraceHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, pTRACE_MAGIC, sizeof(header.magic));
+  header.version = pTRACE_VERSION;
+  header.event_size = sizeof(TraceEvent);
+  header.unit_ns = unit_ns;
+  failed = 0;
+  if (writeAll(&header, sizeof(header)) != 0) {
+    traceClose();
+    return -1;
+  }
+  return 0;
+}
+
+int traceEnabled(void) {
+  return fd >= 0;
+}
+
+// Record an event
+void traceEvent(int core, int type, int64_t time, int thread, int arg) {
+  if (fd < 0) {
+    return;
+  }
+  TraceBuffer *buffer = &buffers[core];
+  TraceEvent *event = &buffer->events[buffer->count];
+  event->time = time;
+  event->thread = thread;
+  event->core = (uint16_t)core;
+  event->type = (uint8_t)type;
+  event->arg = (uint8_t)arg;
+  if (++buffer->count == pTRACE_BUFFER) {
+    flushBuffer(buffer);
+  }
+}
+
+// Flush and close the log
+int traceClose(void) {
+  for (int i = 0; i < nbuffers; i++) {
+    if (fd >= 0 && buffers[i].count > 0) {
+      flushBuffer(&buffers[i]);
+    }
+    free(buffers[i].events);
+  }
+  free(buffers);
+  buffers = NULL;
+  nbuffers = 0;
+
+  if (fd >= 0 && close(fd) != 0) {
+    failed = 1;
+  }
+  fd = -1;
+  return failed ? -1 : 0;
+}
@@ -0,0 +1,59 @@
+///////////////////// EVENT TRACE HEADER FILE README///////////////////////
+
+//This file contains the header (`trace.h`) for the binary event log of a
+//scheduling run. Every scheduling event is a fixed 16-byte record that is
+//appended to a preallocated buffer; one buffer per core, so the cores never
+//share a cache line or a lock while recording. A full buffer is written to
+//the file with a single `write`, there is no stdio on the recording path.
+//`tracejson.c` converts the log to the Chrome Trace Event JSON format.
+
+// FILE FORMAT
+// *Header: `TraceHeader`, the magic "HW2TRACE" and the length of a time unit.
+// *Records: `TraceEvent` until the end of the file, in native byte order.
+//  Records of different cores are not sorted by time with respect to each
+//  other, the records of one core are.
+
+// FUNCTIONALITY
+// *`traceOpen`: Create the log file and allocate one buffer per core.
+// *`traceEnabled`: Check whether a log is being recorded.
+// *`traceEvent`: Append an event to the buffer of a core.
+// *`traceClose`: Write the remaining events and close the file.
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+
+#define trSWITCH 1 // The thread starts running on the core
+#define trYIELD 2 // The thread is put back to ready (slice end or preemption)
+#define trBLOCK 3 // The thread waits for input/output or sleeps
+#define trWAKE 4 // The thread becomes ready (arrival or end of input/output)
+#define trEXIT 5 // The thread finished
+#define trSTEAL 6 // The core took the thread from core `arg`
+#define pTRACE_MAGIC "HW2TRACE"
+#define pTRACE_VERSION 1
+#define pTRACE_BUFFER 16384 // Events kept by every core before a write
+
+// Structure
+typedef struct {
+  char magic[8];
+  uint32_t version;
+  uint32_t event_size; // sizeof(TraceEvent)
+  int64_t unit_ns; // Length of one time unit of the records
+} TraceHeader;
+
+typedef struct {
+  int64_t time; // Time units since an arbitrary origin
+  int32_t thread; // Thread ID
+  uint16_t core; // Core that recorded the event
+  uint8_t type; // trSWITCH ... trSTEAL
+  uint8_t arg; // Victim core of trSTEAL
+} TraceEvent;
+
+// Function prototypes
+int traceOpen(const char *path, int ncores, int64_t unit_ns); // -1 on error
+int traceEnabled(void); // 1 while a log is open
+void traceEvent(int core, int type, int64_t time, int thread, int arg); // Record an event
+int traceClose(void); // Flush and close, -1 if a write failed
+
+#endif /* TRACE_H */
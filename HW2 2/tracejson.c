@@ -0,0 +1,239 @@
+/////////////////////// TRACE CONVERTER SOURCE FILE README/////////////////////////
+
+//This file contains the converter (`tracejson.c`) from the binary event log
+//of `trace.h` to the Chrome Trace Event JSON format, which can be opened in
+//chrome://tracing or https://ui.perfetto.dev. The events are sorted by time
+//and turned into:
+// *`cores`: One row per core with a slice for every time a thread ran.
+// *`threads`: One row per thread with its `ready` (waiting for a core) and
+//  `blocked` (input/output) intervals, so long waits stand out.
+//A summary with the longest ready wait is printed to the standard error.
+
+// Build: gcc -O2 -o tracejson tracejson.c
+
+// Usage: ./tracejson trace.bin [trace.json]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "trace.h"
+
+// State of a thread while the events are replayed
+typedef struct {
+  int64_t run_start; // Start of the running slice, -1 if not running
+  int run_core;
+  int64_t ready_start; // Start of the ready interval, -1 if not ready
+  int64_t block_start; // Start of the blocked interval, -1 if not blocked
+} ThreadTrack;
+
+TraceEvent *events;
+long long nevents;
+ThreadTrack *tracks;
+int ntracks;
+double unit_us; // Length of one time unit in microseconds
+int64_t origin; // Time of the first event
+FILE *out;
+int first_record = 1;
+
+// Order by time, the position in the file breaks ties
+int compareEvent(const void *a, const void *b) {
+  const TraceEvent *x = &events[*(const long long *)a];
+  const TraceEvent *y = &events[*(const long long *)b];
+  if (x->time != y->time) {
+    return x->time < y->time ? -1 : 1;
+  }
+  long long i = *(const long long *)a;
+  long long j = *(const long long *)b;
+  return (i > j) - (i < j);
+}
+
+// Read the whole log
+void readTrace(const char *path) {
+  FILE *fp = fopen(path, "rb");
+  if (fp == NULL) {
+    perror(path);
+    exit(EXIT_FAILURE);
+  }
+
+  TraceHeader header;
+  if (fread(&header, sizeof(header), 1, fp) != 1 ||
+      memcmp(header.magic, pTRACE_MAGIC, sizeof(header.magic)) != 0) {
+    fprintf(stderr, "%s: not a scheduler trace\n", path);
+    exit(EXIT_FAILURE);
+  }
+  if (header.version != pTRACE_VERSION || header.event_size != sizeof(TraceEvent)) {
+    fprintf(stderr, "%s: unsupported trace version %u\n", path, header.version);
+    exit(EXIT_FAILURE);
+  }
+  unit_us = header.unit_ns / 1000.0;
+
+  long long capacity = 0;
+  for (;;) {
+    if (nevents == capacity) {
+      capacity = capacity > 0 ? capacity * 2 : 65536;
+      events = realloc(events, capacity * sizeof(TraceEvent));
+      if (events == NULL) {
+        perror("Could not allocate the events");
+        exit(EXIT_FAILURE);
+      }
+    }
+    size_t n = fread(&events[nevents], sizeof(TraceEvent), capacity - nevents, fp);
+    nevents += n;
+    if (n == 0) {
+      break;
+    }
+  }
+  if (ferror(fp)) {
+    perror(path);
+    exit(EXIT_FAILURE);
+  }
+  fclose(fp);
+}
+
+// Track of a thread, grown on demand
+ThreadTrack *track(int thread) {
+  if (thread >= ntracks) {
+    int count = ntracks > 0 ? ntracks : 64;
+    while (count <= thread) {
+      count *= 2;
+    }
+    tracks = realloc(tracks, count * sizeof(ThreadTrack));
+    if (tracks == NULL) {
+      perror("Could not allocate the threads");
+      exit(EXIT_FAILURE);
+    }
+    for (int i = ntracks; i < count; i++) {
+      tracks[i].run_start = -1;
+      tracks[i].ready_start = -1;
+      tracks[i].block_start = -1;
+    }
+    ntracks = count;
+  }
+  return &tracks[thread];
+}
+
+// Start a new record of the traceEvents array
+void beginRecord() {
+  fputs(first_record ? "\n" : ",\n", out);
+  first_record = 0;
+}
+
+// Complete event (a slice with a duration)
+void slice(const char *category, int pid, int tid, int thread, const char *name,
+           int64_t start, int64_t end, const char *end_reason) {
+  beginRecord();
+  fprintf(out, "{\"name\":\"%s%s%d\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%d",
+          name, name[0] != '\0' ? " T" : "T", thread, category,
+          (start - origin) * unit_us, (end - start) * unit_us, pid, tid);
+  if (end_reason != NULL) {
+    fprintf(out, ",\"args\":{\"end\":\"%s\"}", end_reason);
+  }
+  fputs("}", out);
+}
+
+// End the running slice of a thread
+void endRun(const TraceEvent *e, ThreadTrack *t, const char *reason) {
+  if (t->run_start >= 0) {
+    slice("run", 1, t->run_core, e->thread, "", t->run_start, e->time, reason);
+    t->run_start = -1;
+  }
+}
+
+int main(int argc, char *argv[]) {
+  if (argc < 2 || argc > 3) {
+    fprintf(stderr, "Usage: %s trace.bin [trace.json]\n", argv[0]);
+    exit(EXIT_FAILURE);
+  }
+  readTrace(argv[1]);
+
+  out = stdout;
+  if (argc == 3 && (out = fopen(argv[2], "w")) == NULL) {
+    perror(argv[2]);
+    exit(EXIT_FAILURE);
+  }
+
+  // Records of different cores are interleaved, sort them by time
+  long long *order = malloc((nevents > 0 ? nevents : 1) * sizeof(long long));
+  if (order == NULL) {
+    perror("Could not allocate the events");
+    exit(EXIT_FAILURE);
+  }
+  for (long long i = 0; i < nevents; i++) {
+    order[i] = i;
+  }
+  qsort(order, nevents, sizeof(long long), compareEvent);
+  origin = nevents > 0 ? events[order[0]].time : 0;
+
+  fputs("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[", out);
+  beginRecord();
+  fputs("{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"cores\"}}", out);
+  beginRecord();
+  fputs("{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":2,\"args\":{\"name\":\"threads\"}}", out);
+
+  int64_t worst_wait = -1;
+  int worst_thread = -1;
+  int64_t worst_time = 0;
+
+  for (long long k = 0; k < nevents; k++) {
+    const TraceEvent *e = &events[order[k]];
+    ThreadTrack *t = track(e->thread);
+
+    switch (e->type) {
+      case trSWITCH:
+        if (t->ready_start >= 0 && e->time > t->ready_start) {
+          slice("wait", 2, e->thread, e->thread, "ready", t->ready_start, e->time, NULL);
+          if (e->time - t->ready_start > worst_wait) {
+            worst_wait = e->time - t->ready_start;
+            worst_thread = e->thread;
+            worst_time = t->ready_start;
+          }
+        }
+        t->ready_start = -1;
+        t->run_start = e->time;
+        t->run_core = e->core;
+        break;
+      case trYIELD:
+        endRun(e, t, "yield");
+        t->ready_start = e->time;
+        break;
+      case trBLOCK:
+        endRun(e, t, "block");
+        t->block_start = e->time;
+        break;
+      case trWAKE:
+        if (t->block_start >= 0) {
+          slice("wait", 2, e->thread, e->thread, "blocked", t->block_start, e->time, NULL);
+          t->block_start = -1;
+        }
+        t->ready_start = e->time;
+        break;
+      case trEXIT:
+        endRun(e, t, "exit");
+        break;
+      case trSTEAL:
+        beginRecord();
+        fprintf(out, "{\"name\":\"steal T%d from core %d\",\"cat\":\"steal\",\"ph\":\"i\",\"s\":\"t\",\"ts\":%.3f,\"pid\":1,\"tid\":%d}",
+                e->thread, e->arg, (e->time - origin) * unit_us, e->core);
+        break;
+      default:
+        fprintf(stderr, "Unknown event type %d\n", e->type);
+        break;
+    }
+  }
+  fputs("\n]}\n", out);
+
+  if (ferror(out) || (out != stdout && fclose(out) != 0)) {
+    perror("Could not write the JSON trace");
+    exit(EXIT_FAILURE);
+  }
+
+  fprintf(stderr, "%lld events\n", nevents);
+  if (worst_thread >= 0) {
+    fprintf(stderr, "Longest ready wait: T%d, %.3f us from %.3f us\n", worst_thread,
+            worst_wait * unit_us, (worst_time - origin) * unit_us);
+  }
+  free(order);
+  free(events);
+  free(tracks);
+  return 0;
+}
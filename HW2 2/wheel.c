@@ -0,0 +1,148 @@
+///////////////////// TIMER WHEEL SOURCE FILE README///////////////////////
+
+//This file contains the implementation (`wheel.c`) of the hierarchical timer
+//wheel. A timer due within pWHEEL_SLOTS ticks sits in the slot of its tick
+//on level 0; a later one sits on the level whose slots are wide enough, in
+//the slot of the matching bits of its tick. When the low bits of the clock
+//wrap to zero, the next slot of the level above is emptied and its timers
+//are linked again, one level lower, so every timer moves down at most
+//pWHEEL_LEVELS - 1 times before it expires.
+
+#include "wheel.h"
+#include <string.h>
+
+#define pWHEEL_MASK (pWHEEL_SLOTS - 1)
+#define pWHEEL_RANGE (1ULL << (pWHEEL_BITS * pWHEEL_LEVELS)) // Ticks covered by the levels
+
+// Initialize an empty wheel
+void wheelInit(Wheel *wheel, unsigned long long now) {
+  memset(wheel, 0, sizeof(Wheel));
+  wheel->now = now;
+}
+
+// Put a timer in the slot of its tick, relative to the clock
+static void linkTimer(Wheel *wheel, TimerNode *timer) {
+  unsigned long long tick = timer->expires;
+  int level = 0;
+  if (tick < wheel->now) {
+    tick = wheel->now; // Late, expires on the next tick processed
+  } else if (tick - wheel->now >= pWHEEL_RANGE) {
+    tick = wheel->now + pWHEEL_RANGE - 1; // Parked in the last level until it comes closer
+  }
+  while (level < pWHEEL_LEVELS - 1 && tick - wheel->now >= 1ULL << (pWHEEL_BITS * (level + 1))) {
+    level++;
+  }
+  TimerNode **slot = &wheel->slots[level][(tick >> (pWHEEL_BITS * level)) & pWHEEL_MASK];
+  timer->next = *slot;
+  if (timer->next != NULL) {
+    timer->next->pprev = &timer->next;
+  }
+  timer->pprev = slot;
+  *slot = timer;
+  timer->level = level;
+  wheel->counts[level]++;
+}
+
+// Arm a timer
+void wheelAdd(Wheel *wheel, TimerNode *timer, unsigned long long expires) {
+  timer->expires = expires;
+  linkTimer(wheel, timer);
+  wheel->count++;
+}
+
+// Disarm a timer
+int wheelCancel(Wheel *wheel, TimerNode *timer) {
+  if (timer->pprev == NULL) {
+    return 0;
+  }
+  *timer->pprev = timer->next;
+  if (timer->next != NULL) {
+    timer->next->pprev = timer->pprev;
+  }
+  timer->pprev = NULL;
+  wheel->counts[timer->level]--;
+  wheel->count--;
+  return 1;
+}
+
+int wheelArmed(const TimerNode *timer) {
+  return timer->pprev != NULL;
+}
+
+// Move the timers of a slot one level down (or more)
+static void cascade(Wheel *wheel, int level, int index) {
+  TimerNode *timer = wheel->slots[level][index];
+  wheel->slots[level][index] = NULL;
+  while (timer != NULL) {
+    TimerNode *next = timer->next;
+    wheel->counts[level]--;
+    linkTimer(wheel, timer);
+    timer = next;
+  }
+}
+
+// Process the ticks up to `to` and return the expired timers in tick order
+TimerNode *wheelAdvance(Wheel *wheel, unsigned long long to) {
+  TimerNode *expired = NULL;
+  TimerNode **tail = &expired;
+  while (wheel->now <= to) {
+    int index = wheel->now & pWHEEL_MASK;
+    if (wheel->count == 0) {
+      wheel->now = to + 1;
+      break;
+    }
+    // Nothing due on level 0 before the next cascade
+    if (index != 0 && wheel->counts[0] == 0) {
+      unsigned long long boundary = (wheel->now | pWHEEL_MASK) + 1;
+      wheel->now = boundary <= to ? boundary : to + 1;
+      continue;
+    }
+    if (index == 0) {
+      for (int level = 1; level < pWHEEL_LEVELS; level++) {
+        int upper = (wheel->now >> (pWHEEL_BITS * level)) & pWHEEL_MASK;
+        cascade(wheel, level, upper);
+        if (upper != 0) {
+          break;
+        }
+      }
+    }
+
+    TimerNode *timer = wheel->slots[0][index];
+    wheel->slots[0][index] = NULL;
+    while (timer != NULL) {
+      TimerNode *next = timer->next;
+      timer->pprev = NULL;
+      wheel->counts[0]--;
+      wheel->count--;
+      *tail = timer;
+      tail = &timer->next;
+      timer = next;
+    }
+    wheel->now++;
+  }
+  *tail = NULL;
+  return expired;
+}
+
+// Earliest tick at which a timer may expire
+unsigned long long wheelNext(const Wheel *wheel) {
+  unsigned long long next = ~0ULL;
+  if (wheel->counts[0] > 0) {
+    for (int k = 0; k < pWHEEL_SLOTS; k++) {
+      if (wheel->slots[0][(wheel->now + k) & pWHEEL_MASK] != NULL) {
+        next = wheel->now + k;
+        break;
+      }
+    }
+  }
+  // A cascade may bring a timer of an upper level closer than the level 0
+  // ones; every cascade falls on a level 1 boundary, still to come if the
+  // clock is on one
+  if (wheel->count > wheel->counts[0]) {
+    unsigned long long boundary = (wheel->now + pWHEEL_MASK) & ~(unsigned long long)pWHEEL_MASK;
+    if (boundary < next) {
+      next = boundary;
+    }
+  }
+  return next;
+}
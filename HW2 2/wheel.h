@@ -0,0 +1,57 @@
+///////////////////// TIMER WHEEL HEADER FILE README///////////////////////
+
+//This file contains the header (`wheel.h`) for a hierarchical hashed timer
+//wheel. Timers are intrusive nodes on doubly linked slot lists, so adding
+//and cancelling a timer are O(1) whatever the number of timers; advancing
+//the clock only visits the slots of the ticks that pass, plus a cascade of
+//the next level every pWHEEL_SLOTS ticks. It replaces the lists of sleepers
+//and I/O countdowns that were rescanned on every tick.
+
+// FUNCTIONALITY
+// *`wheelInit`: Initialize an empty wheel starting at a tick.
+// *`wheelAdd`: Arm a timer for an absolute tick.
+// *`wheelCancel`: Disarm a timer if it is armed.
+// *`wheelAdvance`: Move the clock and return the timers that expired.
+// *`wheelNext`: Earliest tick at which a timer may expire.
+
+//Helped from Varghese, G., & Lauck, T. (1987). Hashed and hierarchical
+//timing wheels: data structures for the efficient implementation of a timer
+//facility.
+
+#ifndef WHEEL_H
+#define WHEEL_H
+
+#include <stddef.h>
+
+#define pWHEEL_BITS 6
+#define pWHEEL_SLOTS (1 << pWHEEL_BITS) // Slots of every level
+#define pWHEEL_LEVELS 5 // 2^30 ticks ahead, later timers wait in the last level
+
+// Get the enclosing structure of an embedded timer
+#define wheelEntry(ptr, type, member) \
+  ((type *)((char *)(ptr) - offsetof(type, member)))
+
+// Structure
+typedef struct TimerNode {
+  struct TimerNode *next; // Slot list, then the list of expired timers
+  struct TimerNode **pprev; // Link pointing to this node, NULL if not armed
+  unsigned long long expires; // Absolute tick
+  int level; // Level of the slot that holds it
+} TimerNode;
+
+typedef struct {
+  TimerNode *slots[pWHEEL_LEVELS][pWHEEL_SLOTS];
+  int counts[pWHEEL_LEVELS]; // Timers in every level
+  unsigned long long now; // Next tick to process
+  int count; // Armed timers
+} Wheel;
+
+// Function prototypes
+void wheelInit(Wheel *wheel, unsigned long long now); // Empty wheel at tick now
+void wheelAdd(Wheel *wheel, TimerNode *timer, unsigned long long expires); // A past tick expires on the next advance
+int wheelCancel(Wheel *wheel, TimerNode *timer); // 1 if it was armed
+TimerNode *wheelAdvance(Wheel *wheel, unsigned long long to); // Timers due up to tick to, linked by next
+unsigned long long wheelNext(const Wheel *wheel); // Lower bound of the next expiry, all ones if none
+int wheelArmed(const TimerNode *timer); // 1 if armed
+
+#endif /* WHEEL_H */
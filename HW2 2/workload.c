@@ -0,0 +1,355 @@
+///////////////////// WORKLOAD SOURCE FILE README///////////////////////
+
+//This file contains the implementation (`workload.c`) of the workload parser.
+//The input is read in fixed 64 KB blocks and tokenized by a small state
+//machine, so lines may be arbitrarily long and the memory used is only the
+//parsed bursts themselves. Two kinds of lines are accepted:
+// *`c1 c2 i1 i2`: The original four-column format (CPU1 CPU2 IO1 IO2).
+// *`T arrival tickets b1 b2 ... bn`: Any number of alternating bursts.
+// *`C funding`: A new currency worth funding base tickets. The threads of the
+//  following lines hold their tickets in it.
+//Everything after a `#` up to the end of the line is a comment.
+//The generator draws from a splitmix64 sequence instead of rand(), whose
+//period and range differ between C libraries.
+
+#include "workload.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define pREAD_BLOCK (64 * 1024)
+#define lLEGACY 0 // Kinds of lines
+#define lTHREAD 1
+#define lCURRENCY 2
+
+// Append a burst
+static int pushBurst(Workload *workload, int value) {
+  if (workload->nbursts == workload->burst_capacity) {
+    long long capacity = workload->burst_capacity > 0 ? workload->burst_capacity * 2 : 1024;
+    int *bursts = realloc(workload->bursts, capacity * sizeof(int));
+    if (bursts == NULL) {
+      return -1;
+    }
+    workload->bursts = bursts;
+    workload->burst_capacity = capacity;
+  }
+  workload->bursts[workload->nbursts++] = value;
+  return 0;
+}
+
+// Append a thread
+static int pushThread(Workload *workload, WorkloadThread *thread) {
+  if (workload->nthreads == workload->thread_capacity) {
+    int capacity = workload->thread_capacity > 0 ? workload->thread_capacity * 2 : 16;
+    WorkloadThread *threads = realloc(workload->threads, capacity * sizeof(WorkloadThread));
+    if (threads == NULL) {
+      return -1;
+    }
+    workload->threads = threads;
+    workload->thread_capacity = capacity;
+  }
+  workload->threads[workload->nthreads++] = *thread;
+  return 0;
+}
+
+// Start a currency, the threads that follow are funded by it
+static int pushCurrency(Workload *workload, int funding) {
+  int *array = realloc(workload->funding, (workload->ncurrencies + 1) * sizeof(int));
+  if (array == NULL) {
+    return -1;
+  }
+  workload->funding = array;
+  workload->funding[workload->ncurrencies++] = funding;
+  return 0;
+}
+
+// Finish the current line, returns -1 if it is malformed
+static int endLine(Workload *workload, int kind, long long first, long long count,
+                   const char *name, long long line) {
+  WorkloadThread thread;
+
+  if (kind == lLEGACY && count == 0) {
+    return 0; // Empty or comment line
+  }
+
+  if (kind == lCURRENCY) {
+    if (count != 1 || workload->bursts[first] <= 0) {
+      fprintf(stderr, "%s:%lld: expected C funding (> 0)\n", name, line);
+      return -1;
+    }
+    workload->nbursts--;
+    return pushCurrency(workload, workload->bursts[first]);
+  }
+
+  if (kind == lTHREAD) {
+    if (count < 3) {
+      fprintf(stderr, "%s:%lld: expected T arrival tickets bursts...\n", name, line);
+      return -1;
+    }
+    // The first two numbers are not bursts, move the bursts over them
+    thread.arrival = workload->bursts[first];
+    thread.tickets = workload->bursts[first + 1];
+    memmove(&workload->bursts[first], &workload->bursts[first + 2], (count - 2) * sizeof(int));
+    workload->nbursts -= 2;
+    count -= 2;
+  } else {
+    if (count != 4) {
+      fprintf(stderr, "%s:%lld: expected CPU1 CPU2 IO1 IO2\n", name, line);
+      return -1;
+    }
+    // CPU1 CPU2 IO1 IO2 becomes CPU1 IO1 CPU2 IO2
+    int cpu2 = workload->bursts[first + 1];
+    workload->bursts[first + 1] = workload->bursts[first + 2];
+    workload->bursts[first + 2] = cpu2;
+    thread.arrival = 0;
+    thread.tickets = 0;
+  }
+
+  if (count > 0x7fffffff) {
+    fprintf(stderr, "%s:%lld: too many bursts\n", name, line);
+    return -1;
+  }
+  thread.first = first;
+  thread.nbursts = (int)count;
+  thread.currency = workload->ncurrencies - 1;
+  return pushThread(workload, &thread);
+}
+
+// Parse a workload from a stream
+int workloadParse(Workload *workload, FILE *fp, const char *name) {
+  memset(workload, 0, sizeof(Workload));
+  if (pushCurrency(workload, 0) != 0) {
+    return -1;
+  }
+
+  char *block = malloc(pREAD_BLOCK);
+  if (block == NULL) {
+    return -1;
+  }
+
+  long long line = 1;
+  long long first = 0; // First number of the current line
+  int kind = lLEGACY; // lTHREAD if the line started with T, lCURRENCY with C
+  int comment = 0; // Inside a comment
+  int in_number = 0;
+  long long value = 0;
+  int line_start = 1; // Nothing but blanks seen on this line
+  int error = 0;
+  size_t n;
+
+  while (!error && (n = fread(block, 1, pREAD_BLOCK, fp)) > 0) {
+    for (size_t i = 0; i < n && !error; i++) {
+      char c = block[i];
+
+      if (c >= '0' && c <= '9' && !comment) {
+        value = value * 10 + (c - '0');
+        if (value > 0x7fffffff) {
+          fprintf(stderr, "%s:%lld: number too large\n", name, line);
+          error = 1;
+        }
+        in_number = 1;
+        line_start = 0;
+        continue;
+      }
+
+      // Any other character ends a number
+      if (in_number) {
+        error = pushBurst(workload, (int)value) != 0;
+        in_number = 0;
+        value = 0;
+      }
+
+      if (c == '\n') {
+        error = error || endLine(workload, kind, first, workload->nbursts - first, name, line) != 0;
+        first = workload->nbursts;
+        kind = lLEGACY;
+        comment = 0;
+        line_start = 1;
+        line++;
+      } else if (comment || c == ' ' || c == '\t' || c == '\r') {
+        continue;
+      } else if (c == '#') {
+        comment = 1;
+      } else if ((c == 'T' || c == 'C') && line_start) {
+        kind = c == 'T' ? lTHREAD : lCURRENCY;
+        line_start = 0;
+      } else {
+        fprintf(stderr, "%s:%lld: unexpected character '%c'\n", name, line, c);
+        error = 1;
+      }
+    }
+  }
+  free(block);
+
+  // Last line without a newline
+  if (!error && in_number) {
+    error = pushBurst(workload, (int)value) != 0;
+  }
+  if (!error) {
+    error = endLine(workload, kind, first, workload->nbursts - first, name, line) != 0;
+  }
+  if (!error && ferror(fp)) {
+    perror(name);
+    error = 1;
+  }
+
+  if (error) {
+    workloadDestroy(workload);
+    return -1;
+  }
+  return 0;
+}
+
+// Parse a workload file
+int workloadLoad(Workload *workload, const char *path) {
+  if (strcmp(path, "-") == 0) {
+    return workloadParse(workload, stdin, "stdin");
+  }
+  FILE *fp = fopen(path, "r");
+  if (fp == NULL) {
+    perror(path);
+    return -1;
+  }
+  int result = workloadParse(workload, fp, path);
+  fclose(fp);
+  return result;
+}
+
+// Bursts of a thread
+int *workloadBursts(const Workload *workload, int thread) {
+  return &workload->bursts[workload->threads[thread].first];
+}
+
+// Sum of the bursts of a thread
+long long workloadTotal(const Workload *workload, int thread) {
+  int *bursts = workloadBursts(workload, thread);
+  long long total = 0;
+  for (int j = 0; j < workload->threads[thread].nbursts; j++) {
+    total += bursts[j];
+  }
+  return total;
+}
+
+// %%%%%%%%%%%%%%%%%%%%%% Generator %%%%%%%%%%%%%%%%%%%%%%
+
+// Parse a distribution
+int workloadParseDist(const char *text, WorkloadDist *dist) {
+  char name[16];
+  int n;
+  dist->a = dist->b = dist->p = 0;
+  if (sscanf(text, "%15[a-z]:%n", name, &n) != 1) {
+    return -1;
+  }
+  text += n;
+  if (strcmp(name, "fixed") == 0) {
+    dist->kind = dFIXED;
+    return sscanf(text, "%lf", &dist->a) == 1 && dist->a >= 0 ? 0 : -1;
+  }
+  if (strcmp(name, "exp") == 0) {
+    dist->kind = dEXP;
+    return sscanf(text, "%lf", &dist->a) == 1 && dist->a >= 0 ? 0 : -1;
+  }
+  if (strcmp(name, "pareto") == 0) {
+    dist->kind = dPARETO;
+    return sscanf(text, "%lf:%lf", &dist->a, &dist->b) == 2 && dist->a > 0 && dist->b >= 0 ? 0 : -1;
+  }
+  if (strcmp(name, "bimodal") == 0) {
+    dist->kind = dBIMODAL;
+    return sscanf(text, "%lf:%lf:%lf", &dist->a, &dist->b, &dist->p) == 3 && dist->a >= 0 &&
+           dist->b >= 0 && dist->p >= 0 && dist->p <= 1 ? 0 : -1;
+  }
+  return -1;
+}
+
+// Uniform in [0, 1)
+static double uniform(unsigned long long *state) {
+  unsigned long long z = (*state += 0x9e3779b97f4a7c15ULL);
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+  z ^= z >> 31;
+  return (z >> 11) * (1.0 / 9007199254740992.0);
+}
+
+// Draw a sample, capped so that the sums of the bursts of a thread stay small
+static double sample(const WorkloadDist *dist, unsigned long long *state) {
+  double u = uniform(state);
+  double x;
+  switch (dist->kind) {
+    case dEXP:
+      x = -dist->a * log(1 - u);
+      break;
+    case dPARETO:
+      x = dist->b / pow(1 - u, 1 / dist->a);
+      break;
+    case dBIMODAL:
+      x = u < dist->p ? dist->a : dist->b;
+      break;
+    default:
+      x = dist->a;
+  }
+  return x < pMAX_SAMPLE ? x : pMAX_SAMPLE;
+}
+
+// Burst of at least one time unit
+static int burst(const WorkloadDist *dist, unsigned long long *state) {
+  int x = (int)(sample(dist, state) + 0.5);
+  return x > 0 ? x : 1;
+}
+
+// Generate a synthetic workload
+int workloadGenerate(Workload *workload, const WorkloadSpec *spec) {
+  memset(workload, 0, sizeof(Workload));
+  int per_thread = spec->ncpu > 0 ? 2 * spec->ncpu - 1 : 0;
+  workload->threads = malloc((spec->nthreads > 0 ? spec->nthreads : 1) * sizeof(WorkloadThread));
+  workload->bursts = malloc(((long long)spec->nthreads * per_thread + 1) * sizeof(int));
+  if (workload->threads == NULL || workload->bursts == NULL || pushCurrency(workload, 0) != 0) {
+    workloadDestroy(workload);
+    return -1;
+  }
+  workload->thread_capacity = spec->nthreads;
+  workload->burst_capacity = (long long)spec->nthreads * per_thread + 1;
+
+  unsigned long long state = spec->seed;
+  double arrival = 0;
+  for (int i = 0; i < spec->nthreads; i++) {
+    WorkloadThread *thread = &workload->threads[workload->nthreads++];
+    thread->arrival = arrival < 0x7fffffff ? (int)arrival : 0x7fffffff;
+    thread->tickets = spec->tickets;
+    thread->currency = 0;
+    thread->first = workload->nbursts;
+    thread->nbursts = per_thread;
+    for (int j = 0; j < per_thread; j++) {
+      workload->bursts[workload->nbursts++] = burst(j % 2 == 0 ? &spec->cpu : &spec->io, &state);
+    }
+    arrival += sample(&spec->arrival, &state);
+  }
+  return 0;
+}
+
+// Write a workload in the extended format
+int workloadWrite(const Workload *workload, FILE *fp) {
+  int currency = 0;
+  for (int i = 0; i < workload->nthreads; i++) {
+    const WorkloadThread *thread = &workload->threads[i];
+    // Every thread after a C line is in that currency
+    while (currency < thread->currency) {
+      currency++;
+      fprintf(fp, "C %d\n", workload->funding[currency]);
+    }
+    fprintf(fp, "T %d %d", thread->arrival, thread->tickets);
+    int *bursts = workloadBursts(workload, i);
+    for (int j = 0; j < thread->nbursts; j++) {
+      fprintf(fp, " %d", bursts[j]);
+    }
+    fputc('\n', fp);
+  }
+  return fflush(fp) == 0 && !ferror(fp) ? 0 : -1;
+}
+
+// Release the memory
+void workloadDestroy(Workload *workload) {
+  free(workload->threads);
+  free(workload->bursts);
+  free(workload->funding);
+  memset(workload, 0, sizeof(Workload));
+}
@@ -0,0 +1,82 @@
+///////////////////// WORKLOAD HEADER FILE README///////////////////////
+
+//This file contains the header (`workload.h`) for the workload of the
+//scheduler. A workload is a list of threads; every thread has an arrival
+//time, a ticket weight and an arbitrary long sequence of bursts that
+//alternates CPU and I/O, starting with CPU. All bursts of all threads are
+//stored in one array so that traces with millions of bursts stay compact.
+//Threads may be grouped in ticket currencies: a currency is funded with a
+//number of base tickets, and the tickets of its threads only divide that
+//funding among them (see the lottery policy).
+//The format is described in InputFormat.txt.
+//Workloads can also be generated: bursts and inter-arrival times are drawn
+//from exponential, Pareto or bimodal distributions with a private generator,
+//so the same seed gives the same workload on every machine.
+
+// FUNCTIONALITY
+// *`workloadLoad`: Parse a workload file ("-" is the standard input).
+// *`workloadParse`: Parse a workload from an open stream in a single pass.
+// *`workloadBursts`: Bursts of one thread.
+// *`workloadParseDist`: Parse a distribution such as `exp:10`.
+// *`workloadGenerate`: Generate a synthetic workload.
+// *`workloadWrite`: Write a workload in the extended format.
+// *`workloadDestroy`: Release the allocated memory.
+
+#ifndef WORKLOAD_H
+#define WORKLOAD_H
+
+#include <stdio.h>
+
+#define dFIXED 0 // Distributions
+#define dEXP 1
+#define dPARETO 2
+#define dBIMODAL 3
+#define pMAX_SAMPLE 1000000 // Upper bound of a generated burst
+
+// Structure
+typedef struct {
+  int arrival; // Arrival time
+  int tickets; // Ticket weight, 0 if it is derived from the bursts
+  int currency; // Currency of the tickets, 0 for the base currency
+  long long first; // Index of the first burst in the burst array
+  int nbursts; // CPU, I/O, CPU, I/O, ...
+} WorkloadThread;
+
+typedef struct {
+  WorkloadThread *threads;
+  int nthreads;
+  int thread_capacity;
+  int *bursts; // Bursts of every thread, one after the other
+  long long nbursts;
+  long long burst_capacity;
+  int *funding; // Base tickets of every currency, funding[0] is unused
+  int ncurrencies; // Including the base currency
+} Workload;
+
+typedef struct {
+  int kind; // dFIXED, dEXP, dPARETO or dBIMODAL
+  double a; // Value, mean, shape (alpha) or short mode
+  double b; // Pareto minimum or long mode
+  double p; // Probability of the short mode
+} WorkloadDist;
+
+typedef struct {
+  int nthreads;
+  int ncpu; // CPU bursts per thread, with an I/O burst between two of them
+  WorkloadDist cpu, io;
+  WorkloadDist arrival; // Time between two arrivals
+  int tickets; // Tickets of every thread, 0 to derive them from the bursts
+  unsigned long long seed;
+} WorkloadSpec;
+
+// Function prototypes
+int workloadLoad(Workload *workload, const char *path); // -1 on error
+int workloadParse(Workload *workload, FILE *fp, const char *name); // -1 on error
+int *workloadBursts(const Workload *workload, int thread); // Bursts of a thread
+long long workloadTotal(const Workload *workload, int thread); // Sum of the bursts of a thread
+int workloadParseDist(const char *text, WorkloadDist *dist); // fixed:v exp:mean pareto:alpha:min bimodal:short:long:p, -1 if malformed
+int workloadGenerate(Workload *workload, const WorkloadSpec *spec); // -1 if out of memory
+int workloadWrite(const Workload *workload, FILE *fp); // -1 on write error
+void workloadDestroy(Workload *workload); // Release the memory
+
+#endif /* WORKLOAD_H */
@@ -0,0 +1,106 @@
+/////////////////////// WORKLOAD GENERATOR SOURCE FILE README/////////////////////////
+
+//This file contains a generator (`workloadgen.c`) of synthetic workloads for
+//the scheduler. Every thread gets a number of CPU bursts with an I/O burst
+//between two of them, drawn from the given distributions, and arrives after
+//the previous one by a drawn inter-arrival time. The output is in the
+//extended format of InputFormat.txt, so it can be piped to the scheduler:
+//  ./workloadgen -n 1000 -c pareto:1.5:2 | ./scheduler -i - -q
+
+// Build: gcc -O2 -o workloadgen workloadgen.c workload.c -lm
+
+// Command-line Options
+// * `-n`: Number of threads (default 100)
+// * `-b`: CPU bursts of every thread (default 2)
+// * `-c`: CPU burst distribution (default exp:10)
+// * `-i`: I/O burst distribution (default exp:5)
+// * `-a`: Inter-arrival time distribution (default exp:5)
+// * `-t`: Tickets of every thread, 0 to derive them from the bursts (default 0)
+// * `-s`: Seed (default 1)
+// * `-o`: Output file (default standard output)
+
+// Distributions
+// * `fixed:v`: Always v.
+// * `exp:mean`: Exponential with the given mean.
+// * `pareto:alpha:min`: Pareto with shape alpha and minimum min, heavy tailed
+//  for small alpha.
+// * `bimodal:short:long:p`: short with probability p, long otherwise.
+// Bursts are rounded to at least one time unit and capped at pMAX_SAMPLE.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "workload.h"
+
+// Parse a distribution option or exit
+void parseDist(const char *text, WorkloadDist *dist) {
+  if (workloadParseDist(text, dist) != 0) {
+    fprintf(stderr, "Bad distribution: %s (expected fixed:v, exp:mean, pareto:alpha:min or bimodal:short:long:p)\n", text);
+    exit(EXIT_FAILURE);
+  }
+}
+
+int main(int argc, char *argv[]) {
+  WorkloadSpec spec = {100, 2, {dEXP, 10, 0, 0}, {dEXP, 5, 0, 0}, {dEXP, 5, 0, 0}, 0, 1};
+  const char *output = NULL;
+
+  // Parse command line arguments
+  int opt;
+  while ((opt = getopt(argc, argv, "n:b:c:i:a:t:s:o:")) != -1) {
+    switch (opt) {
+      case 'n':
+        spec.nthreads = atoi(optarg);
+        break;
+      case 'b':
+        spec.ncpu = atoi(optarg);
+        break;
+      case 'c':
+        parseDist(optarg, &spec.cpu);
+        break;
+      case 'i':
+        parseDist(optarg, &spec.io);
+        break;
+      case 'a':
+        parseDist(optarg, &spec.arrival);
+        break;
+      case 't':
+        spec.tickets = atoi(optarg);
+        break;
+      case 's':
+        spec.seed = strtoull(optarg, NULL, 10);
+        break;
+      case 'o':
+        output = optarg;
+        break;
+      default:
+        fprintf(stderr, "Usage: %s [-n threads] [-b CPU bursts] [-c dist] [-i dist] [-a dist] [-t tickets] [-s seed] [-o output]\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+  }
+  if (spec.nthreads < 1 || spec.ncpu < 1 || spec.tickets < 0) {
+    fprintf(stderr, "At least one thread with one CPU burst is needed\n");
+    exit(EXIT_FAILURE);
+  }
+
+  Workload workload;
+  if (workloadGenerate(&workload, &spec) != 0) {
+    perror("workloadGenerate");
+    exit(EXIT_FAILURE);
+  }
+
+  FILE *fp = output != NULL ? fopen(output, "w") : stdout;
+  if (fp == NULL) {
+    perror(output);
+    exit(EXIT_FAILURE);
+  }
+  fprintf(fp, "# workloadgen -n %d -b %d -t %d -s %llu\n", spec.nthreads, spec.ncpu, spec.tickets, spec.seed);
+  int result = workloadWrite(&workload, fp);
+  if (output != NULL && fclose(fp) != 0) {
+    result = -1;
+  }
+  if (result != 0) {
+    perror(output != NULL ? output : "stdout");
+  }
+  workloadDestroy(&workload);
+  return result == 0 ? 0 : EXIT_FAILURE;
+}
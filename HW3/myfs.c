@@ -4,8 +4,11 @@
 // system (FS) that employs a file allocation table (FAT). 
 
 // Command-line Options
-// * `./myfs disk –format`: Overwrites the disk header with an empty FAT and an empty file list.
-// * `./myfs disk -write source_file destination_file`: Copies a file to the disk with the specified name.
+// * `./myfs disk –format [block_size [block_count [list_size]]]`: Overwrites the disk with an empty FAT
+//   and an empty file list. The block size is a power of two from 512 B to 64 KB (default 512), the FAT
+//   has block_count entries (default 4096) and the file list list_size entries (default 128).
+// * `./myfs disk -write source_file destination_file`: Copies a file to the disk with the specified name,
+//   `-` as the source reads stdin.
 // * `./myfs disk -read source_file destination_file`: Copies a file from the disk to the computer.
 // * `./myfs disk -delete file`: Deletes a file in the disk.
 // * `./myfs disk –list`: Prints all visible files and their respective sizes in the disk.
@@ -17,1038 +20,1974 @@
 // * `./myfs disk –unhide source_file`: Unhides a file in the disk.
 // * `./myfs disk –printfilelist`: Prints the File List to the "filelist.txt" file.
 // * `./myfs disk –printfat`: Prints the File Allocation Table (FAT) to the "fat.txt" file.
-// * `./myfs disk –defragment`: Merges fragmented files into one contiguous space or block.
+// * `./myfs disk –defragment [budget]`: Merges fragmented files into one contiguous space or block.
+//   It stops after `budget` block moves (`budget`ms with a `ms` suffix); running it again carries on.
+// * `./myfs disk -batch [script]`: Runs the commands of a script (stdin if none or `-`), one per line
+//   without the disk (e.g. `-write a.pdf b.pdf`). The FAT and the File List are read once and kept in
+//   memory; only the changed entries are written back, at a `-checkpoint` line and at the end.
+
+// The disk starts with a superblock that records the format version, the block size, the number of
+// blocks, the number of File List entries and the offsets of the journal and of the data blocks; the
+// FAT (64-bit entries in big endian), the File List and the journal follow it. Every table is sized
+// from the superblock when the disk is opened. `-format` truncates the disk and extends it to its full
+// size without writing the blocks, so the data is a sparse hole that reads as zeros and a disk of many
+// GB formats at once. A disk made before the superblock is format version 0: 512 B blocks, a FAT of
+// 4096 32-bit entries at offset 0 and a File List of 128 entries of 260 bytes (32-bit first block, size
+// and hidden flag), recognised by its reserved FAT entry 0. It is read and written in that layout,
+// converted to and from the tables in memory. An empty disk must be formatted before any other command.
+
+// Every command works on the FAT and the File List loaded by `OpenDisk`. A command only marks the
+// entries it changes (`MarkFat`, `MarkFileEntry`) and `FlushDisk` commits those, so a batch of
+// thousands of writes reads the tables once instead of once per command.
+
+// Changes to the tables go through a write-ahead journal, a circular region after the File List. A
+// commit (at the end of a command or batch, and at a `-checkpoint` line) appends one transaction with
+// the runs of changed FAT entries and File List entries and a checksum, waits for it with a single
+// `fdatasync`, and only then writes the entries in place. The journal header then moves to that
+// transaction, as the earlier ones are in place since the `fdatasync`. Opening the disk replays the
+// transactions from the header on, so a crash leaves the tables of the last commit whatever was
+// written in place. A block freed by a command is reused only after the commit that frees it, since
+// the committed FAT may still use it. The journal is written over from its start once the entries of
+// the earlier transactions are on the disk. A disk of format version 0 or 1 has no journal and is
+// written in place.
+
+// The disk is memory-mapped when it holds at least the tables: the data blocks are then pointers into
+// the mapping and blocks go to and from files with a single read or write on the mapping. The FAT and
+// the File List are copies of the mapping, as they must not reach the disk before their transaction
+// (on a disk without a journal they are the mapping itself and nothing is flushed by hand). A shorter
+// (unformatted) disk, or one that cannot be mapped, is accessed through stdio with the tables loaded in
+// memory.
+
+// `run.sh` builds the program and a test build (`-DCRASH_TEST`) that exits with status 9 at the commit
+// numbered by `$CRASH`, after its transaction is logged and before anything is written in place, or
+// just before it is logged for a negative number. It checks the commands against a known output,
+// `-defragment` with a budget run again until it completes, the replay of the journal after a crash in
+// a batch and in `-defragment`, and a copy of `disk.image` (format version 0).
+
+// File names are found through a hash index (open addressing with linear probing) that is rebuilt
+// when the disk is opened and kept up to date by every command that adds, renames or removes a file,
+// so a lookup or the check that a name is free does not depend on the size of the File List.
+
+// Free blocks are tracked by a bitmap built from the FAT when the disk is opened and updated by
+// `SetFat`, the only place that changes a FAT entry. The number of free blocks is kept with it, and a
+// free extent (a run of free blocks) is found a word of 64 blocks at a time with `ctz`, so a file
+// is allocated in a few runs instead of one FAT scan per block.
+
+// `-write` reads its source once. A regular file is sized with `fstat`, its whole chain is allocated
+// before any data moves and it is streamed in chunks of `ChunkBlocks` blocks, straight into the
+// mapping when the disk is mapped. A pipe or stdin is read a chunk at a time and its blocks are
+// allocated as it goes; if the disk fills up, the blocks taken so far are given back.
+
+// `-read` follows the chain a run of consecutive blocks at a time (a defragmented file is a single
+// run) and copies every run with one `copy_file_range`, or `sendfile`, so the data stays in the
+// kernel; when neither works the run goes through one `pread` (or the mapping) and one `write`.
+
+// `-duplicate` shares the chain of the file instead of copying it, so it takes the same time for a
+// file of any size and no space. Every block has a reference count, the FAT entries and File List
+// entries that point at it, rebuilt when the disk is opened and kept up to date by `SetFat`. Deleting
+// a file drops its reference and frees only the blocks nothing points at any more. A file is never
+// changed in place, so a shared block stays shared until the last file using it is deleted.
+
+// `-defragment` works in place. The target layout is every file of the File List one after the
+// other from block 1 on; only the blocks that are not in place move. A block is copied to a free
+// block before the FAT or the File List point at it and freed afterwards, so the disk is consistent at
+// every commit, and a block vacated by a move is committed before it is written over: a run that is
+// stopped by its budget (or killed) leaves a valid disk, and the next run plans again from there. The
+// places are filled along the cycles of the permutation, all of them at once in rounds of one commit:
+// a round fills every place that is free, which vacates the places the next round fills. A cycle, or
+// a chain longer than `DefragSteps`, is cut by moving one of its blocks out to a free block first, so
+// a disk with some free space is laid out in a few commits and almost every block moves only once.
 
 // In the code, there are multiple usage of IA code generators 
 // accompanying with different open source repositories. The used
 // repositories are given in the reference at the end.
 
+#define _GNU_SOURCE // copy_file_range
+
+#include <errno.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
 
-#define DataSize 512
-#define FatSize 4096
-#define ListSize 128
 #define NameSize 248
+#define LineSize 1024 // Longest command line of a batch script
+#define MaxArgs 8 // Most words of a batch command
+#define ChunkBlocks 64 // Blocks moved by one read of a source
+#define DefragSteps 32 // Most places a chain of moves fills before it is cut, one per commit
+#define WordBits 64 // Blocks per word of the free bitmap
+#define EndOfChain UINT64_MAX // Next block of the last block of a chain
+#define DiskMagic "MYFSDISK"
+#define FormatVersion 2 // Versions 0 and 1 have no journal
+#define SuperSize 512 // Bytes kept for the superblock, the FAT starts after them
+#define JournalMagic 0x314C4E4A // "JNL1"
+#define JournalStart 512 // Bytes kept for the journal header, transactions start after them
+#define RecordFat 1 // Journal records
+#define RecordEntry 2
+#define DefaultBlockSize 512
+#define DefaultBlockCount 4096
+#define DefaultListSize 128
+#define MinBlockSize 512
+#define MaxBlockSize 65536
+#define MaxBlockCount (1LL << 40) // 64 PB of 64 KB blocks, offsets stay within 64 bits
+#define MaxListSize (1 << 20)
+#define LegacyBlockCount 4096 // Geometry of a version 0 disk
+#define LegacyListSize 128
+#define LegacyEntrySize 260 // Name, then first block, size and hidden flag of 32 bits
+#define LegacyListOffset (LegacyBlockCount * 4)
+#define LegacyDataOffset (LegacyListOffset + LegacyListSize * LegacyEntrySize)
+#define LegacyEnd 0xFFFFFFFFu // Next block of the last block of a version 0 chain
 
 // Define Structures
 typedef struct {
-    char data[DataSize];
-} DataBlock;
+    char magic[8]; // DiskMagic
+    uint32_t version; // FormatVersion
+    uint32_t block_size; // Bytes of a data block, a power of two
+    uint64_t block_count; // Entries of the FAT, block 0 is reserved
+    uint32_t list_size; // Entries of the File List
+    uint32_t name_size; // Bytes of a file name
+    uint64_t data_offset; // Offset of block 0, a multiple of the block size
+    uint64_t journal_offset; // Offset of the journal, after the File List
+    uint64_t journal_size; // Bytes of the journal, 0 for version 1
+} Superblock;
 
 typedef struct {
-    DataBlock datablock[DataSize];
-} Data;
+    uint32_t magic; // JournalMagic
+    uint32_t unused;
+    uint64_t sequence; // First transaction that may not be in place on the disk
+    uint64_t start; // Offset of that transaction in the journal
+} JournalHeader;
 
 typedef struct {
-    unsigned int dummy;
-} FatEntry;
+    uint32_t magic; // JournalMagic
+    uint32_t records; // Records that follow
+    uint64_t sequence; // One more than the previous transaction
+    uint64_t length; // Bytes of the transaction, this header included
+    uint64_t checksum; // FNV-1a of the transaction with this field 0
+} TxnHeader;
+
+typedef struct {
+    uint32_t type; // RecordFat or RecordEntry
+    uint32_t count; // Entries that follow
+    uint64_t index; // First FAT entry or File List entry
+} RecordHeader;
 
 typedef struct {
-    FatEntry listentries[FatSize];
-} FAT;
+    uint64_t dummy; // Next block in big endian, 0 if free
+} FatEntry;
 
 typedef struct {
     char filename[NameSize];
-    uint32_t first_block;
-    uint32_t size;
+    uint64_t first_block;
+    uint64_t size;
     int hidden; 
+    int unused; // Keeps the entry a multiple of 8 bytes
 } FileEntry;
 
-typedef struct {
-    FileEntry filelist[ListSize];
-} FileList;
-
 // Global Variables Declaration
 char *disk_location;
-FILE *disk, *disk2;
+FILE *disk;
+int formatted; // The disk has a superblock, or is of version 0
+int disk_version = FormatVersion; // Format of the open disk
+uint32_t block_size = DefaultBlockSize; // Geometry of the open disk
+int64_t block_count = DefaultBlockCount;
+int list_size = DefaultListSize;
+off_t data_offset; // Offset of block 0
+off_t journal_offset; // Offset of the journal
+off_t journal_size; // Bytes of the journal, 0 if the disk has none
+off_t journal_head; // Offset in the journal of the next transaction
+uint64_t journal_sequence; // Number of the next transaction
+FatEntry *fat; // FAT of the open disk, resident until CloseDisk
+FileEntry *filelist; // File List of the open disk
+int shadow_tables; // The FAT and the File List are copies even though the disk is mapped
+uint64_t *fat_dirty; // Bit set for every FAT entry not yet written back
+int64_t fat_lo = INT64_MAX, fat_hi = -1; // Range of the bits set in fat_dirty
+char *entry_dirty; // File List entries not yet written back
+char *disk_map; // Mapping of the disk, NULL for the stdio backend
+size_t map_size; // Bytes mapped: the header and every addressable block
+off_t disk_size; // Size of the mapped disk, grown as blocks are written
+int *name_index; // File List entry of every name, -1 for an empty slot
+int index_size; // Slots of the name index, a power of two at most half full
+int duplicate_names; // Entries whose name an earlier entry already has
+uint64_t *free_map; // Bit set for every free block
+int64_t free_blocks; // Bits set in free_map
+uint64_t *pending_map; // Bit set for every block freed since the last commit, free after it
+int64_t pending_blocks; // Bits set in pending_map
+uint32_t *block_refs; // FAT entries and File List entries that point at every block
+char zero_block[MaxBlockSize]; // Data of a block that was never written
+int script_stdin; // The batch script is read from stdin
+
+// Words of the free bitmap
+int64_t MapWords() {
+    return (block_count + WordBits - 1) / WordBits;
+}
 
 // Locate a free FAT entry 
-int FindFreeFatEntry(FAT *fat, int start_index) {
-    for (int i = start_index; i < FatSize; i++) {
-        if (fat->listentries[i].dummy == 0x00000000) {
-            return i;
+int64_t FindFreeFatEntry(int64_t start_index) {
+    for (int64_t w = start_index / WordBits; w < MapWords(); w++) {
+        uint64_t word = free_map[w];
+        if (w == start_index / WordBits) {
+            word &= ~0ULL << (start_index % WordBits);
+        }
+        if (word != 0) {
+            return w * WordBits + __builtin_ctzll(word);
         }
     }
     return -1;
 }
 
+// Locate the first run of free blocks at or after start_index, at most want blocks long
+int64_t FindFreeExtent(int64_t start_index, int64_t want, int64_t *length) {
+    int64_t first = FindFreeFatEntry(start_index);
+    if (first == -1) {
+        return -1;
+    }
+
+    // The run ends at the first used block after it
+    int64_t end = block_count;
+    for (int64_t w = first / WordBits; w < MapWords(); w++) {
+        uint64_t used = ~free_map[w];
+        if (w == first / WordBits) {
+            used &= ~0ULL << (first % WordBits);
+        }
+        if (used != 0) {
+            end = w * WordBits + __builtin_ctzll(used);
+            end = end < block_count ? end : block_count;
+            break;
+        }
+        if (w * WordBits + WordBits - first >= want) {
+            break;
+        }
+    }
+    *length = end - first < want ? end - first : want;
+    return first;
+}
+
 // Locate an available entry 
-int FindFreeFileListEntry(FileList *filelist) {
-    for (int i = 0; i < ListSize; i++) {
-        if (filelist->filelist[i].filename[0] == '\0') {
+int FindFreeFileListEntry(FileEntry *filelist) {
+    for (int i = 0; i < list_size; i++) {
+        if (filelist[i].filename[0] == '\0') {
             return i;
         }
     }
     return -1;
 }
 
+// FNV-1a hash of a file name
+uint32_t HashName(const char *name) {
+    uint32_t hash = 2166136261u;
+    for (int i = 0; i < NameSize && name[i] != '\0'; i++) {
+        hash = (hash ^ (unsigned char)name[i]) * 16777619u;
+    }
+    return hash;
+}
+
+// Slot of a name in the index, or the empty slot where it would go
+int IndexSlot(const char *name) {
+    int slot = HashName(name) & (index_size - 1);
+    while (name_index[slot] != -1 &&
+           strncmp(filelist[name_index[slot]].filename, name, NameSize) != 0) {
+        slot = (slot + 1) & (index_size - 1);
+    }
+    return slot;
+}
+
+// Add a File List entry to the index, the first entry of a name wins
+void IndexAdd(int entry) {
+    int slot = IndexSlot(filelist[entry].filename);
+    if (name_index[slot] == -1 || name_index[slot] > entry) {
+        name_index[slot] = entry;
+    }
+}
+
+// Remove a File List entry from the index, before its name changes
+void IndexRemove(int entry) {
+    char *name = filelist[entry].filename;
+    int slot = IndexSlot(name);
+    if (name_index[slot] != entry) {
+        return;
+    }
+
+    // Shift back the entries after it that would no longer be found
+    int hole = slot;
+    for (int next = (hole + 1) & (index_size - 1); name_index[next] != -1;
+         next = (next + 1) & (index_size - 1)) {
+        int home = HashName(filelist[name_index[next]].filename) & (index_size - 1);
+        if (((next - home) & (index_size - 1)) >= ((next - hole) & (index_size - 1))) {
+            name_index[hole] = name_index[next];
+            hole = next;
+        }
+    }
+    name_index[hole] = -1;
+
+    // A disk written before the index may hold the same name twice
+    for (int i = 0; duplicate_names > 0 && i < list_size; i++) {
+        if (i != entry && strncmp(filelist[i].filename, name, NameSize) == 0) {
+            IndexAdd(i);
+            duplicate_names--;
+            break;
+        }
+    }
+}
+
 // Return the index of the file in the filelist.
-int FindFileInList(FileList *filelist, char *file_name) {
-    for (int i = 0; i < ListSize; i++) {
-        char *f_name = filelist->filelist[i].filename;
-        if (strcmp(f_name, file_name) == 0) {
-            return i;
+int FindFileInList(char *file_name) {
+    if (file_name[0] == '\0') {
+        return -1;
+    }
+    return name_index[IndexSlot(file_name)];
+}
+
+// Rebuild the index from the File List
+void BuildIndex() {
+    memset(name_index, -1, index_size * sizeof(int));
+    duplicate_names = 0;
+    for (int i = 0; i < list_size; i++) {
+        if (filelist[i].filename[0] != '\0') {
+            if (FindFileInList(filelist[i].filename) != -1) {
+                duplicate_names++;
+            }
+            IndexAdd(i);
         }
     }
-    return -1;
 }
 
 // Convert little endian to big endian and vice versa
-uint32_t EndianConversion(uint32_t dummy) {
-    return ((dummy & 0xFF) << 24) | ((dummy & 0xFF00) << 8) |
-           ((dummy & 0xFF0000) >> 8) | ((dummy & 0xFF000000) >> 24);
+uint64_t EndianConversion(uint64_t dummy) {
+    return __builtin_bswap64(dummy);
 }
 
+// Remember that a FAT entry changed
+void MarkFat(int64_t index) {
+    fat_dirty[index / WordBits] |= 1ULL << (index % WordBits);
+    if (index < fat_lo) {
+        fat_lo = index;
+    }
+    if (index > fat_hi) {
+        fat_hi = index;
+    }
+}
 
-// Function to format disk
-void FormatDisk() {
-    // Open Disk
-    FILE *disk = fopen(disk_location, "wb+");
-    if (disk == NULL) {
-        printf("Error: Could not open disk\n");
-        return;
+// Remember that a File List entry changed
+void MarkFileEntry(int index) {
+    entry_dirty[index] = 1;
+}
+
+// Take (1) or drop (-1) the reference of a File List entry to the first block of its chain
+void RefBlock(uint64_t block_index, int delta) {
+    if (block_index < (uint64_t)block_count) {
+        block_refs[block_index] += delta;
     }
+}
 
-    // Initialize and create FAT
-    FAT fat;
-    memset(&fat, 0, sizeof(FAT));
-    fat.listentries[0].dummy = 0xFFFFFFFF;
+// Set the next block of a FAT entry (0 frees it) and keep the free bitmap and the references in step.
+// A freed block is only free after the next commit: the committed FAT may still use it.
+void SetFat(int64_t index, uint64_t next_block) {
+    int was_free = fat[index].dummy == 0;
+    if (!was_free) {
+        RefBlock(EndianConversion(fat[index].dummy), -1);
+    }
+    if (next_block != 0) {
+        RefBlock(next_block, 1);
+    }
+    fat[index].dummy = EndianConversion(next_block);
+    MarkFat(index);
+    uint64_t bit = 1ULL << (index % WordBits);
+    if (was_free && next_block != 0 && (pending_map[index / WordBits] & bit)) {
+        pending_map[index / WordBits] &= ~bit;
+        pending_blocks--;
+    } else if (was_free && next_block != 0) {
+        free_map[index / WordBits] &= ~bit;
+        free_blocks--;
+    } else if (!was_free && next_block == 0) {
+        pending_map[index / WordBits] |= bit;
+        pending_blocks++;
+    }
+}
 
-    // Initialize and create File List
-    FileList filelist;
-    memset(&filelist, 0, sizeof(FileList));
+// Make the blocks freed before a commit free
+void ReleasePending() {
+    for (int64_t w = 0; pending_blocks > 0 && w < MapWords(); w++) {
+        free_map[w] |= pending_map[w];
+        pending_blocks -= __builtin_popcountll(pending_map[w]);
+        free_blocks += __builtin_popcountll(pending_map[w]);
+        pending_map[w] = 0;
+    }
+}
 
-    // Write FAT and File List to disk
-    fseek(disk, 0, SEEK_SET);
-    fwrite(&fat, sizeof(FAT), 1, disk);
-    fwrite(&filelist, sizeof(FileList), 1, disk);
+// Free a chain of blocks nothing points at, it stops at a block that is shared or already free
+void FreeChain(uint64_t block_index) {
+    while (block_index < (uint64_t)block_count && fat[block_index].dummy != 0 &&
+           block_refs[block_index] == 0) {
+        uint64_t next_block_index = EndianConversion(fat[block_index].dummy);
+        SetFat(block_index, 0);
+        block_index = next_block_index;
+    }
+}
 
-    // Initialize and create Data Blocks
-    Data data;
-    memset(&data, 0, sizeof(Data));
+int FlushDisk();
 
-    // Write Data Blocks to disk
-    fseek(disk, sizeof(FAT) + sizeof(FileList), SEEK_SET);
-    fwrite(&data, sizeof(Data), 1, disk);
+// Link count free blocks after last (-1 to start a chain), in runs; first is the first new block
+int AppendBlocks(int64_t count, int64_t *first, int64_t *last) {
+    if (free_blocks < count && free_blocks + pending_blocks >= count) {
+        FlushDisk(); // Commit to reuse the blocks freed since the last commit
+    }
+    if (free_blocks < count) {
+        return -1;
+    }
+    *first = -1;
+    while (count > 0) {
+        int64_t length;
+        int64_t run = FindFreeExtent(*last == -1 ? 1 : *last + 1, count, &length);
+        if (run == -1) {
+            run = FindFreeExtent(1, count, &length); // Wrap around
+        }
+        for (int64_t b = run; b < run + length; b++) {
+            SetFat(b, EndOfChain);
+            if (*last != -1) {
+                SetFat(*last, b);
+            }
+            if (*first == -1) {
+                *first = b;
+            }
+            *last = b;
+        }
+        count -= length;
+    }
+    return 0;
+}
 
-    printf("Disk formatted\n");
-    fclose(disk);
+// Number of consecutive blocks of a chain from block on, at most max
+int64_t RunLength(uint64_t block, int64_t max) {
+    int64_t length = 1;
+    while (length < max && EndianConversion(fat[block + length - 1].dummy) == block + length) {
+        length++;
+    }
+    return length;
 }
 
+// Rebuild the free bitmap from the FAT, block 0 is never free
+void BuildFreeMap() {
+    memset(free_map, 0, MapWords() * sizeof(uint64_t));
+    free_blocks = 0;
+    for (int64_t i = 1; i < block_count; i++) {
+        if (fat[i].dummy == 0) {
+            free_map[i / WordBits] |= 1ULL << (i % WordBits);
+            free_blocks++;
+        }
+    }
+}
 
-// Write file to disk
-void WriteToDisk(char *src_path, char *dest_file_name) {
-    FILE *disk = fopen(disk_location, "rb+");
-    
-    if (disk == NULL) {
-        printf("Error: Could not open disk\n");
-        return;
+// Rebuild the reference counts of the blocks from the FAT and the File List
+void BuildRefs() {
+    memset(block_refs, 0, block_count * sizeof(uint32_t));
+    for (int64_t i = 1; i < block_count; i++) {
+        if (fat[i].dummy != 0) {
+            RefBlock(EndianConversion(fat[i].dummy), 1);
+        }
     }
-    
-    // Get data from the disk
-    FAT *t_fat = malloc(sizeof(FAT));
-    fseek(disk, 0, SEEK_SET);
-    fread(t_fat, sizeof(FAT), 1, disk);
+    for (int i = 0; i < list_size; i++) {
+        if (filelist[i].filename[0] != '\0') {
+            RefBlock(filelist[i].first_block, 1);
+        }
+    }
+}
 
-    FileList *t_filelist = malloc(sizeof(FileList));
-    fseek(disk, sizeof(FAT), SEEK_SET);
-    fread(t_filelist, sizeof(FileList), 1, disk);
+// Offset of the File List in the disk, after the superblock and the FAT
+off_t ListOffset() {
+    if (disk_version == 0) {
+        return LegacyListOffset;
+    }
+    return SuperSize + (off_t)block_count * sizeof(FatEntry);
+}
 
-    FILE *src_file = fopen(src_path, "rb");
-    if (src_file == NULL) {
-        printf("Error: Could not open source file\n");
-        fclose(disk);
-        free(t_fat);
-        free(t_filelist);
-        return;
+// Offset of a data block in the disk
+off_t BlockOffset(int64_t index) {
+    return data_offset + (off_t)index * block_size;
+}
+
+// Bytes of the superblock and the tables
+off_t HeaderBytes() {
+    if (disk_version == 0) {
+        return LegacyDataOffset;
     }
+    return ListOffset() + (off_t)list_size * sizeof(FileEntry);
+}
 
-    // Find free file list entry
-    int filelist_index = FindFreeFileListEntry(t_filelist);
-    if (filelist_index == -1) {
-        printf("Error: File list is full\n");
-        fclose(src_file);
-        fclose(disk);
-        free(t_fat);
-        free(t_filelist);
-        return;
+// Bytes of the journal: room for a transaction that changes every FAT entry and File List entry
+off_t JournalBytes() {
+    off_t worst = JournalStart + sizeof(TxnHeader) + sizeof(RecordHeader);
+    worst += (off_t)block_count * sizeof(FatEntry) + (off_t)list_size * (sizeof(RecordHeader) + sizeof(FileEntry));
+    return (worst + 4095) / 4096 * 4096;
+}
+
+// Check a geometry and lay the disk out for it, 0 if it is not valid
+int SetGeometry(long long size, long long count, long long entries, int version) {
+    if (size < MinBlockSize || size > MaxBlockSize || (size & (size - 1)) != 0 ||
+        count < 2 || count > MaxBlockCount || entries < 1 || entries > MaxListSize) {
+        return 0;
+    }
+    block_size = size;
+    block_count = count;
+    list_size = entries;
+    disk_version = version;
+    if (version == 0) {
+        journal_offset = LegacyDataOffset;
+        journal_size = 0;
+        data_offset = LegacyDataOffset;
+        return 1;
     }
+    journal_offset = (HeaderBytes() + 511) / 512 * 512;
+    journal_size = version >= 2 ? JournalBytes() : 0;
+    data_offset = (journal_offset + journal_size + block_size - 1) / block_size * block_size;
+    return 1;
+}
 
-    // Find free FAT entry
-    int fat_index = FindFreeFatEntry(t_fat, 1);
-    if (fat_index == -1) {
-        printf("Error: Disk is full\n");
-        printf("Error: File list is full\n");
-        fclose(src_file);
-        fclose(disk);
-        free(t_fat);
-        free(t_filelist);
+// FNV-1a of a buffer
+uint64_t Checksum(const char *buf, size_t len) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < len; i++) {
+        hash = (hash ^ (unsigned char)buf[i]) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+// Next run of changed FAT entries at or after from, -1 if there is none
+int64_t NextFatRun(int64_t from, int64_t *length) {
+    for (int64_t w = from / WordBits; w * WordBits <= fat_hi; w++) {
+        uint64_t word = fat_dirty[w];
+        if (w == from / WordBits) {
+            word &= ~0ULL << (from % WordBits);
+        }
+        if (word == 0) {
+            continue;
+        }
+        int64_t start = w * WordBits + __builtin_ctzll(word);
+        int64_t end = start + 1;
+        while (end <= fat_hi && end - start < (1 << 30) &&
+               (fat_dirty[end / WordBits] >> (end % WordBits) & 1)) {
+            end++;
+        }
+        *length = end - start;
+        return start;
+    }
+    return -1;
+}
+
+// Add a record to a transaction that is being built, or only count its bytes when txn is NULL
+size_t AddRecord(char *txn, size_t pos, uint32_t type, int64_t index, int64_t count) {
+    size_t bytes = count * (type == RecordFat ? sizeof(FatEntry) : sizeof(FileEntry));
+    if (txn != NULL) {
+        RecordHeader rec = {type, count, index};
+        memcpy(txn + pos, &rec, sizeof(RecordHeader));
+        char *entries = type == RecordFat ? (char *)&fat[index] : (char *)&filelist[index];
+        memcpy(txn + pos + sizeof(RecordHeader), entries, bytes);
+        ((TxnHeader *)txn)->records++;
+    }
+    return pos + sizeof(RecordHeader) + bytes;
+}
+
+// Gather the changed FAT entries and File List entries in one transaction, NULL if nothing changed
+char *BuildTxn(size_t *length) {
+    char *txn = NULL;
+    *length = 0;
+    for (int pass = 0; pass < 2; pass++) {
+        // Runs of changed FAT entries, or the whole changed range when that is shorter
+        size_t pos = sizeof(TxnHeader);
+        size_t runs = pos;
+        int64_t run;
+        for (int64_t start = NextFatRun(0, &run); start != -1; start = NextFatRun(start + run, &run)) {
+            runs = AddRecord(NULL, runs, RecordFat, start, run);
+        }
+        if (fat_lo <= fat_hi && runs > AddRecord(NULL, pos, RecordFat, fat_lo, fat_hi - fat_lo + 1)) {
+            pos = AddRecord(txn, pos, RecordFat, fat_lo, fat_hi - fat_lo + 1);
+        } else {
+            for (int64_t start = NextFatRun(0, &run); start != -1; start = NextFatRun(start + run, &run)) {
+                pos = AddRecord(txn, pos, RecordFat, start, run);
+            }
+        }
+
+        // Runs of changed File List entries
+        for (int i = 0; i < list_size; i++) {
+            int end = i;
+            while (end < list_size && entry_dirty[end]) {
+                end++;
+            }
+            if (end > i) {
+                pos = AddRecord(txn, pos, RecordEntry, i, end - i);
+                i = end;
+            }
+        }
+
+        if (pass == 0) {
+            if (pos == sizeof(TxnHeader)) {
+                return NULL;
+            }
+            *length = pos;
+            txn = calloc(1, pos);
+            if (txn == NULL) {
+                return NULL;
+            }
+        }
+    }
+
+    TxnHeader *header = (TxnHeader *)txn;
+    header->magic = JournalMagic;
+    header->sequence = journal_sequence;
+    header->length = *length;
+    header->checksum = Checksum(txn, *length);
+    return txn;
+}
+
+// Read the tables of a version 0 disk into the tables in memory
+void LoadLegacyTables() {
+    uint32_t legacy_fat[LegacyBlockCount];
+    char legacy_list[LegacyListSize][LegacyEntrySize];
+    memset(legacy_fat, 0, sizeof(legacy_fat));
+    memset(legacy_list, 0, sizeof(legacy_list));
+    pread(fileno(disk), legacy_fat, sizeof(legacy_fat), 0);
+    pread(fileno(disk), legacy_list, sizeof(legacy_list), LegacyListOffset);
+    for (int i = 0; i < LegacyBlockCount; i++) {
+        uint32_t next_block = __builtin_bswap32(legacy_fat[i]);
+        fat[i].dummy = EndianConversion(next_block == LegacyEnd ? EndOfChain : next_block);
+    }
+    for (int i = 0; i < LegacyListSize; i++) {
+        uint32_t fields[3];
+        memcpy(filelist[i].filename, legacy_list[i], NameSize);
+        filelist[i].filename[NameSize - 1] = '\0';
+        memcpy(fields, legacy_list[i] + NameSize, sizeof(fields));
+        filelist[i].first_block = fields[0];
+        filelist[i].size = fields[1];
+        filelist[i].hidden = fields[2];
+    }
+}
+
+// Write a record of a transaction at its place on a version 0 disk
+int StoreLegacyRecord(const RecordHeader *rec, const char *entries) {
+    char buf[LegacyListSize * LegacyEntrySize]; // Holds the whole FAT too
+    size_t bytes;
+    off_t place;
+    if (rec->type == RecordFat) {
+        for (uint32_t i = 0; i < rec->count; i++) {
+            FatEntry entry;
+            memcpy(&entry, entries + i * sizeof(FatEntry), sizeof(FatEntry));
+            uint64_t next_block = EndianConversion(entry.dummy);
+            uint32_t stored = __builtin_bswap32(next_block == EndOfChain ? LegacyEnd : (uint32_t)next_block);
+            memcpy(buf + i * 4, &stored, 4);
+        }
+        bytes = rec->count * 4;
+        place = rec->index * 4;
+    } else {
+        memset(buf, 0, rec->count * LegacyEntrySize);
+        for (uint32_t i = 0; i < rec->count; i++) {
+            FileEntry entry;
+            memcpy(&entry, entries + i * sizeof(FileEntry), sizeof(FileEntry));
+            uint32_t fields[3] = {entry.first_block, entry.size, entry.hidden};
+            memcpy(buf + i * LegacyEntrySize, entry.filename, NameSize);
+            memcpy(buf + i * LegacyEntrySize + NameSize, fields, sizeof(fields));
+        }
+        bytes = rec->count * LegacyEntrySize;
+        place = LegacyListOffset + rec->index * LegacyEntrySize;
+    }
+    return pwrite(fileno(disk), buf, bytes, place) == (ssize_t)bytes ? 0 : -1;
+}
+
+// Write the records of a transaction at their place on the disk, and in the tables when replaying
+int ApplyTxn(const char *txn, size_t length, int replaying) {
+    const TxnHeader *header = (const TxnHeader *)txn;
+    size_t pos = sizeof(TxnHeader);
+    for (uint32_t r = 0; r < header->records; r++) {
+        RecordHeader rec;
+        if (pos + sizeof(RecordHeader) > length) {
+            return -1;
+        }
+        memcpy(&rec, txn + pos, sizeof(RecordHeader));
+        pos += sizeof(RecordHeader);
+
+        size_t bytes;
+        off_t place;
+        char *table;
+        if (rec.type == RecordFat && rec.index + rec.count <= (uint64_t)block_count) {
+            bytes = rec.count * sizeof(FatEntry);
+            place = SuperSize + rec.index * sizeof(FatEntry);
+            table = (char *)&fat[rec.index];
+        } else if (rec.type == RecordEntry && rec.index + rec.count <= (uint64_t)list_size) {
+            bytes = rec.count * sizeof(FileEntry);
+            place = ListOffset() + rec.index * sizeof(FileEntry);
+            table = (char *)&filelist[rec.index];
+        } else {
+            return -1;
+        }
+        if (pos + bytes > length) {
+            return -1;
+        }
+        if (replaying) {
+            memcpy(table, txn + pos, bytes);
+        }
+        if (disk_version == 0) {
+            if (StoreLegacyRecord(&rec, txn + pos) != 0) {
+                return -1;
+            }
+        } else if (pwrite(fileno(disk), txn + pos, bytes, place) != (ssize_t)bytes) {
+            return -1;
+        }
+        pos += bytes;
+    }
+    return 0;
+}
+
+// Append a transaction to the journal and wait until it is on the disk
+int LogTxn(const char *txn, size_t length) {
+    // Wrap around once the transactions in the journal are on the disk at their place
+    if (journal_head + (off_t)length > journal_size) {
+        JournalHeader header = {JournalMagic, 0, journal_sequence, JournalStart};
+        if (fdatasync(fileno(disk)) != 0 ||
+            pwrite(fileno(disk), &header, sizeof(JournalHeader), journal_offset) != sizeof(JournalHeader)) {
+            return -1;
+        }
+        journal_head = JournalStart;
+    }
+    if (pwrite(fileno(disk), txn, length, journal_offset + journal_head) != (ssize_t)length ||
+        fdatasync(fileno(disk)) != 0) {
+        return -1;
+    }
+
+    // The earlier transactions are in place since the fdatasync, the next open replays from this one
+    JournalHeader header = {JournalMagic, 0, journal_sequence, journal_head};
+    if (pwrite(fileno(disk), &header, sizeof(JournalHeader), journal_offset) != sizeof(JournalHeader)) {
+        return -1;
+    }
+    journal_head += length;
+    journal_sequence++;
+    return 0;
+}
+
+// Redo the transactions of the journal that may not be at their place on the disk yet
+void ReplayJournal() {
+    JournalHeader header;
+    journal_head = JournalStart;
+    journal_sequence = 1;
+    if (pread(fileno(disk), &header, sizeof(JournalHeader), journal_offset) != sizeof(JournalHeader) ||
+        header.magic != JournalMagic) {
         return;
     }
+    journal_sequence = header.sequence;
+    if (header.start >= JournalStart && header.start < (uint64_t)journal_size) {
+        journal_head = header.start;
+    }
+
+    // Transactions follow each other until one is torn or older than the wrap
+    for (;;) {
+        TxnHeader txn_header;
+        if (journal_head + (off_t)sizeof(TxnHeader) > journal_size ||
+            pread(fileno(disk), &txn_header, sizeof(TxnHeader), journal_offset + journal_head) !=
+                sizeof(TxnHeader) ||
+            txn_header.magic != JournalMagic || txn_header.sequence != journal_sequence ||
+            txn_header.length < sizeof(TxnHeader) ||
+            txn_header.length > (uint64_t)(journal_size - journal_head)) {
+            return;
+        }
+        char *txn = malloc(txn_header.length);
+        if (txn == NULL ||
+            pread(fileno(disk), txn, txn_header.length, journal_offset + journal_head) !=
+                (ssize_t)txn_header.length) {
+            free(txn);
+            return;
+        }
+        ((TxnHeader *)txn)->checksum = 0;
+        if (Checksum(txn, txn_header.length) != txn_header.checksum ||
+            ApplyTxn(txn, txn_header.length, 1) != 0) {
+            free(txn);
+            return;
+        }
+        free(txn);
+        journal_head += txn_header.length;
+        journal_sequence++;
+    }
+}
 
-    // Count free FAT entries
-    int free_fat_entries = 0;
-    for (int i = 0; i < FatSize; i++) {
-        if (t_fat->listentries[i].dummy == 0x00000000) {
-            free_fat_entries++;
+// Map the disk, or load its tables for the stdio backend
+int MapDisk() {
+    struct stat st;
+    Superblock sb;
+    uint32_t legacy_reserved;
+    disk_map = NULL;
+    formatted = 0;
+
+    // The geometry is in the superblock, an unformatted disk gets the default one
+    if (pread(fileno(disk), &sb, sizeof(Superblock), 0) == sizeof(Superblock) &&
+        memcmp(sb.magic, DiskMagic, sizeof(sb.magic)) == 0) {
+        if (sb.version < 1 || sb.version > FormatVersion || sb.name_size != NameSize ||
+            !SetGeometry(sb.block_size, sb.block_count, sb.list_size, sb.version) ||
+            sb.data_offset != (uint64_t)data_offset ||
+            sb.journal_size != (uint64_t)journal_size ||
+            (journal_size > 0 && sb.journal_offset != (uint64_t)journal_offset)) {
+            printf("Error: Unsupported disk format\n");
+            return 0;
         }
+        formatted = 1;
+    } else if (fstat(fileno(disk), &st) == 0 && st.st_size >= LegacyDataOffset &&
+               pread(fileno(disk), &legacy_reserved, 4, 0) == 4 && legacy_reserved == LegacyEnd) {
+        // Made before the superblock, block 0 is reserved
+        SetGeometry(DefaultBlockSize, LegacyBlockCount, LegacyListSize, 0);
+        formatted = 1;
+    } else {
+        SetGeometry(DefaultBlockSize, DefaultBlockCount, DefaultListSize, FormatVersion);
+    }
+
+    // Tables sized by the geometry
+    index_size = 1;
+    while (index_size < 2 * list_size) {
+        index_size *= 2;
+    }
+    entry_dirty = calloc(list_size, 1);
+    name_index = malloc(index_size * sizeof(int));
+    free_map = malloc(MapWords() * sizeof(uint64_t));
+    pending_map = calloc(MapWords(), sizeof(uint64_t));
+    fat_dirty = calloc(MapWords(), sizeof(uint64_t));
+    block_refs = malloc(block_count * sizeof(uint32_t));
+    pending_blocks = 0;
+    fat_lo = INT64_MAX;
+    fat_hi = -1;
+    shadow_tables = 0;
+    if (entry_dirty == NULL || name_index == NULL || free_map == NULL || pending_map == NULL ||
+        fat_dirty == NULL || block_refs == NULL) {
+        printf("Error: Memory allocation failed\n");
+        return 0;
     }
-    
-    //int free_fat_entries = CountFreeFATEntries(t_fat);
-    
-    int f_size = 0;
-    int n_clusters = 0;
-    while (!feof(src_file)) {
-        DataBlock block;
-        int b_read = fread(block.data, 1, DataSize, src_file);
-        if (b_read > 0) {
-            n_clusters++;
-            f_size += b_read;
+
+    off_t header = HeaderBytes();
+    if (formatted && fstat(fileno(disk), &st) == 0 && st.st_size >= header) {
+        map_size = BlockOffset(block_count);
+        void *map = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fileno(disk), 0);
+        if (map != MAP_FAILED) {
+            disk_map = map;
+            disk_size = st.st_size;
+            madvise(disk_map, header, MADV_WILLNEED);
+            // The tables are written in place only once they are allocated, see ReserveBlocks
+            if (journal_size == 0 && disk_version > 0 && posix_fallocate(fileno(disk), 0, header) == 0) {
+                fat = (FatEntry *)(disk_map + SuperSize);
+                filelist = (FileEntry *)(disk_map + ListOffset());
+                BuildIndex();
+                BuildFreeMap();
+                BuildRefs();
+                return 1;
+            }
+
+            // With a journal the tables must not reach the disk before their transaction, and those
+            // of version 0 have another layout: use copies, written with pwrite
+            fat = malloc(block_count * sizeof(FatEntry));
+            filelist = malloc(list_size * sizeof(FileEntry));
+            if (fat == NULL || filelist == NULL) {
+                printf("Error: Memory allocation failed\n");
+                return 0;
+            }
+            shadow_tables = 1;
+            if (disk_version == 0) {
+                LoadLegacyTables();
+            } else {
+                memcpy(fat, disk_map + SuperSize, block_count * sizeof(FatEntry));
+                memcpy(filelist, disk_map + ListOffset(), list_size * sizeof(FileEntry));
+                ReplayJournal();
+            }
+            BuildIndex();
+            BuildFreeMap();
+            BuildRefs();
+            return 1;
         }
     }
 
-    src_file = fopen(src_path, "rb");
+    fat = calloc(block_count, sizeof(FatEntry));
+    filelist = calloc(list_size, sizeof(FileEntry));
+    if (fat == NULL || filelist == NULL) {
+        printf("Error: Memory allocation failed\n");
+        return 0;
+    }
 
-    if (free_fat_entries < n_clusters) {
-        fclose(src_file);
+    // A short (unformatted) disk reads as empty tables
+    if (formatted && disk_version == 0) {
+        LoadLegacyTables();
+    } else if (formatted) {
+        pread(fileno(disk), fat, block_count * sizeof(FatEntry), SuperSize);
+        pread(fileno(disk), filelist, list_size * sizeof(FileEntry), ListOffset());
+        if (journal_size > 0) {
+            ReplayJournal();
+        }
+    }
+    BuildIndex();
+    BuildFreeMap();
+    BuildRefs();
+    return 1;
+}
+
+// Release the mapping or the loaded tables
+void UnmapDisk() {
+    if (disk_map == NULL || shadow_tables) {
+        free(fat);
+        free(filelist);
+    }
+    if (disk_map != NULL) {
+        munmap(disk_map, map_size);
+        disk_map = NULL;
+    }
+    free(entry_dirty);
+    free(name_index);
+    free(free_map);
+    free(pending_map);
+    free(fat_dirty);
+    free(block_refs);
+}
+
+// Open the disk and load the FAT and the File List
+int OpenDisk(char *loc) {
+    disk = fopen(loc, "rb+");
+    if (disk == NULL) {
+        printf("Error: Could not open disk\n");
+        return 0;
+    }
+    if (MapDisk() == 0) {
         fclose(disk);
-        free(t_fat);
-        free(t_filelist);
-        printf("Error: Not enough free space on disk\n");
-        return;
+        return 0;
     }
+    return 1;
+}
+
+// Allocate count data blocks from index on, growing the disk if needed. A block that was never
+// written is a hole in a sparse disk, and a store into a hole the host cannot fill raises SIGBUS,
+// so every run is reserved before it is written through the mapping.
+int ReserveBlocks(int64_t index, int64_t count) {
+    off_t end = BlockOffset(index + count);
+    if (posix_fallocate(fileno(disk), BlockOffset(index), end - BlockOffset(index)) != 0) {
+        return -1;
+    }
+    if (end > disk_size) {
+        disk_size = end;
+    }
+    return 0;
+}
 
-    int num_clusters = 0;
+// Address of a data block in the mapping, reserved on the disk when writing
+char *MapBlock(int64_t index, int writing) {
+    if (writing) {
+        return ReserveBlocks(index, 1) == 0 ? disk_map + BlockOffset(index) : NULL;
+    }
+    if (BlockOffset(index) + block_size > disk_size) {
+        return zero_block; // Never written
+    }
+    return disk_map + BlockOffset(index);
+}
+
+// Hint how the data blocks are about to be accessed
+void AdviseData(int advice) {
+    if (disk_map != NULL && disk_size > BlockOffset(0)) {
+        madvise(disk_map + BlockOffset(0), disk_size - BlockOffset(0), advice);
+    }
+}
 
-    // Write file to disk
-    FileEntry file_entry;
-    file_entry.first_block = fat_index;
-    file_entry.size = 0;
-    file_entry.hidden = 0;
-    strncpy(file_entry.filename, dest_file_name, NameSize);
-    file_entry.filename[NameSize - 1] = '\0';  // Ensure null-termination
+// Write a whole buffer to a descriptor
+int WriteAll(int fd, const char *buf, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, buf, len);
+        if (n <= 0) {
+            return -1;
+        }
+        buf += n;
+        len -= n;
+    }
+    return 0;
+}
 
-    int data_index = fat_index;
-    while (!feof(src_file)) {
-        DataBlock data_block;
-        int bytes_read = fread(data_block.data, 1, DataSize, src_file);
-        if (bytes_read == 0) {
+// Read up to len bytes, fewer only at the end of the source
+ssize_t ReadFull(int fd, char *buf, size_t len) {
+    size_t done = 0;
+    while (done < len) {
+        ssize_t n = read(fd, buf + done, len - done);
+        if (n < 0) {
+            return -1;
+        }
+        if (n == 0) {
             break;
         }
-        fseek(disk,
-              sizeof(FAT) + sizeof(FileList) + (data_index * sizeof(DataBlock)),
-              SEEK_SET);
-        fwrite(&data_block, sizeof(DataBlock), 1, disk);
+        done += n;
+    }
+    return done;
+}
+
+// Store len bytes in the chain from block on, the last block padded with zeros
+int StoreChain(uint64_t block, const char *buf, size_t len) {
+    while (len > 0) {
+        int64_t run = RunLength(block, (len + block_size - 1) / block_size);
+        size_t bytes = (size_t)run * block_size < len ? (size_t)run * block_size : len;
+        size_t padded = (size_t)run * block_size;
 
-        // Update FAT
-        uint32_t fat_dummy;
-        if (bytes_read < DataSize) {
-            fat_dummy = 0xFFFFFFFF;
+        if (disk_map != NULL) {
+            if (ReserveBlocks(block, run) != 0) {
+                return -1;
+            }
+            memcpy(disk_map + BlockOffset(block), buf, bytes);
+            memset(disk_map + BlockOffset(block) + bytes, 0, padded - bytes);
         } else {
-            fat_dummy = FindFreeFatEntry(t_fat, data_index + 1);
+            fseek(disk, BlockOffset(block), SEEK_SET);
+            if (fwrite(buf, 1, bytes, disk) != bytes ||
+                fwrite(zero_block, 1, padded - bytes, disk) != padded - bytes) {
+                return -1;
+            }
         }
 
-        if (t_fat->listentries[data_index].dummy == 0x00000000) {
-            t_fat->listentries[data_index].dummy = EndianConversion(fat_dummy);
+        buf += bytes;
+        len -= bytes;
+        block = EndianConversion(fat[block + run - 1].dummy);
+    }
+    return 0;
+}
+
+// Copy len bytes of the disk from offset on to a descriptor, inside the kernel when it can
+int CopyOut(int dest_fd, off_t offset, size_t len, char *buffer) {
+    static int no_copy_range, no_sendfile; // Not supported between these files
+    while (len > 0) {
+        ssize_t n = -1;
+        if (!no_copy_range) {
+            loff_t in = offset;
+            n = copy_file_range(fileno(disk), &in, dest_fd, NULL, len, 0);
+            if (n < 0 && errno != EINTR && errno != EIO && errno != ENOSPC) {
+                no_copy_range = 1;
+            }
+        }
+        if (n <= 0 && !no_sendfile) {
+            off_t in = offset;
+            n = sendfile(dest_fd, fileno(disk), &in, len);
+            if (n < 0 && (errno == EINVAL || errno == ENOSYS)) {
+                no_sendfile = 1;
+            }
+        }
+        if (n <= 0) {
+            // Through user space, one chunk at a time
+            size_t chunk = len < ChunkBlocks * block_size ? len : ChunkBlocks * block_size;
+            if (disk_map != NULL && offset + (off_t)chunk <= disk_size) {
+                n = WriteAll(dest_fd, disk_map + offset, chunk) == 0 ? (ssize_t)chunk : -1;
+            } else {
+                n = pread(fileno(disk), buffer, chunk, offset);
+                if (n > 0 && WriteAll(dest_fd, buffer, n) != 0) {
+                    n = -1;
+                }
+            }
+        }
+        if (n <= 0) {
+            return -1;
         }
+        offset += n;
+        len -= n;
+    }
+    return 0;
+}
 
-        if (bytes_read > 0) {
-            num_clusters++;
+#ifdef CRASH_TEST
+// The test build dies at the commit numbered by the CRASH environment variable, counted from 1 in
+// every run of the program: at n once its transaction is logged, at -n just before (the changes since
+// the previous commit are lost)
+void CrashPoint(int logged) {
+    static long at, commit;
+    if (commit == 0) {
+        at = getenv("CRASH") != NULL ? atol(getenv("CRASH")) : 0;
+    }
+    if (!logged) {
+        commit++;
+    }
+    if (commit == (logged ? at : -at)) {
+        _exit(9);
+    }
+}
+#endif
+
+// Commit the changed FAT entries and File List entries: log them, then write them back in place
+int FlushDisk() {
+    int failed = fflush(disk) != 0;
+
+    // Without a journal the mapping is the disk, the kernel writes it back
+    if (!failed && (disk_map == NULL || shadow_tables)) {
+        size_t length;
+        char *txn = BuildTxn(&length);
+        if (txn == NULL) {
+            failed = length > 0;
+        } else {
+#ifdef CRASH_TEST
+            CrashPoint(0);
+#endif
+            failed = journal_size > 0 && LogTxn(txn, length) != 0;
+#ifdef CRASH_TEST
+            CrashPoint(1);
+#endif
+            failed = failed || ApplyTxn(txn, length, 0) != 0;
+            free(txn);
         }
+    }
+    if (failed) {
+        printf("Error: Could not write to disk\n");
+        return 0;
+    }
 
-        // Update fileentry
-        file_entry.size += bytes_read;
+    // Committed: blocks freed since the last commit can be reused
+    if (fat_lo <= fat_hi) {
+        int64_t words = fat_hi / WordBits - fat_lo / WordBits + 1;
+        memset(&fat_dirty[fat_lo / WordBits], 0, words * sizeof(uint64_t));
+    }
+    fat_lo = INT64_MAX;
+    fat_hi = -1;
+    memset(entry_dirty, 0, list_size);
+    ReleasePending();
+    return 1;
+}
+
+// Flush and close the disk
+int CloseDisk() {
+    int flushed = FlushDisk();
+    UnmapDisk();
+    fclose(disk);
+    return flushed;
+}
 
-        // Move to next data block
-        data_index = t_fat->listentries[data_index].dummy;
-        data_index = EndianConversion(data_index);
+// Function to format disk
+void FormatDisk(long long size, long long count, long long entries) {
+    // Lay the disk out for the new geometry
+    if (!SetGeometry(size, count, entries, FormatVersion)) {
+        printf("Error: Invalid disk geometry\n");
+        return;
+    }
+    Superblock sb;
+    memset(&sb, 0, sizeof(Superblock));
+    memcpy(sb.magic, DiskMagic, sizeof(sb.magic));
+    sb.version = FormatVersion;
+    sb.block_size = block_size;
+    sb.block_count = block_count;
+    sb.list_size = list_size;
+    sb.name_size = NameSize;
+    sb.data_offset = data_offset;
+    sb.journal_offset = journal_offset;
+    sb.journal_size = journal_size;
+    JournalHeader journal = {JournalMagic, 0, 1, JournalStart}; // Empty, the first transaction is number 1
+    FatEntry reserved = {EndianConversion(EndOfChain)}; // Block 0
+
+    // Drop the old contents, the new disk is sparse and every block reads as zeros
+    fflush(disk);
+    UnmapDisk();
+    int failed = ftruncate(fileno(disk), 0) != 0 || ftruncate(fileno(disk), BlockOffset(block_count)) != 0 ||
+                 pwrite(fileno(disk), &sb, sizeof(Superblock), 0) != sizeof(Superblock) ||
+                 pwrite(fileno(disk), &reserved, sizeof(FatEntry), SuperSize) != sizeof(FatEntry) ||
+                 pwrite(fileno(disk), &journal, sizeof(JournalHeader), journal_offset) !=
+                     sizeof(JournalHeader);
+
+    // Continue on the empty tables
+    if (MapDisk() == 0) {
+        exit(1);
+    }
+    if (failed) {
+        printf("Error: Could not resize disk\n");
+        return;
     }
+    printf("Disk formatted\n");
+}
 
-    // Update filelist
-    t_filelist->filelist[filelist_index] = file_entry;
-    t_filelist->filelist[filelist_index].hidden = 0;
+// Write file to disk
+void WriteToDisk(char *src_path, char *dest_file_name) {
+    // The name as it is stored must be free
+    char stored_name[NameSize];
+    strncpy(stored_name, dest_file_name, NameSize);
+    stored_name[NameSize - 1] = '\0';
+    if (FindFileInList(stored_name) != -1) {
+        printf("Error: File already exists\n");
+        return;
+    }
 
-    // Write FAT and filelist to disk
-    fseek(disk, 0, SEEK_SET);
-    fwrite(t_fat, sizeof(FAT), 1, disk);
-    fwrite(t_filelist, sizeof(FileList), 1, disk);
+    // Open the source, `-` is stdin
+    int from_stdin = strcmp(src_path, "-") == 0;
+    if (from_stdin && script_stdin) {
+        printf("Error: stdin holds the batch script\n");
+        return;
+    }
+    int src_fd = from_stdin ? STDIN_FILENO : open(src_path, O_RDONLY);
+    if (src_fd < 0) {
+        printf("Error: Could not open source file\n");
+        return;
+    }
 
-    printf("File: %s written to disk\n", dest_file_name);
-    fclose(src_file);
-    fclose(disk);
-    free(t_fat);
-    free(t_filelist);
-}
+    // Find free file list entry
+    int filelist_index = FindFreeFileListEntry(filelist);
+    char *buffer = malloc(ChunkBlocks * block_size);
+    if (filelist_index == -1 || buffer == NULL) {
+        printf(filelist_index == -1 ? "Error: File list is full\n" : "Error: Memory allocation failed\n");
+        if (!from_stdin) {
+            close(src_fd);
+        }
+        free(buffer);
+        return;
+    }
 
-// Read file from disk
-void ReadFromDisk(char *src_file_name, char *dest_path) {
+    // Find free FAT entry, a block freed since the last commit is free once AppendBlocks commits
+    if (free_blocks + pending_blocks == 0) {
+        printf("Error: Disk is full\n");
+        printf("Error: File list is full\n");
+        if (!from_stdin) {
+            close(src_fd);
+        }
+        free(buffer);
+        return;
+    }
 
-    // Open the disk for reading
-    FILE *disk = fopen(disk_location, "rb");
-    if (disk == NULL) {
-        printf("Error: Could not open disk\n");
-    return;
+    // A regular file is sized once, a pipe is not
+    struct stat st;
+    long long f_size = -1;
+    if (fstat(src_fd, &st) == 0 && S_ISREG(st.st_mode)) {
+        f_size = st.st_size;
     }
-    
-    // Read from Disk FAT
-    FAT *t_fat = malloc(sizeof(FAT));
-    fseek(disk, 0, SEEK_SET);
-    fread(t_fat, sizeof(FAT), 1, disk);
 
-    // Read from Disk File List
-    FileList *t_filelist = malloc(sizeof(FileList));
-    fseek(disk, sizeof(FAT), SEEK_SET);
-    fread(t_filelist, sizeof(FileList), 1, disk);
+    int64_t first_block = -1;
+    int64_t last_block = -1;
+    long long size = 0;
+    const char *error = NULL;
+
+    if (f_size >= 0) {
+        // Allocate the whole chain, an empty file still gets one block
+        int64_t n_clusters = (f_size + block_size - 1) / block_size;
+        if (AppendBlocks(n_clusters > 0 ? n_clusters : 1, &first_block, &last_block) != 0) {
+            printf("Error: Not enough free space on disk\n");
+            if (!from_stdin) {
+                close(src_fd);
+            }
+            free(buffer);
+            return;
+        }
+
+        // Stream it one run of consecutive blocks at a time
+        int64_t filled = -1; // Last block that holds data
+        uint64_t block = first_block;
+        while (block != EndOfChain && size < f_size) {
+            int64_t run = RunLength(block, ChunkBlocks);
+            long long left = f_size - size;
+            size_t want = (long long)run * block_size < left ? (size_t)run * block_size : (size_t)left;
+            ssize_t n;
+            if (disk_map != NULL) {
+                // Straight into the mapped blocks
+                if (ReserveBlocks(block, run) != 0) {
+                    error = "Error: Not enough free space on disk\n";
+                    break;
+                }
+                n = ReadFull(src_fd, disk_map + BlockOffset(block), want);
+                if (n >= 0) {
+                    memset(disk_map + BlockOffset(block) + n, 0, (size_t)run * block_size - n);
+                }
+            } else {
+                n = ReadFull(src_fd, buffer, want);
+                if (n >= 0 && StoreChain(block, buffer, n) != 0) {
+                    error = "Error: Could not write to disk\n";
+                    break;
+                }
+            }
+            if (n < 0) {
+                error = "Error: Could not read source file\n";
+                break;
+            }
+            if (n > 0) {
+                filled = block + (n - 1) / block_size;
+            }
+            size += n;
+            if ((size_t)n < want) {
+                break; // The source shrank
+            }
+            block = EndianConversion(fat[block + run - 1].dummy);
+        }
+
+        // Give back the blocks the source did not fill
+        int64_t keep = filled != -1 ? filled : first_block;
+        uint64_t rest = EndianConversion(fat[keep].dummy);
+        if (error == NULL && rest != EndOfChain) {
+            SetFat(keep, EndOfChain);
+            FreeChain(rest);
+        }
+    } else {
+        // Allocate as the data arrives
+        for (;;) {
+            ssize_t n = ReadFull(src_fd, buffer, ChunkBlocks * block_size);
+            if (n < 0) {
+                error = "Error: Could not read source file\n";
+                break;
+            }
+            if (n == 0 && first_block != -1) {
+                break;
+            }
+            int64_t chunk_first;
+            int64_t count = n > 0 ? (n + block_size - 1) / block_size : 1;
+            if (AppendBlocks(count, &chunk_first, &last_block) != 0) {
+                error = "Error: Not enough free space on disk\n";
+                break;
+            }
+            if (first_block == -1) {
+                first_block = chunk_first;
+            }
+            if (StoreChain(chunk_first, buffer, n) != 0) {
+                error = "Error: Could not write to disk\n";
+                break;
+            }
+            size += n;
+            if (n < ChunkBlocks * block_size) {
+                break;
+            }
+        }
+    }
+
+    if (!from_stdin) {
+        close(src_fd);
+    }
+    free(buffer);
+
+    // Roll back: nothing of the file stays on the disk
+    if (error != NULL) {
+        if (first_block != -1) {
+            FreeChain(first_block);
+        }
+        printf("%s", error);
+        return;
+    }
+
+    // Update filelist
+    FileEntry *file_entry = &filelist[filelist_index];
+    memset(file_entry, 0, sizeof(FileEntry));
+    strcpy(file_entry->filename, stored_name);
+    file_entry->first_block = first_block;
+    RefBlock(first_block, 1);
+    file_entry->size = size;
+    file_entry->hidden = 0;
+    MarkFileEntry(filelist_index);
+    IndexAdd(filelist_index);
 
+    printf("File: %s written to disk\n", dest_file_name);
+}
+
+// Read file from disk
+void ReadFromDisk(char *src_file_name, char *dest_path) {
     // Find the file in the File List
-    int file_index = FindFileInList(t_filelist, src_file_name);
+    int file_index = FindFileInList(src_file_name);
     if (file_index == -1) {
         printf("Error: File not found\n");
-        fclose(disk);
-        free(t_fat);
-        free(t_filelist);
         return;
     }
 
     // Open the destination file for writing
-    FILE *dest_file = fopen(dest_path, "wb");
-    if (dest_file == NULL) {
+    int dest_fd = open(dest_path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    char *buffer = malloc(ChunkBlocks * block_size);
+    if (dest_fd < 0 || buffer == NULL) {
         printf("Error: Could not open destination file\n");
-        fclose(disk);
-        free(t_fat);
-        free(t_filelist);
+        if (dest_fd >= 0) {
+            close(dest_fd);
+        }
+        free(buffer);
         return;
     }
 
+    // Blocks written through stdio must reach the descriptor first
+    fflush(disk);
+
     // Read file from disk
-    int data_index = t_filelist->filelist[file_index].first_block;
-    int remaining_size = t_filelist->filelist[file_index].size;
-
-    // Read data block from disk and check if it is the last one
-    while (data_index != 0xFFFFFFFF && remaining_size > 0) {
-        // Read data block from disk
-        DataBlock data_block;
-        fseek(disk,sizeof(FAT) + sizeof(FileList) + (data_index * sizeof(DataBlock)),SEEK_SET);
-        fread(&data_block, sizeof(DataBlock), 1, disk);
-
-        // Write data block to destination file
-        int bytes_to_write =
-            (remaining_size < DataSize) ? remaining_size : DataSize; fwrite(data_block.data, 1, bytes_to_write, dest_file);
-
-        // Move to next data block
-        data_index = t_fat->listentries[data_index].dummy;
-        data_index = EndianConversion(data_index);
+    uint64_t data_index = filelist[file_index].first_block;
+    long long remaining_size = filelist[file_index].size;
+
+    // Copy one run of consecutive blocks at a time
+    AdviseData(MADV_SEQUENTIAL);
+    int failed = 0;
+    while (data_index < (uint64_t)block_count && remaining_size > 0) {
+        int64_t run = RunLength(data_index, (remaining_size + block_size - 1) / block_size);
+        long long bytes_to_write = (long long)run * block_size < remaining_size ? (long long)run * block_size : remaining_size;
+
+        if (CopyOut(dest_fd, BlockOffset(data_index), bytes_to_write, buffer) != 0) {
+            failed = 1;
+            break;
+        }
+
+        // Move to the block after the run
+        data_index = EndianConversion(fat[data_index + run - 1].dummy);
         remaining_size -= bytes_to_write;
     }
+    AdviseData(MADV_NORMAL);
 
-    // Close the disk and destination file
-    fclose(dest_file);
-    fclose(disk);
+    // Close the destination file
+    if (close(dest_fd) != 0 || failed) {
+        printf("Error: Could not copy the file from disk\n");
+        free(buffer);
+        return;
+    }
+    free(buffer);
 
     printf("File: %s read from disk\n", src_file_name);
-
-    // Free memory
-    free(t_fat);
-    free(t_filelist);
 }
 
 // Deletes a file from the disk
 void DeleteFromDisk(char *src_file_name) {
-    FILE *disk = fopen(disk_location, "rb+");
-    
-    if (disk == NULL) {
-        printf("Error: Could not open disk\n");
-    return;
-    }
-    
-    // Read from Disk FAT
-    FAT *t_fat = malloc(sizeof(FAT));
-    fseek(disk, 0, SEEK_SET);
-    fread(t_fat, sizeof(FAT), 1, disk);
-
-    // Read from Disk File List
-    FileList *t_filelist = malloc(sizeof(FileList));
-    fseek(disk, sizeof(FAT), SEEK_SET);
-    fread(t_filelist, sizeof(FileList), 1, disk);
-
     // Find the file in the File List
-    int file_index = FindFileInList(t_filelist, src_file_name);
+    int file_index = FindFileInList(src_file_name);
     if (file_index == -1) {
         printf("Error: File not found\n");
-        fclose(disk);
-        free(t_fat);
-        free(t_filelist);
         return;
     }
 
-    // Free the FAT entries occupied by the file
-    int block_index = t_filelist->filelist[file_index].first_block;
-    while (block_index != 0xFFFFFFFF) {
-        int next_block_index = t_fat->listentries[block_index].dummy;
-        next_block_index = EndianConversion(next_block_index);
-        t_fat->listentries[block_index].dummy = 0x00000000;
-        block_index = next_block_index;
-    }
+    // Free the FAT entries occupied by the file, the blocks a duplicate shares stay
+    RefBlock(filelist[file_index].first_block, -1);
+    FreeChain(filelist[file_index].first_block);
 
     // Remove the file from the file list
-    t_filelist->filelist[file_index].filename[0] = '\0';
-    t_filelist->filelist[file_index].first_block = 0;
-    t_filelist->filelist[file_index].size = 0;
+    IndexRemove(file_index);
+    filelist[file_index].filename[0] = '\0';
+    filelist[file_index].first_block = 0;
+    filelist[file_index].size = 0;
+    MarkFileEntry(file_index);
 
     printf("File deleted: %s\n", src_file_name);
-
-    // Write to Disk FAT
-    fseek(disk, 0, SEEK_SET);
-    fwrite(t_fat, sizeof(FAT), 1, disk);
-
-    // Write to Disk File List
-    fseek(disk, sizeof(FAT), SEEK_SET);
-    fwrite(t_filelist, sizeof(FileList), 1, disk);
-
-
-    fclose(disk);
-    free(t_fat);
-    free(t_filelist);
 }
 
 // List all files on the disk
 void List() {
-    disk = fopen(disk_location, "rb");
-
-    // Read from Disk File List
-    FileList *t_filelist = malloc(sizeof(FileList));
-    fseek(disk, sizeof(FAT), SEEK_SET);
-    fread(t_filelist, sizeof(FileList), 1, disk);
-
-    // Check if there are any files on the disk
-    if (t_filelist->filelist[0].filename[0] == '\0' &&
-        t_filelist->filelist[1].filename[1] == '\0' &&
-        t_filelist->filelist[2].filename[2] == '\0' &&
-        t_filelist->filelist[4].filename[4] == '\0' &&
-        t_filelist->filelist[5].filename[5] == '\0') {
+    // Check if there are any files on the disk (a short File List only has its first entry checked)
+    if (filelist[0].filename[0] == '\0' &&
+        (list_size < 6 ||
+         (filelist[1].filename[1] == '\0' &&
+          filelist[2].filename[2] == '\0' &&
+          filelist[4].filename[4] == '\0' &&
+          filelist[5].filename[5] == '\0'))) {
         printf("No files on disk\n");
         return;
     }
     
     printf("Filename\tSize\n");
-    for (int i = 0; i < ListSize; i++) {
-        char *filename = t_filelist->filelist[i].filename;
-        int size = t_filelist->filelist[i].size;
-        int hidden = t_filelist->filelist[i].hidden;
+    for (int i = 0; i < list_size; i++) {
+        char *filename = filelist[i].filename;
+        long long size = filelist[i].size;
+        int hidden = filelist[i].hidden;
         
         if (filename[0] == '\0' || hidden) {
             continue; // Skip hidden files or empty entries
         }
         
-        printf("%-15s\t%d\n", filename, size);
+        printf("%-15s\t%lld\n", filename, size);
     }
-    // Close the disk
-    fclose(disk);
+}
 
-    // Free the allocated memory
-    free(t_filelist);
+// Order two entries by size, equal sizes keep their order on the list
+static int CompareBySize(const void *a, const void *b) {
+    const FileEntry *x = *(const FileEntry * const *)a;
+    const FileEntry *y = *(const FileEntry * const *)b;
+    if (x->size != y->size) {
+        return x->size < y->size ? -1 : 1;
+    }
+    return (x > y) - (x < y);
 }
 
 // Arrange the file list in ascending order based on file size
 void SortFilesBySize() {
-    FILE *disk = fopen(disk_location, "rb+");
-    
-    if (disk == NULL) {
-        printf("Error: Could not open disk\n");
-    return;
-    }	
-    
-    // Read from Disk
-    FileList *t_filelist = malloc(sizeof(FileList));
-    fseek(disk, sizeof(FAT), SEEK_SET);
-    fread(t_filelist, sizeof(FileList), 1, disk);
-
-    // Close the disk
-    fclose(disk);
-
     // Whether there are file on the disk
-    if (t_filelist->filelist[0].filename[0] == '\0') {
+    if (filelist[0].filename[0] == '\0') {
         printf("No files on disk\n");
         return;
     }
 
-    // Sort files in the disk using bubble sort (Ascending Order)
-    for (int i = 0; i < ListSize - 1; i++) {
-        for (int j = i + 1; j < ListSize; j++) {
-            int i_size = t_filelist->filelist[i].size;
-            int j_size = t_filelist->filelist[j].size;
-
-            if (i_size > j_size) {
-                FileEntry temp = t_filelist->filelist[i];
-                t_filelist->filelist[i] = t_filelist->filelist[j];
-                t_filelist->filelist[j] = temp;
-            }
+    // Sort pointers to the visible entries, the order on the disk does not change
+    const FileEntry **sorted = malloc(list_size * sizeof(FileEntry *));
+    if (sorted == NULL) {
+        printf("Error: Memory allocation failed\n");
+        return;
+    }
+    int count = 0;
+    for (int i = 0; i < list_size; i++) {
+        if (filelist[i].filename[0] != '.' && filelist[i].filename[0] != '\0') {
+            sorted[count++] = &filelist[i];
         }
     }
-    
+    qsort(sorted, count, sizeof(FileEntry *), CompareBySize);
+
     // Display sorted file list
     printf("Filename\tSize\n");
-    for (int i = 0; i < ListSize; i++) {
-        char *filename = t_filelist->filelist[i].filename;
-        int size = t_filelist->filelist[i].size;
-
-    // Check whether file entry is valid 
-        if (filename[0] != '.' && filename[0] != '\0') {
-            printf("%-15s\t%d\n", filename, size);
-        }
+    for (int i = 0; i < count; i++) {
+        printf("%-15s\t%lld\n", sorted[i]->filename, (long long)sorted[i]->size);
     }
     // Free allocated Memory
-    free(t_filelist);
+    free(sorted);
 }
 
 // Function to rename a file on the disk
 void RenameFile(char *source_file, char *new_name) {
-    FILE *disk = fopen(disk_location, "rb+");
-    if (disk == NULL) {
-        printf("Error: Could not open disk\n");
-        return;
-    }
-
-    FileList *t_filelist = malloc(sizeof(FileList));
-    
-    //Get the files
-    fseek(disk, sizeof(FAT), SEEK_SET);
-    fread(t_filelist, sizeof(FileList), 1, disk);
-
     // Index of the source_file
-    int index = -1;
-    for (int i = 0; i < ListSize; i++) {
-        if (strcmp(t_filelist->filelist[i].filename, source_file) == 0) {
-            index = i;
-            break;
-        }
-    }
+    int index = FindFileInList(source_file);
 
     // Error case
     if (index == -1) {
         printf("Error: File not found\n");
-        fclose(disk);
-        free(t_filelist);
         return;
     }
     
     // Check if the new name is the same as the old name
     if (strcmp(source_file, new_name) == 0) {
         printf("Error: New name is the same as the old name\n");
-        fclose(disk);
-        free(t_filelist);
         return;
     }
     
-    // Check if the new name is the same as the old name
-    if (strcmp(source_file, new_name) == 0) {
-        printf("Error: New name is the same as the old name\n");
-        fclose(disk);
-        free(t_filelist);
+    // The new name must be free
+    char stored_name[NameSize];
+    strncpy(stored_name, new_name, NameSize);
+    stored_name[NameSize - 1] = '\0';
+    if (FindFileInList(stored_name) != -1) {
+        printf("Error: File already exists\n");
         return;
     }
-    
+
     // Rename the source_file
-    strncpy(t_filelist->filelist[index].filename, new_name, NameSize);
-    t_filelist->filelist[index].filename[NameSize - 1] = '\0';
+    IndexRemove(index);
+    strncpy(filelist[index].filename, stored_name, NameSize);
+    MarkFileEntry(index);
+    IndexAdd(index);
 
-    // Update the disk
-    fseek(disk, sizeof(FAT), SEEK_SET);
-    fwrite(t_filelist, sizeof(FileList), 1, disk);
     printf("The name of the file %s is changed to %s \n", source_file, new_name);
-    fclose(disk);
-    free(t_filelist);
 }
 
 // Function to duplicate a file on the disk
 
 void DuplicateFile(char *source_file) {
-    FILE *disk = fopen(disk_location, "rb+");
-    if (disk == NULL) {
-        printf("Error: Could not open disk\n");
-        return;
-    }
-
-    FileList *t_filelist = malloc(sizeof(FileList));
-    if (t_filelist == NULL) {
-        printf("Error: Memory allocation failed\n");
-        fclose(disk);
-        return;
-    }
-    
-    // Read the file 
-    fseek(disk, sizeof(FAT), SEEK_SET);
-    fread(t_filelist, sizeof(FileList), 1, disk);
-
     // Find the index of the source_file
-    int index = -1;
-    for (int i = 0; i < ListSize; i++) {
-        if (strcmp(t_filelist->filelist[i].filename, source_file) == 0) {
-            index = i;
-            break;
-        }
-    }
+    int index = FindFileInList(source_file);
 
     // Whether the file is available
     if (index == -1) {
         printf("Error: File not found\n");
-        fclose(disk);
-        free(t_filelist);
         return;
     }
     
-    // Empty Slot
-    int copy_index = -1;
-    for (int i = 0; i < ListSize; i++) {
-        if (t_filelist->filelist[i].filename[0] == '\0') {
-            copy_index = i;
-            break;
-        }
+    // The name of the copy must be free
+    char copy_name[NameSize];
+    snprintf(copy_name, NameSize, "%s_copy", source_file);
+    if (FindFileInList(copy_name) != -1) {
+        printf("Error: File already exists\n");
+        return;
     }
 
+    // Empty Slot
+    int copy_index = FindFreeFileListEntry(filelist);
+
     // Whether the empty slot available
     if (copy_index == -1) {
         printf("Error: No space to duplicate file\n");
-        fclose(disk);
-        free(t_filelist);
         return;
     }
     
-    // Create the duplicate file entry
-    snprintf(t_filelist->filelist[copy_index].filename, NameSize, "%s_copy", source_file);
-    t_filelist->filelist[copy_index].first_block = t_filelist->filelist[index].first_block;
-    t_filelist->filelist[copy_index].size = t_filelist->filelist[index].size;
-    t_filelist->filelist[copy_index].hidden = 0;
-
-    // Update the Disk
-    fseek(disk, sizeof(FAT), SEEK_SET);
-    fwrite(t_filelist, sizeof(FileList), 1, disk);
-
-    fclose(disk);
-    free(t_filelist);
+    // Create the duplicate file entry, it shares the chain of the file whatever its size
+    strcpy(filelist[copy_index].filename, copy_name);
+    filelist[copy_index].first_block = filelist[index].first_block;
+    RefBlock(filelist[index].first_block, 1);
+    filelist[copy_index].size = filelist[index].size;
+    filelist[copy_index].hidden = 0;
+    MarkFileEntry(copy_index);
+    IndexAdd(copy_index);
 }
 
 // Function to search for a file on the disk
 void Search(char *source_file) {
-    FILE *disk = fopen(disk_location, "rb");
-    if (disk == NULL) {
-        printf("Error: Could not open disk\n");
-        return;
-    }
-
-    FileList *t_filelist = malloc(sizeof(FileList));
-    
-    // Read the file list from the disk
-    fseek(disk, sizeof(FAT), SEEK_SET);
-    fread(t_filelist, sizeof(FileList), 1, disk);
-
     // Search for the file in the file list
-    int found = 0;
-    for (int i = 0; i < ListSize; i++) {
-        if (strcmp(t_filelist->filelist[i].filename, source_file) == 0 && t_filelist->filelist[i].hidden == 0) {
-            found = 1;
-            break;
-        }
-    }
+    int index = FindFileInList(source_file);
+    int found = index != -1 && filelist[index].hidden == 0;
 
     if (found) {
         printf("YES\n");
     } else {
         printf("NO\n");
     }
-
-    fclose(disk);
-    free(t_filelist);
 }
 
 void Hide(char *source_file) {
-    // Open the disk
-    FILE *disk = fopen(disk_location, "rb+");
-    if (disk == NULL) {
-        printf("Error: Could not open disk\n");
-        return;
-    }
-
-    // Read the FileList from the disk
-    FileList *t_filelist = malloc(sizeof(FileList));
-    fseek(disk, sizeof(FAT), SEEK_SET);
-    fread(t_filelist, sizeof(FileList), 1, disk);
-
     // Find the file in the FileList
-    int index = -1;
-    for (int i = 0; i < ListSize; i++) {
-        if (strcmp(t_filelist->filelist[i].filename, source_file) == 0) {
-            index = i;
-            break;
-        }
-    }
+    int index = FindFileInList(source_file);
 
     // Check if the file is found
     if (index == -1) {
         printf("Error: File not found\n");
-        fclose(disk);
-        free(t_filelist);
         return;
     }
 
     // Update the FileList to hide the file
-    t_filelist->filelist[index].hidden = 1;
-
-    // Write the updated FileList back to the disk
-    fseek(disk, sizeof(FAT), SEEK_SET);
-    fwrite(t_filelist, sizeof(FileList), 1, disk);
+    filelist[index].hidden = 1;
+    MarkFileEntry(index);
 
     printf("File: %s is hided successfully \n", source_file);
-    // Close the disk and free memory
-    fclose(disk);
-    free(t_filelist);
 }
 
 void Unhide(char *source_file) {
-    // Open the disk
-    FILE *disk = fopen(disk_location, "rb+");
-    if (disk == NULL) {
-        printf("Error: Could not open disk\n");
-        return;
-    }
-
-    // Read the FileList from the disk
-    FileList *t_filelist = malloc(sizeof(FileList));
-    fseek(disk, sizeof(FAT), SEEK_SET);
-    fread(t_filelist, sizeof(FileList), 1, disk);
-
     // Find the file in the FileList
-    int index = -1;
-    for (int i = 0; i < ListSize; i++) {
-        if (strcmp(t_filelist->filelist[i].filename, source_file) == 0 &&
-            t_filelist->filelist[i].hidden == 1) {
-            index = i;
-            break;
-        }
-    }
+    int index = FindFileInList(source_file);
 
     // Check if the file is found and hidden
-    if (index == -1) {
+    if (index == -1 || filelist[index].hidden != 1) {
         printf("Error: File not found or not hidden\n");
-        fclose(disk);
-        free(t_filelist);
         return;
     }
 
     // Update the FileList to unhide the file
-    t_filelist->filelist[index].hidden = 0;
+    filelist[index].hidden = 0;
+    MarkFileEntry(index);
 
-    // Write the updated FileList back to the disk
-    fseek(disk, sizeof(FAT), SEEK_SET);
-    fwrite(t_filelist, sizeof(FileList), 1, disk);
     printf("File: %s is unhided successfully \n", source_file);
-    // Close the disk and free memory
-    fclose(disk);
-    free(t_filelist);
 }
 
 // Creates the filelist.txt
 void PrintFileList() {
-    FILE *disk = fopen(disk_location, "rb");
-    
-    if (disk == NULL) {
-        printf("Error: Could not open disk\n");
-        return;
-    }
-    
-    FileList *t_filelist = malloc(sizeof(FileList));
-    if (t_filelist == NULL) {
-        printf("Error: Memory allocation failed\n");
-        fclose(disk);
-        return;
-    }
-    
-    // Read File
-    fseek(disk, sizeof(FAT), SEEK_SET);
-    fread(t_filelist, sizeof(FileList), 1, disk);
-
     // Write to file
     FILE *filelist_file = fopen("filelist.txt", "w");
     
     if (filelist_file == NULL) {
         printf("Error: Could not create filelist.txt\n");
-        fclose(disk);
-        free(t_filelist);
         return;
     }
     
     fprintf(filelist_file,
             "Item\tFilename\t\tFirst Block\t\tFile Size(bytes)\n");
-    for (int i = 0; i < ListSize; i++) {
-        char *filename = t_filelist->filelist[i].filename;
-        uint32_t first_block = t_filelist->filelist[i].first_block;
-        uint32_t size = t_filelist->filelist[i].size;
-        int hidden = t_filelist->filelist[i].hidden;
+    for (int i = 0; i < list_size; i++) {
+        char *filename = filelist[i].filename;
+        unsigned long long first_block = filelist[i].first_block;
+        unsigned long long size = filelist[i].size;
+        int hidden = filelist[i].hidden;
 
 	// Create a list
         if (filename[0] == '\0' || hidden) {
             continue; // Skip hidden files or empty entries
         }
 
-        fprintf(filelist_file, "%d\t\t%-15s\t%4d\t\t\t%d\n", i, filename, first_block, size);
+        fprintf(filelist_file, "%d\t\t%-15s\t%4llu\t\t\t%llu\n", i, filename, first_block, size);
     }
     
     printf("File: filelist.txt is created successfully \n");
-    // Close the disk and file
+    // Close the file
     fclose(filelist_file);
-    fclose(disk);
-
-    // Free the memory
-    free(t_filelist);
 }
 
 // Creates the fat.txt 
 void PrintFAT() {
-    // Open the disk
-    disk = fopen(disk_location, "rb+");
-    
-    //Open Disk error
-    if (disk == NULL) {
-        printf("Error: Could not open disk\n");
-        return;
-    }
-    
-    // Read Disk FAT
-    FAT *t_fat = malloc(sizeof(FAT));
-   
-   // Memory Allocation Error
-    if (t_fat == NULL) {
-        printf("Error: Memory allocation failed\n");
-        fclose(disk);
-        return;
-    }
-    
-    fseek(disk, 0, SEEK_SET);
-    fread(t_fat, sizeof(FAT), 1, disk);
-
     // Print the FAT
     FILE *fat_file = fopen("fat.txt", "w");
     
     // Create file error
     if (fat_file == NULL) {
         printf("Error: Could not create fat.txt\n");
-        fclose(disk);
-        free(t_fat);
         return;
     }
     fprintf(fat_file,
             "Entry\tdummy\t\tEntry\tdummy\t\tEntry\tdummy\t\tEntry\tdummy\n");
-    for (int i = 0; i < FatSize; i += 4) {
-        fprintf(fat_file, "%04x\t%08x\t%04x\t%08x\t%04x\t%08x\t%04x\t%08x\n", i,
-                t_fat->listentries[i].dummy, i + 1,
-                t_fat->listentries[i + 1].dummy, i + 2,
-                t_fat->listentries[i + 2].dummy, i + 3,
-                t_fat->listentries[i + 3].dummy);
+    for (int64_t i = 0; i < block_count; i++) {
+        fprintf(fat_file, "%04llx\t%016llx%s", (unsigned long long)i, (unsigned long long)fat[i].dummy,
+                i % 4 == 3 || i == block_count - 1 ? "\n" : "\t");
     }
 
     printf("File: fat.txt is created successfully \n");
     
-    // Close the disk and file
+    // Close the file
     fclose(fat_file);
-    fclose(disk);
-
-    // Free the memory
-    free(t_fat);
 }
 
-// // Function to defragment the disk
-void Defragment() {
-    // Open the disk for reading and writing
-    FILE *disk = fopen(disk_location, "rb+");
-    if (disk == NULL) {
-        printf("Error: Could not open disk\n");
-        return;
+// Layout and references of the blocks while defragmenting
+typedef struct {
+    int64_t *plan; // Block (where it was found) that belongs at every place of the layout, from 1 on
+    int64_t *where; // Place of a block found at an index, -1 if it is not in the layout
+    int64_t *owner; // Block (where it was found) at every place, -1 if free
+    char *cut; // 1 for a place on a chain or cycle, 2 if its block moves out to cut it
+    int64_t *ref_start; // First reference to the block at a place in refs
+    int64_t *ref_count; // References to the block at a place
+    int64_t *refs; // FAT entries that point at a block, -(entry + 1) for a File List entry
+    int64_t planned; // Blocks in the layout
+} Defrag;
+
+// Copy the data of a block to another block
+int CopyBlock(int64_t from, int64_t to) {
+    if (disk_map != NULL) {
+        char *dest = MapBlock(to, 1);
+        if (dest == NULL) {
+            return -1;
+        }
+        memcpy(dest, MapBlock(from, 0), block_size);
+        return 0;
     }
+    static char block[MaxBlockSize];
+    ssize_t n = pread(fileno(disk), block, block_size, BlockOffset(from));
+    if (n < 0) {
+        return -1;
+    }
+    memset(block + n, 0, block_size - n); // Never written
+    return pwrite(fileno(disk), block, block_size, BlockOffset(to)) == block_size ? 0 : -1;
+}
 
-    // Create dummy file to write to
-    char temp_file_name[] = "/tmp/disk.XXXXXX";
-    int temp_file_descriptor = mkstemp(temp_file_name);
-    if (temp_file_descriptor == -1) {
-        printf("Error: could not create dummy file.\n");
-        fclose(disk);
-        return;
+// Move a block to a free block: the data is copied before anything points at the copy and the old
+// block is freed last, so the disk is consistent at every commit. The target must be free in the
+// committed FAT too, not only vacated since the last commit.
+int MoveBlock(Defrag *d, int64_t from, int64_t to) {
+    if (CopyBlock(from, to) != 0) {
+        return -1;
     }
 
-    // Open dummy file
-    FILE *disk2 = fdopen(temp_file_descriptor, "wb+");
-    if (disk2 == NULL) {
-        printf("Error: Could not open dummy file\n");
-        fclose(disk);
-        remove(temp_file_name);
-        return;
+    // The copy takes over the next block and every reference
+    uint64_t next_block = EndianConversion(fat[from].dummy);
+    SetFat(to, next_block);
+    for (int64_t i = d->ref_start[from]; i < d->ref_start[from] + d->ref_count[from]; i++) {
+        if (d->refs[i] >= 0) {
+            SetFat(d->refs[i], to);
+        } else {
+            filelist[-d->refs[i] - 1].first_block = to;
+            RefBlock(to, 1);
+            RefBlock(from, -1);
+            MarkFileEntry(-d->refs[i] - 1);
+        }
+    }
+    if (next_block < (uint64_t)block_count) {
+        for (int64_t i = d->ref_start[next_block]; i < d->ref_start[next_block] + d->ref_count[next_block]; i++) {
+            if (d->refs[i] == from) {
+                d->refs[i] = to;
+            }
+        }
     }
+    d->ref_start[to] = d->ref_start[from];
+    d->ref_count[to] = d->ref_count[from];
+    d->ref_count[from] = 0;
+    SetFat(from, 0);
 
-    // Read from Disk
-    FAT *t_fat = malloc(sizeof(FAT));
-    if (t_fat == NULL) {
-        printf("Error: Memory allocation failed\n");
-        fclose(disk);
-        fclose(disk2);
-        remove(temp_file_name);
-        return;
+    d->owner[to] = d->owner[from];
+    d->owner[from] = -1;
+    d->where[d->owner[to]] = to;
+    return 0;
+}
+
+// 1 once budget moves (or milliseconds) are spent, a budget of 0 has no limit
+int BudgetSpent(long budget, int in_ms, long moves, struct timespec *start) {
+    if (budget <= 0) {
+        return 0;
     }
-    fseek(disk, 0, SEEK_SET);
-    fread(t_fat, sizeof(FAT), 1, disk);
+    if (!in_ms) {
+        return moves >= budget;
+    }
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) * 1000 + (now.tv_nsec - start->tv_nsec) / 1000000 >= budget;
+}
 
-    FileList *t_filelist = malloc(sizeof(FileList));
-    if (t_filelist == NULL) {
-        printf("Error: Memory allocation failed\n");
-        fclose(disk);
-        fclose(disk2);
-        remove(temp_file_name);
-        free(t_fat);
+// Function to defragment the disk in place
+void Defragment(long budget, int in_ms) {
+    printf("Defragmenting...\n");
+    if (FlushDisk() == 0) {
         return;
     }
-    fseek(disk, sizeof(FAT), SEEK_SET);
-    fread(t_filelist, sizeof(FileList), 1, disk);
 
-    // Create new FAT and File List
-    FAT *new_fat = malloc(sizeof(FAT));
-    
-    if (new_fat == NULL) {
+    Defrag d;
+    d.plan = malloc(block_count * sizeof(int64_t));
+    d.where = malloc(block_count * sizeof(int64_t));
+    d.owner = malloc(block_count * sizeof(int64_t));
+    d.cut = calloc(block_count, 1);
+    d.ref_start = malloc(block_count * sizeof(int64_t));
+    d.ref_count = calloc(block_count, sizeof(int64_t));
+    d.refs = malloc((block_count + list_size) * sizeof(int64_t));
+    if (d.plan == NULL || d.where == NULL || d.owner == NULL || d.cut == NULL || d.ref_start == NULL ||
+        d.ref_count == NULL || d.refs == NULL) {
         printf("Error: Memory allocation failed\n");
-        fclose(disk);
-        fclose(disk2);
-        remove(temp_file_name);
-        free(t_fat);
-        free(t_filelist);
+        free(d.plan);
+        free(d.where);
+        free(d.owner);
+        free(d.cut);
+        free(d.ref_start);
+        free(d.ref_count);
+        free(d.refs);
         return;
     }
-    memcpy(new_fat, t_fat, sizeof(FAT));
-
-    FileList *new_filelist = malloc(sizeof(FileList));
-    memcpy(new_filelist, t_filelist, sizeof(FileList));
-
-    printf("Defragmenting...\n");
 
     // Find number of files
     int num_files = 0;
-    for (int i = 0; i < ListSize; i++) {
-        if (t_filelist->filelist[i].filename[0] != '\0') {
+    for (int i = 0; i < list_size; i++) {
+        if (filelist[i].filename[0] != '\0') {
             num_files++;
         }
     }
+    printf("Number of files: %d\n", num_files);
 
-    // Find first blocks of each file
-    uint32_t first_blocks[num_files];
-    for (int i = 0; i < num_files; i++) {
-        // If file exists, add first block to array
-        if (t_filelist->filelist[i].filename[0] != '\0') {
-            first_blocks[i] = t_filelist->filelist[i].first_block;
-        } else {
-            first_blocks[i] = 0xFFFFFFFF;
+    // Target layout: the chains one after the other in the order of the File List, a block shared
+    // by several files where it is first met
+    d.planned = 0;
+    for (int64_t b = 0; b < block_count; b++) {
+        d.where[b] = -1;
+    }
+    for (int i = 0; i < list_size; i++) {
+        if (filelist[i].filename[0] == '\0') {
+            continue;
+        }
+        uint64_t block = filelist[i].first_block;
+        printf("%llu ", (unsigned long long)block);
+        while (block > 0 && block < (uint64_t)block_count && fat[block].dummy != 0 &&
+               d.where[block] == -1) {
+            d.where[block] = block;
+            d.plan[++d.planned] = block;
+            block = EndianConversion(fat[block].dummy);
         }
     }
+    printf("\n");
 
-    printf("Number of files: %d\n", num_files);
-    // Move data blocks and update FAT and File List
-    int new_index = 1;
-    for (int i = 0; i < num_files; i++) {
-        printf("%d ", first_blocks[i]);
-
-        int once = 0;
-        int dif = 0;
-        int current_block = first_blocks[i];
-        while (current_block != 0xFFFFFFFF) {
-            // Read data block from the original disk
-            int next_block = t_fat->listentries[current_block].dummy;
-            DataBlock data_block;
-            // Write data block to the temporary disk
-            fseek(disk,
-                  sizeof(FAT) + sizeof(FileList) +
-                      (current_block * sizeof(DataBlock)),
-                  SEEK_SET);
-            fread(&data_block, sizeof(DataBlock), 1, disk);
-            fseek(disk2,
-                  sizeof(FAT) + sizeof(FileList) +
-                      (new_index * sizeof(DataBlock)),
-                  SEEK_SET);
-            fwrite(&data_block, sizeof(DataBlock), 1, disk2);
-
-            next_block = EndianConversion(next_block);
-
-            // If last block, set next block to 0xFFFFFFFF
-            if (next_block == 0xFFFFFFFF) {
-                new_fat->listentries[new_index].dummy =
-                    EndianConversion(next_block);
-            } else {
-                new_fat->listentries[new_index].dummy =
-                    EndianConversion(new_index + 1);
+    // Blocks no file reaches are leftovers of an interrupted command
+    int64_t leaked = 0;
+    for (int64_t b = 1; b < block_count; b++) {
+        if (fat[b].dummy != 0 && d.where[b] == -1) {
+            SetFat(b, 0);
+            leaked++;
+        }
+        d.owner[b] = d.where[b];
+    }
+    d.owner[0] = -1;
+    if (leaked > 0) {
+        printf("Freed %lld unreachable blocks\n", (long long)leaked);
+    }
+
+    // References to every block of the layout, from the FAT and from the File List
+    for (int64_t b = 1; b < block_count; b++) {
+        uint64_t next_block = EndianConversion(fat[b].dummy);
+        if (d.where[b] != -1 && next_block < (uint64_t)block_count && d.where[next_block] != -1) {
+            d.ref_count[next_block]++;
+        }
+    }
+    for (int i = 0; i < list_size; i++) {
+        uint64_t block = filelist[i].first_block;
+        if (filelist[i].filename[0] != '\0' && block < (uint64_t)block_count && d.where[block] != -1) {
+            d.ref_count[block]++;
+        }
+    }
+    int64_t total = 0;
+    for (int64_t b = 0; b < block_count; b++) {
+        d.ref_start[b] = total;
+        total += d.ref_count[b];
+        d.ref_count[b] = 0;
+    }
+    for (int64_t b = 1; b < block_count; b++) {
+        uint64_t next_block = EndianConversion(fat[b].dummy);
+        if (d.where[b] != -1 && next_block < (uint64_t)block_count && d.where[next_block] != -1) {
+            d.refs[d.ref_start[next_block] + d.ref_count[next_block]++] = b;
+        }
+    }
+    for (int i = 0; i < list_size; i++) {
+        uint64_t block = filelist[i].first_block;
+        if (filelist[i].filename[0] != '\0' && block < (uint64_t)block_count && d.where[block] != -1) {
+            d.refs[d.ref_start[block] + d.ref_count[block]++] = -(i + 1);
+        }
+    }
+
+    // Filling a place vacates the place of the block that belongs there, the next one to fill: the
+    // places out of place form chains that start at a free place and end where a block comes from
+    // outside the layout, and cycles. A chain is cut every DefragSteps places and a cycle where it is
+    // met, by moving the block at that place out to a free block.
+    for (int pass = 0; pass < 2; pass++) {
+        for (int64_t p = 1; p <= d.planned; p++) {
+            if (d.cut[p] != 0 || d.where[d.plan[p]] == p || (pass == 0 && d.owner[p] != -1)) {
+                continue; // Chains first, what is left are cycles
+            }
+            int64_t steps = 0;
+            for (int64_t q = p; q <= d.planned && d.cut[q] == 0; q = d.where[d.plan[q]]) {
+                d.cut[q] = steps % DefragSteps == 0 && (pass == 1 || steps > 0) ? 2 : 1;
+                steps++;
             }
+        }
+    }
 
-            // // Write data block to the temporary disk
-            if (once == 0) {
-                new_filelist->filelist[i].first_block = new_index;
-                once = 1;
+    // Every round fills the places that are free and cuts where a free block outside the layout is
+    // left, then commits: the places it vacated are filled by the next one
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    long moves = 0;
+    int stopped = 0, failed = 0;
+    int64_t lo = 1; // The places before it are done
+    for (;;) {
+        while (lo <= d.planned && d.where[d.plan[lo]] == lo) {
+            lo++;
+        }
+        if (lo > d.planned) {
+            break;
+        }
+        long round_moves = moves;
+        int64_t next_hole = d.planned + 1; // Free blocks before it are taken
+        for (int64_t p = lo; p <= d.planned && !stopped && !failed; p++) {
+            if (d.where[d.plan[p]] == p) {
+                continue;
+            }
+            if (BudgetSpent(budget, in_ms, moves, &start)) {
+                stopped = 1;
+                break;
             }
+            if (free_map[p / WordBits] >> (p % WordBits) & 1) {
+                failed = MoveBlock(&d, d.where[d.plan[p]], p) != 0;
+                moves++;
+            } else if (d.cut[p] == 2 && d.owner[p] != -1 && next_hole != -1) {
+                next_hole = FindFreeFatEntry(next_hole);
+                if (next_hole != -1) {
+                    failed = MoveBlock(&d, p, next_hole) != 0;
+                    d.cut[p] = 1;
+                    next_hole++;
+                    moves++;
+                }
+            }
+        }
+        if (stopped || failed) {
+            break;
+        }
 
-            current_block = next_block;
-            new_index++;
+        // Only cycles that cannot be cut are left
+        if (moves == round_moves) {
+            printf("Error: No free block to defragment with\n");
+            failed = 1;
+            break;
+        }
+        if (FlushDisk() == 0) {
+            failed = 1;
+            break;
         }
     }
-    printf("\n");
-
-    // Write the new FAT and File List to the temporary disk
-    fseek(disk2, 0, SEEK_SET);
-    fwrite(new_fat, sizeof(FAT), 1, disk2);
-    fwrite(new_filelist, sizeof(FileList), 1, disk2);
-    free(t_fat);
-    free(t_filelist);
-    free(new_fat);
-    free(new_filelist);
-    
-    // Close files
-    fclose(disk);
-    fclose(disk2);
-    
-    // Rename the temporary file to the original disk location
-    if (rename(temp_file_name, disk_location) == -1) {
-        printf("Error: Could not rename temporary file\n");
-        remove(temp_file_name);
-        return;
+    if (failed && moves > 0) {
+        printf("Error: Could not move a block\n");
     }
-    printf("Defragmentation complete\n");
-}
 
-// Check if disk can be opened in a function
-int OpenDisk(char *loc) {
-    // Check if disk exists
-    FILE *disk = fopen(loc, "rb+");
-    if (disk == NULL) {
-        printf("Error: Could not open disk\n");
-        return 0;
+    printf("Moved %ld blocks\n", moves);
+    if (stopped) {
+        printf("Defragmentation paused, run -defragment again to continue\n");
+    } else if (!failed) {
+        printf("Defragmentation complete\n");
     }
-    return 1;
+    free(d.plan);
+    free(d.where);
+    free(d.owner);
+    free(d.cut);
+    free(d.ref_start);
+    free(d.ref_count);
+    free(d.refs);
 }
 
-int main(int argc, char *argv[]) {
-    if (argc < 3) {
-        printf("Usage: %s folder_name -function [args]\n", argv[0]);
-        return 1;
-    }
-
-    // Get the disk location
-    disk_location = argv[1];
-
-    // Open the disk
-    int disk_opened = OpenDisk(disk_location);
+// Run one command, argv holds the program, the disk and the command as on the command line
+int RunCommand(int argc, char *argv[]) {
     char *command = argv[2];
 
-    if (disk_opened == 0) {
-        printf("Error: Could not open disk\n");
-        return 1;
-    }
-
     if (strcmp(command, "-format") == 0) {
-        FormatDisk();
+        if (argc > 6) {
+            printf("Error: Invalid number of arguments for -format\n");
+            return 1;
+        }
+        long long geometry[3] = {DefaultBlockSize, DefaultBlockCount, DefaultListSize};
+        for (int i = 3; i < argc; i++) {
+            char *end;
+            geometry[i - 3] = strtoll(argv[i], &end, 10);
+            if (*end != '\0') {
+                printf("Error: Invalid disk geometry\n");
+                return 1;
+            }
+        }
+        FormatDisk(geometry[0], geometry[1], geometry[2]);
+    } else if (!formatted) {
+        printf("Error: Disk is not formatted\n");
+        return 1;
     } else if (strcmp(command, "-write") == 0) {
         if (argc != 5) {
             printf("Error: Invalid number of arguments for -write\n");
@@ -1122,11 +2061,28 @@ int main(int argc, char *argv[]) {
         }
         PrintFAT();
     } else if (strcmp(command, "-defragment") == 0) {
-        if (argc != 3) {
+        if (argc != 3 && argc != 4) {
             printf("Error: Invalid number of arguments for -defragment\n");
             return 1;
         }
-        Defragment();
+        long budget = 0;
+        int in_ms = 0;
+        if (argc == 4) {
+            char *end;
+            budget = strtol(argv[3], &end, 10);
+            in_ms = strcmp(end, "ms") == 0;
+            if (budget <= 0 || (*end != '\0' && !in_ms)) {
+                printf("Error: Invalid budget for -defragment\n");
+                return 1;
+            }
+        }
+        Defragment(budget, in_ms);
+    } else if (strcmp(command, "-checkpoint") == 0) {
+        if (argc != 3) {
+            printf("Error: Invalid number of arguments for -checkpoint\n");
+            return 1;
+        }
+        return FlushDisk() ? 0 : 1;
     } else {
         printf("Error: Invalid command\n");
         return 1;
@@ -1135,6 +2091,83 @@ int main(int argc, char *argv[]) {
     return 0;
 }
 
+// Run the commands of a script on the resident tables, returns the number of failed commands
+int RunBatch(char *script) {
+    FILE *input = stdin;
+    if (script != NULL && strcmp(script, "-") != 0) {
+        input = fopen(script, "r");
+        if (input == NULL) {
+            printf("Error: Could not open script\n");
+            return 1;
+        }
+    }
+
+    char line[LineSize];
+    int failed = 0;
+    script_stdin = input == stdin;
+    while (fgets(line, sizeof(line), input) != NULL) {
+        // Split the line into words after the program and the disk
+        char *args[MaxArgs + 2] = {"myfs", disk_location};
+        int count = 2;
+        for (char *word = strtok(line, " \t\r\n"); word != NULL; word = strtok(NULL, " \t\r\n")) {
+            if (count == 2 && word[0] == '#') {
+                break; // Comment
+            }
+            if (count < MaxArgs + 2) {
+                args[count] = word;
+            }
+            count++;
+        }
+        if (count == 2) {
+            continue; // Empty line
+        }
+        if (count > MaxArgs + 2 || strcmp(args[2], "-batch") == 0) {
+            printf("Error: Invalid command\n");
+            failed++;
+            continue;
+        }
+        failed += RunCommand(count, args);
+    }
+
+    if (input != stdin) {
+        fclose(input);
+    }
+    return failed;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 3) {
+        printf("Usage: %s folder_name -function [args]\n", argv[0]);
+        return 1;
+    }
+
+    // Get the disk location
+    disk_location = argv[1];
+
+    // Open the disk and load its tables
+    if (OpenDisk(disk_location) == 0) {
+        return 1;
+    }
+
+    int result;
+    if (strcmp(argv[2], "-batch") == 0) {
+        if (argc > 4) {
+            printf("Error: Invalid number of arguments for -batch\n");
+            CloseDisk();
+            return 1;
+        }
+        result = RunBatch(argc == 4 ? argv[3] : NULL) > 0;
+    } else {
+        result = RunCommand(argc, argv);
+    }
+
+    // Write back what changed
+    if (CloseDisk() == 0) {
+        return 1;
+    }
+    return result;
+}
+
 // Referneces:
 // *AlperKutay. (n.d.). EE-442-OPERATING-SYSTEMS. GitHub. https://github.com/AlperKutay/EE-442-OPERATING-SYSTEMS
 // *UseProxy305. (n.d.). EE442-Operating-Systems. GitHub. https://github.com/UseProxy305/EE442-Operating-Systems
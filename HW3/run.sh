@@ -0,0 +1,186 @@
+#!/bin/bash
+# Tests of myfs.c: ./run.sh from any directory. Prints every failed check and exits with status 1 if
+# there is one. The programs, disks and files are made in a temporary directory.
+
+cd "$(dirname "$0")" || exit 1
+IMAGE=$PWD/disk.image
+T=$(mktemp -d) || exit 1
+trap 'rm -rf "$T"' EXIT
+gcc -O2 -o "$T/myfs" myfs.c && gcc -O2 -DCRASH_TEST -o "$T/myfs_crash" myfs.c || exit 1
+cd "$T" || exit 1
+mkdir src
+
+failures=0
+fail() {
+    echo "FAIL: $*"
+    failures=$((failures + 1))
+}
+
+# A file of random bytes in src
+make_file() {
+    head -c "$2" /dev/urandom > "src/$1"
+}
+
+# Every listed file of a disk reads back as its source in src (a copy as the file it was made from)
+check_files() {
+    local name size
+    while read -r name size; do
+        [ -n "$size" ] || continue
+        ./myfs "$1" -read "$name" out.bin > /dev/null
+        cmp -s out.bin "src/${name%_copy}" || fail "$1 ($2): $name differs from its source"
+    done < <(./myfs "$1" -list | tail -n +2)
+}
+
+# A disk of 60 files with some deleted and written again, so that most chains are fragmented
+make_fragmented() {
+    local i
+    rm -f "$1"
+    touch "$1"
+    ./myfs "$1" -format > /dev/null
+    RANDOM=$2
+    for i in $(seq 1 60); do
+        make_file "f$i" $((RANDOM % 40000 + 1))
+        echo "-write src/f$i f$i"
+        if [ $((i % 3)) -eq 0 ]; then
+            echo "-delete f$((i - 2))"
+        fi
+        if [ $((i % 10)) -eq 0 ]; then
+            echo "-duplicate f$((i - 1))"
+        fi
+    done | ./myfs "$1" -batch > /dev/null
+}
+
+# Commands
+make_file small.bin 100070
+make_file mid.bin 62188
+make_file big.bin 1057485
+D=run.img
+touch $D
+{
+    ./myfs $D -format; ./myfs $D -list
+    ./myfs $D -write src/small.bin small.pdf; ./myfs $D -write src/big.bin big.pdf; ./myfs $D -list
+    ./myfs $D -write src/mid.bin middle.pdf; ./myfs $D -rename middle.pdf smallest.pdf
+    ./myfs $D -duplicate small.pdf; ./myfs $D -sorta
+    ./myfs $D -delete small.pdf_copy; ./myfs $D -hide smallest.pdf; ./myfs $D -list
+    ./myfs $D -search smallest.pdf; ./myfs $D -unhide smallest.pdf
+    ./myfs $D -read big.pdf out.bin; cmp out.bin src/big.bin && echo readok
+    ./myfs $D -delete small.pdf; ./myfs $D -write src/mid.bin m2; ./myfs $D -write src/small.bin s2
+    ./myfs $D -printfilelist; ./myfs $D -printfat
+    ./myfs $D -defragment; ./myfs $D -read s2 out.bin; cmp out.bin src/small.bin && echo read2ok
+    ./myfs $D -list; ./myfs $D -bogus
+} 2>&1 | grep -v '^Moved' > commands.out
+cat > commands.want << 'EOF'
+Disk formatted
+No files on disk
+File: small.pdf written to disk
+File: big.pdf written to disk
+Filename	Size
+small.pdf      	100070
+big.pdf        	1057485
+File: middle.pdf written to disk
+The name of the file middle.pdf is changed to smallest.pdf
+Filename	Size
+smallest.pdf   	62188
+small.pdf      	100070
+small.pdf_copy 	100070
+big.pdf        	1057485
+File deleted: small.pdf_copy
+File: smallest.pdf is hided successfully
+Filename	Size
+small.pdf      	100070
+big.pdf        	1057485
+NO
+File: smallest.pdf is unhided successfully
+File: big.pdf read from disk
+readok
+File deleted: small.pdf
+File: m2 written to disk
+File: s2 written to disk
+File: filelist.txt is created successfully
+File: fat.txt is created successfully
+Defragmenting...
+Number of files: 4
+1 197 2263 123
+Defragmentation complete
+File: s2 read from disk
+read2ok
+Filename	Size
+m2             	62188
+big.pdf        	1057485
+smallest.pdf   	62188
+s2             	100070
+Error: Invalid command
+EOF
+diff -b commands.want commands.out > /dev/null || fail "commands: output differs from the expected one"
+
+# Defragment with a budget of blocks, then of milliseconds, run again until it completes
+for budget in 5 1ms; do
+    make_fragmented budget.img 1
+    runs=0
+    until ./myfs budget.img -defragment $budget | grep -q 'Defragmentation complete'; do
+        runs=$((runs + 1))
+        [ $runs -lt 10000 ] || break
+    done
+    [ $runs -gt 0 ] || fail "defragment $budget: the budget did not stop it"
+    check_files budget.img "defragment $budget"
+    ./myfs budget.img -defragment | grep -q 'Moved 0 blocks' || fail "defragment $budget: not laid out"
+done
+
+# Crash in a batch before and after logging every commit: the disk opens with the files of the last
+# logged commit
+make_fragmented base.img 2
+for i in $(seq 1 12); do
+    cp "src/f$((i * 4))" "src/g$i"
+    echo "-write src/g$i g$i"
+    echo "-delete f$((i * 5))"
+    echo "-duplicate g$i"
+    echo "-checkpoint"
+done > batch.txt
+for k in $(seq -12 12); do
+    [ $k -ne 0 ] || continue
+    cp base.img crash.img
+    CRASH=$k ./myfs_crash crash.img -batch batch.txt > /dev/null
+    [ $? -eq 9 ] || fail "batch crash $k: did not crash"
+    check_files crash.img "batch crash $k"
+    logged=$((k > 0 ? k : -k - 1))
+    cp base.img want.img
+    awk -v k=$logged 'k == 0 { exit } { print } /^-checkpoint/ && ++n == k { exit }' batch.txt |
+        ./myfs want.img -batch > /dev/null
+    [ "$(./myfs crash.img -list)" == "$(./myfs want.img -list)" ] ||
+        fail "batch crash $k: the files are not those of commit $logged"
+done
+
+# Crash in -defragment before or after logging one of its first commits, until it completes
+make_fragmented crash.img 3
+for runs in $(seq 1 1000); do
+    crash=(-1 1 -2 2 -3 3)
+    CRASH=${crash[(runs - 1) % 6]} ./myfs_crash crash.img -defragment > defrag.out
+    status=$?
+    [ $status -eq 0 ] || [ $status -eq 9 ] || fail "defragment crash: exit status $status"
+    check_files crash.img "defragment crash $runs"
+    grep -q 'Defragmentation complete' defrag.out && break
+done
+./myfs crash.img -defragment | grep -q 'Moved 0 blocks' || fail "defragment crash: not laid out"
+
+# Format version 0: the sample disk is used in its own layout
+cp "$IMAGE" v0.img
+mkdir v0
+./myfs v0.img -list | tail -n +2 | while read -r name size; do
+    ./myfs v0.img -read "$name" "v0/$name" > /dev/null
+done
+make_file v0new 30000
+./myfs v0.img -write src/v0new v0new > /dev/null
+./myfs v0.img -defragment > /dev/null
+./myfs v0.img -read v0new out.bin > /dev/null
+cmp -s out.bin src/v0new || fail "version 0: the new file differs from its source"
+for f in v0/*; do
+    ./myfs v0.img -read "$(basename "$f")" out.bin > /dev/null
+    cmp -s out.bin "$f" || fail "version 0: $(basename "$f") changed"
+done
+[ "$(head -c 4 v0.img | od -An -tx1 | tr -d ' ')" == "ffffffff" ] || fail "version 0: the layout changed"
+
+if [ $failures -gt 0 ]; then
+    echo "$failures failed"
+    exit 1
+fi
+echo "PASS"